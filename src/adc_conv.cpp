@@ -0,0 +1,106 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "adc_conv.h"
+
+int32_t adc_conv_vcc(uint32_t vref_raw, uint16_t vrefint_cal, int32_t vrefint_mV)
+{
+    if (vref_raw == 0) {
+        return vrefint_mV;      // no valid reading yet
+    }
+
+    // VREFINT_CAL is a 12-bit value, so shift it to ADC_CONV_BITS resolution
+    return vrefint_mV * ((uint32_t)vrefint_cal << (ADC_CONV_BITS - 12)) / vref_raw;
+}
+
+int32_t adc_conv_full_scale(int32_t vcc_mV, int32_t gain_q16)
+{
+    // 64-bit multiplication necessary, but only called once per control cycle
+    return (int32_t)(((int64_t)vcc_mV * gain_q16) >> 16);
+}
+
+int32_t adc_conv_value(uint32_t raw, int32_t full_scale)
+{
+    // unsigned multiplication to avoid overflow for large full-scale values
+    return (int32_t)((raw * (uint32_t)full_scale) >> ADC_CONV_BITS);
+}
+
+uint32_t adc_conv_raw(int32_t value, int32_t full_scale)
+{
+    if (value <= 0 || full_scale <= 0) {
+        return 0;
+    }
+    else if (value >= full_scale) {
+        return (1 << ADC_CONV_BITS) - 1;
+    }
+    return ((int64_t)value << ADC_CONV_BITS) / full_scale;
+}
+
+uint32_t adc_conv_pwm_average(uint32_t on, uint32_t off, uint32_t duty_q16)
+{
+    // 64-bit multiplication necessary, but only called once per DMA interrupt
+    return off + (int32_t)(((int64_t)((int32_t)(on - off)) * duty_q16) >> 16);
+}
+
+int32_t adc_conv_ntc_temp(const int16_t *lut, uint32_t raw)
+{
+    const int shift = ADC_CONV_BITS - NTC_LUT_BITS;
+    uint32_t pos = raw >> shift;
+    if (pos >= (1 << NTC_LUT_BITS)) {
+        return lut[1 << NTC_LUT_BITS];
+    }
+    int32_t frac = raw & ((1 << shift) - 1);
+    return lut[pos] + (((int32_t)lut[pos + 1] - lut[pos]) * frac >> shift);
+}
+
+// limits drift of the offset to the allowed range around the calibrated value
+static int32_t auto_zero_clamp(const adc_auto_zero_t *az, int32_t offset_q8)
+{
+    if (offset_q8 > az->offset_init_q8 + (ADC_AUTO_ZERO_LIMIT << 8)) {
+        return az->offset_init_q8 + (ADC_AUTO_ZERO_LIMIT << 8);
+    }
+    else if (offset_q8 < az->offset_init_q8 - (ADC_AUTO_ZERO_LIMIT << 8)) {
+        return az->offset_init_q8 - (ADC_AUTO_ZERO_LIMIT << 8);
+    }
+    return offset_q8;
+}
+
+void adc_auto_zero_init(adc_auto_zero_t *az, int32_t current)
+{
+    az->offset_q8 = -current * 256;
+    az->offset_init_q8 = az->offset_q8;
+    az->zero_count = 0;
+}
+
+int32_t adc_auto_zero_update(adc_auto_zero_t *az, int32_t current, bool no_current)
+{
+    // deviation from the zero point calibrated at start-up
+    int32_t deviation = current + (az->offset_init_q8 >> 8);
+
+    if (no_current == false || deviation > ADC_AUTO_ZERO_LIMIT || deviation < -ADC_AUTO_ZERO_LIMIT) {
+        az->zero_count = 0;
+    }
+    else if (az->zero_count < ADC_AUTO_ZERO_DELAY) {
+        // wait until the current and the ADC filters have settled
+        az->zero_count++;
+    }
+    else {
+        // low pass filter with c = 1/2^ADC_AUTO_ZERO_SHIFT
+        az->offset_q8 = auto_zero_clamp(az, az->offset_q8 +
+            ((-current * 256 - az->offset_q8) >> ADC_AUTO_ZERO_SHIFT));
+    }
+    return az->offset_q8 >> 8;
+}
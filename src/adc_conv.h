@@ -0,0 +1,317 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ADC_CONV_H
+#define ADC_CONV_H
+
+/** @file
+ *
+ * @brief Hardware-independent conversion of raw ADC readings into measurement values
+ *
+ * The STM32F0 and STM32L0 MCUs don't have an FPU, so all conversions are done in
+ * fixed-point arithmetics. Voltages are calculated in mV and currents in mA. Conversion
+ * to float is only done when storing the values in the structs accessed via ThingSet.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Resolution (bits) of the raw ADC values used for conversion
+ *
+ * The ADC itself provides 12-bit values, but the exponential moving average filter
+ * increases the effective resolution.
+ */
+#define ADC_CONV_BITS 14
+
+/** Converts a gain or offset constant into Q16.16 fixed-point format
+ *
+ * Only to be used with compile-time constants (e.g. ADC_GAIN_V_BAT), so that no
+ * floating point operations remain in the firmware.
+ */
+#define ADC_Q16(x) ((int32_t)((x) * 65536.0 + ((x) < 0 ? -0.5 : 0.5)))
+
+/** Calculates the supply voltage of the ADC based on the internal reference
+ *
+ * @param vref_raw Raw ADC reading of VREFINT (ADC_CONV_BITS resolution)
+ * @param vrefint_cal Factory calibration value of VREFINT (12-bit)
+ * @param vrefint_mV Supply voltage during factory calibration of VREFINT (mV)
+ *
+ * @returns Supply voltage of the ADC (mV)
+ */
+int32_t adc_conv_vcc(uint32_t vref_raw, uint16_t vrefint_cal, int32_t vrefint_mV);
+
+/** Calculates the full-scale value of an ADC channel
+ *
+ * Should be called once per control cycle for each channel, as it depends on the
+ * actual supply voltage (see also adc_conv_scales()).
+ *
+ * @param vcc_mV Supply voltage of the ADC (mV)
+ * @param gain_q16 Gain of the channel in Q16.16 format, see ADC_Q16()
+ *
+ * @returns Measurement value at raw ADC full scale (mV or mA)
+ */
+int32_t adc_conv_full_scale(int32_t vcc_mV, int32_t gain_q16);
+
+/** Converts a raw ADC reading into a measurement value
+ *
+ * @param raw Raw ADC reading (ADC_CONV_BITS resolution)
+ * @param full_scale Full-scale value of the channel, see adc_conv_full_scale(),
+ *                   must be positive and below 2^(32 - ADC_CONV_BITS)
+ *
+ * @returns Measurement value (mV or mA)
+ */
+int32_t adc_conv_value(uint32_t raw, int32_t full_scale);
+
+/** Converts a measurement value into the corresponding raw ADC reading
+ *
+ * Inverse of adc_conv_value(), e.g. to set thresholds of the ADC analog watchdog.
+ *
+ * @param value Measurement value (mV or mA)
+ * @param full_scale Full-scale value of the channel, see adc_conv_full_scale(), must be positive
+ *
+ * @returns Raw ADC reading (ADC_CONV_BITS resolution), limited to the ADC range
+ */
+uint32_t adc_conv_raw(int32_t value, int32_t full_scale);
+
+/** Value of adc_channel_t.ref if no other measurement value should be added
+ */
+#define ADC_CONV_NO_REF 0xFF
+
+/** Conversion parameters of a linear ADC channel
+ *
+ * The measurement value is calculated as follows:
+ *
+ *     value = values[ref] + (raw / 2^ADC_CONV_BITS * gain + offset) * vcc
+ *
+ * The full-scale value |gain * vcc| must be below 2^(31 - ADC_CONV_BITS).
+ */
+typedef struct {
+    uint8_t pos;        ///< Position of the reading in the array written by the DMA (ADC_POS_*)
+    uint8_t dest;       ///< Index of the measurement value (ADC_MEAS_*), also defining the unit
+    uint8_t ref;        ///< Index of a previously converted measurement value to be added to
+                        ///< the result or ADC_CONV_NO_REF
+    int32_t gain;       ///< Gain in Q16.16 format, see ADC_Q16()
+    int32_t offset;     ///< Offset relative to supply voltage in Q16.16 format
+} adc_channel_t;
+
+/** Full-scale values of a linear ADC channel for the actual supply voltage
+ */
+typedef struct {
+    int32_t gain;       ///< Measurement value at raw ADC full scale (mV or mA)
+    int32_t offset;     ///< Offset (mV or mA)
+} adc_conv_scale_t;
+
+/** Calculates the full-scale values of all linear ADC channels
+ *
+ * Should be called once per control cycle, as the result depends on the actual supply
+ * voltage. The 64-bit multiplications are only necessary here, so that adc_conv_channels()
+ * can be called with high frequency.
+ *
+ * @param channels Table with conversion parameters (adc_channels in PCB header)
+ * @param vcc_mV Supply voltage of the ADC (mV), see adc_conv_vcc()
+ * @param scales Array to store the full-scale values (same size as channel table)
+ */
+template<unsigned int N>
+void adc_conv_scales(const adc_channel_t (&channels)[N], int32_t vcc_mV,
+    adc_conv_scale_t (&scales)[N])
+{
+    for (unsigned int i = 0; i < N; i++) {
+        scales[i].gain = adc_conv_full_scale(vcc_mV, channels[i].gain);
+        scales[i].offset = adc_conv_full_scale(vcc_mV, channels[i].offset);
+    }
+}
+
+/** Converts the readings of all linear ADC channels into measurement values
+ *
+ * The number of channels is a template parameter, so that the compiler can unroll the loop
+ * for the channel table of the PCB.
+ *
+ * @param channels Table with conversion parameters (adc_channels in PCB header)
+ * @param scales Full-scale values of the channels, see adc_conv_scales()
+ * @param raw Raw ADC readings of all channels (ADC_CONV_BITS resolution)
+ * @param values Array to store the measurement values (mV or mA)
+ */
+template<unsigned int N>
+void adc_conv_channels(const adc_channel_t (&channels)[N], const adc_conv_scale_t (&scales)[N],
+    const uint32_t raw[], int32_t values[])
+{
+    for (unsigned int i = 0; i < N; i++) {
+        const adc_channel_t *ch = &channels[i];
+        // signed multiplication, as gain may be negative
+        values[ch->dest] = (((int32_t)raw[ch->pos] * scales[i].gain) >> ADC_CONV_BITS)
+            + scales[i].offset + (ch->ref != ADC_CONV_NO_REF ? values[ch->ref] : 0);
+    }
+}
+
+/** Calculates the average of a signal switched by PWM
+ *
+ * Used for the solar current of the PWM charger, where the readings with switch on and off
+ * are filtered separately. The off-state reading contains the zero-current offset of the
+ * sensor, so it is not multiplied with the duty cycle.
+ *
+ * @param on Filtered reading with switch on
+ * @param off Filtered reading with switch off
+ * @param duty_q16 Duty cycle in Q16 format (0 to 2^16)
+ *
+ * @returns Average reading (same scaling as inputs)
+ */
+uint32_t adc_conv_pwm_average(uint32_t on, uint32_t off, uint32_t duty_q16);
+
+/** Number of control cycles with switched-off current path before the auto-zero starts
+ */
+#define ADC_AUTO_ZERO_DELAY 10
+
+/** Filter constant of the current sensor auto-zero (c = 1/2^ADC_AUTO_ZERO_SHIFT)
+ *
+ * Corresponds to a time constant of approx. 13 s at 10 Hz control frequency, so that
+ * short disturbances don't have a relevant effect.
+ */
+#define ADC_AUTO_ZERO_SHIFT 7
+
+/** Maximum drift of the zero-current offset of current sensors (mA)
+ *
+ * Relative to the offset calibrated at start-up, which may be much larger for sensors biased
+ * with a reference voltage. Readings deviating more than this value from the calibrated zero
+ * point are not considered as offset, but as actual current.
+ */
+#ifndef ADC_AUTO_ZERO_LIMIT
+#define ADC_AUTO_ZERO_LIMIT 500
+#endif
+
+/** Auto-zero state of a current measurement
+ */
+typedef struct {
+    int32_t offset_q8;          ///< Offset (mA) with 8 fractional bits
+    int32_t offset_init_q8;     ///< Offset calibrated at start-up (mA) with 8 fractional bits
+    uint16_t zero_count;        ///< Number of consecutive cycles with zero current expected
+} adc_auto_zero_t;
+
+/** Sets the offset of a current measurement immediately
+ *
+ * The offset is not limited, so that also sensors with a large bias can be calibrated. Later
+ * drift compensation is limited to ADC_AUTO_ZERO_LIMIT around this value.
+ *
+ * @param az Auto-zero state
+ * @param current Current measured without offset correction (mA), expected to be zero
+ */
+void adc_auto_zero_init(adc_auto_zero_t *az, int32_t current);
+
+/** Slowly adjusts the offset of a current measurement to compensate drift
+ *
+ * Should be called once per control cycle.
+ *
+ * @param az Auto-zero state
+ * @param current Current measured without offset correction (mA)
+ * @param no_current True if all switches in the current path are off
+ *
+ * @returns Offset to be added to the measured current (mA)
+ */
+int32_t adc_auto_zero_update(adc_auto_zero_t *az, int32_t current, bool no_current);
+
+/** Number of intervals of the NTC lookup table as power of two
+ *
+ * 2^8 intervals are needed to stay below 0.1°C interpolation error between -40°C and 125°C.
+ */
+#define NTC_LUT_BITS 8
+
+/** Lower and upper limit of temperatures stored in the NTC lookup table (°C)
+ *
+ * Values below -50°C are used to detect that no external sensor is connected.
+ */
+#define NTC_LUT_TEMP_MIN -100
+#define NTC_LUT_TEMP_MAX 250
+
+/** Nominal resistance of the NTC at 25°C (Ohm)
+ */
+#define NTC_R25 10000
+
+/** Natural logarithm (compile-time evaluation only)
+ *
+ * The argument is reduced to the interval [0.75, 1.5] and the remaining logarithm is
+ * calculated using the atanh series.
+ */
+constexpr double ntc_ln_series(double z2, double z_pow, int k)
+{
+    return k > 30 ? 0.0 : z_pow / (2 * k + 1) + ntc_ln_series(z2, z_pow * z2, k + 1);
+}
+
+constexpr double ntc_ln(double x)
+{
+    return x > 1.5 ? ntc_ln(x / 2) + 0.69314718055994531 :
+        x < 0.75 ? ntc_ln(x * 2) - 0.69314718055994531 :
+        2 * ntc_ln_series(((x - 1) / (x + 1)) * ((x - 1) / (x + 1)), (x - 1) / (x + 1), 0);
+}
+
+constexpr int16_t ntc_lut_round(double temp)
+{
+    return temp > NTC_LUT_TEMP_MAX * 100 ? NTC_LUT_TEMP_MAX * 100 :
+        temp < NTC_LUT_TEMP_MIN * 100 ? NTC_LUT_TEMP_MIN * 100 :
+        (int16_t)(temp + (temp < 0 ? -0.5 : 0.5));
+}
+
+/** Temperature calculation using Beta equation (compile-time evaluation only)
+ *
+ * @param ratio NTC voltage divided by supply voltage of the voltage divider
+ * @param r_series Resistance of the series resistor (Ohm)
+ * @param beta Beta value of the NTC (25°C reference temperature)
+ *
+ * @returns Temperature in 0.01°C
+ */
+constexpr int16_t ntc_lut_value(double ratio, int r_series, int beta)
+{
+    return ratio <= 0.0 ? NTC_LUT_TEMP_MAX * 100 :
+        ratio >= 1.0 ? NTC_LUT_TEMP_MIN * 100 :
+        ntc_lut_round(100.0 / (1.0 / (273.15 + 25) +
+            ntc_ln(r_series * ratio / (1.0 - ratio) / NTC_R25) / beta) - 100.0 * 273.15);
+}
+
+// index sequence for generation of the lookup table (C++11 compatible)
+template<int... I> struct ntc_lut_seq {};
+template<int N, int... I> struct ntc_lut_make_seq : ntc_lut_make_seq<N - 1, N - 1, I...> {};
+template<int... I> struct ntc_lut_make_seq<0, I...> { typedef ntc_lut_seq<I...> type; };
+
+/** NTC temperature lookup table generated at compile time
+ *
+ * Contains (2^NTC_LUT_BITS + 1) temperatures in 0.01°C for equally spaced raw ADC values
+ * from 0 to full scale. The NTC is assumed to be connected between the ADC pin and ground
+ * and the series resistor between the ADC pin and the ADC supply voltage.
+ *
+ * Usage: ntc_lut<NTC_SERIES_RESISTOR, NTC_BETA_VALUE>::values
+ */
+template<int R_SERIES, int BETA, typename Seq = typename ntc_lut_make_seq<(1 << NTC_LUT_BITS) + 1>::type>
+struct ntc_lut;
+
+template<int R_SERIES, int BETA, int... I>
+struct ntc_lut<R_SERIES, BETA, ntc_lut_seq<I...> >
+{
+    static constexpr int16_t values[sizeof...(I)] = {
+        ntc_lut_value((double)I / (1 << NTC_LUT_BITS), R_SERIES, BETA)...
+    };
+};
+
+template<int R_SERIES, int BETA, int... I>
+constexpr int16_t ntc_lut<R_SERIES, BETA, ntc_lut_seq<I...> >::values[sizeof...(I)];
+
+/** Calculates NTC temperature using linear interpolation of a lookup table
+ *
+ * @param lut Lookup table generated by ntc_lut
+ * @param raw Raw ADC reading (ADC_CONV_BITS resolution)
+ *
+ * @returns Temperature in 0.01°C
+ */
+int32_t adc_conv_ntc_temp(const int16_t *lut, uint32_t raw);
+
+#endif /* ADC_CONV_H */
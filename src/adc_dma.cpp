@@ -23,27 +23,12 @@
 #ifndef PIL_TESTING
 
 #include "adc_dma.h"
+#include "adc_filter.h"
+#include "adc_scope.h"
 #include "pcb.h"        // contains defines for pins
-#include <math.h>       // log for thermistor calculation
-#include "log.h"
 #include "pwm_switch.h"
-
-// factory calibration values for internal voltage reference and temperature sensor (see MCU datasheet, not RM)
-#if defined(STM32F0)
-    const uint16_t VREFINT_CAL = *((uint16_t *)0x1FFFF7BA); // VREFINT @3.3V/30°C
-    #define VREFINT_VALUE 3300 // mV
-    const uint16_t TSENSE_CAL1 = *((uint16_t *)0x1FFFF7B8);
-    const uint16_t TSENSE_CAL2 = *((uint16_t *)0x1FFFF7C2);
-    #define TSENSE_CAL1_VALUE 30.0   // temperature of first calibration point
-    #define TSENSE_CAL2_VALUE 110.0  // temperature of second calibration point
-#elif defined(STM32L0)
-    const uint16_t VREFINT_CAL = *((uint16_t *)0x1FF80078);   // VREFINT @3.0V/25°C
-    #define VREFINT_VALUE 3000 // mV
-    const uint16_t TSENSE_CAL1 = *((uint16_t *)0x1FF8007A);
-    const uint16_t TSENSE_CAL2 = *((uint16_t *)0x1FF8007E);
-    #define TSENSE_CAL1_VALUE 30.0   // temperature of first calibration point
-    #define TSENSE_CAL2_VALUE 130.0  // temperature of second calibration point
-#endif
+#include "half_bridge.h"
+#include "dcdc.h"
 
 #ifdef PIN_REF_I_DCDC
 AnalogOut ref_i_dcdc(PIN_REF_I_DCDC);
@@ -53,153 +38,20 @@ AnalogOut ref_i_dcdc(PIN_REF_I_DCDC);
 DigitalInOut temp_pd(PIN_TEMP_INT_PD);
 #endif
 
-float dcdc_current_offset;
-float load_current_offset;
+// for ADC and DMA (double buffer, each half contains ADC_DMA_FRAMES conversion sequences)
+volatile uint16_t adc_readings[2][ADC_DMA_FRAMES][NUM_ADC_CH];
 
-// for ADC and DMA
-volatile uint16_t adc_readings[NUM_ADC_CH] = {0};
-volatile uint32_t adc_filtered[NUM_ADC_CH] = {0};
+// period of the hardware trigger for ADC conversion sequences (SystemCoreClock cycles)
+static int adc_trig_period;
 //volatile int num_adc_conversions;
 
-#define ADC_FILTER_CONST 5          // filter multiplier = 1/(2^ADC_FILTER_CONST)
-
-extern Serial serial;
-extern log_data_t log_data;
-extern float mcu_temp;
-
-void calibrate_current_sensors(dcdc_t *dcdc, load_output_t *load)
-{
-    dcdc_current_offset = -dcdc->ls_current;
-    load_current_offset = -load->current;
-}
-
-//----------------------------------------------------------------------------
-void update_measurements(dcdc_t *dcdc, battery_state_t *bat, load_output_t *load, power_port_t *hs, power_port_t *ls)
-{
-    //int v_temp, rts;
-
-    // reference voltage of 2.5 V at PIN_V_REF
-    //int vcc = 2500 * 4096 / (adc_filtered[ADC_POS_V_REF] >> (4 + ADC_FILTER_CONST));
-
-    // internal STM reference voltage
-    int vcc = VREFINT_VALUE * VREFINT_CAL / (adc_filtered[ADC_POS_VREF_MCU] >> (4 + ADC_FILTER_CONST));
-
-    // rely on LDO accuracy
-    //int vcc = 3300;
-
-    ls->voltage =
-        (float)(((adc_filtered[ADC_POS_V_BAT] >> (4 + ADC_FILTER_CONST)) * vcc) / 4096) *
-        ADC_GAIN_V_BAT / 1000.0;
-    load->voltage = ls->voltage;
-
-    hs->voltage =
-        (float)(((adc_filtered[ADC_POS_V_SOLAR] >> (4 + ADC_FILTER_CONST)) * vcc) / 4096) *
-        ADC_GAIN_V_SOLAR / 1000.0;
-
-#ifdef ADC_OFFSET_V_SOLAR
-    hs->voltage = ls->voltage + -(vcc * ADC_OFFSET_V_SOLAR / 1000.0 + hs->voltage);
+#ifdef PWM_CHANNEL_PHASE2
+// thresholds of the overcurrent trip of the second phase (scaling of the DMA readings)
+static uint32_t phase2_trip_low = 0;
+static uint32_t phase2_trip_high = UINT16_MAX;
 #endif
 
-    load->current =
-        (float)(((adc_filtered[ADC_POS_I_LOAD] >> (4 + ADC_FILTER_CONST)) * vcc) / 4096) *
-        ADC_GAIN_I_LOAD / 1000.0 + load_current_offset;
-
-    /// \todo Multiply current with PWM duty cycle for PWM charger to get avg current.
-#ifdef CHARGER_TYPE_PWM
-    hs->current =
-        (float)(((adc_filtered[ADC_POS_I_SOLAR] >> (4 + ADC_FILTER_CONST)) * vcc) / 4096) *
-        ADC_GAIN_I_SOLAR / 1000.0 + dcdc_current_offset;
-    ls->current = hs->current - load->current;
-#else // MPPT
-    dcdc->ls_current =
-        (float)(((adc_filtered[ADC_POS_I_DCDC] >> (4 + ADC_FILTER_CONST)) * vcc) / 4096) *
-        ADC_GAIN_I_DCDC / 1000.0 + dcdc_current_offset;
-    ls->current = dcdc->ls_current - load->current;
-    hs->current = -dcdc->ls_current * ls->voltage / hs->voltage;
-#endif
-
-
-    /** \todo Improved (faster) temperature calculation:
-       https://www.embeddedrelated.com/showarticle/91.php
-    */
-
-    float v_temp, rts;
-    float bat_temp = 25.0;
-
-#ifdef PIN_ADC_TEMP_BAT
-    // battery temperature calculation
-    v_temp = ((adc_filtered[ADC_POS_TEMP_BAT] >> (4 + ADC_FILTER_CONST)) * vcc) / 4096;  // voltage read by ADC (mV)
-    rts = NTC_SERIES_RESISTOR * v_temp / (vcc - v_temp); // resistance of NTC (Ohm)
-
-    // Temperature calculation using Beta equation for 10k thermistor
-    // (25°C reference temperature for Beta equation assumed)
-    bat_temp = 1.0/(1.0/(273.15+25) + 1.0/NTC_BETA_VALUE*log(rts/10000.0)) - 273.15; // °C
-#endif
-
-    detect_battery_temperature(bat, bat_temp);
-
-#ifdef PIN_ADC_TEMP_FETS
-    // MOSFET temperature calculation
-    v_temp = ((adc_filtered[ADC_POS_TEMP_FETS] >> (4 + ADC_FILTER_CONST)) * vcc) / 4096;  // voltage read by ADC (mV)
-    rts = 10000 * v_temp / (vcc - v_temp); // resistance of NTC (Ohm)
-    dcdc->temp_mosfets = 1.0/(1.0/(273.15+25) + 1.0/NTC_BETA_VALUE*log(rts/10000.0)) - 273.15; // °C
-#endif
-
-    // internal MCU temperature
-    uint16_t adcval = (adc_filtered[ADC_POS_TEMP_MCU] >> (4 + ADC_FILTER_CONST)) * vcc / VREFINT_VALUE;
-    mcu_temp = (TSENSE_CAL2_VALUE - TSENSE_CAL1_VALUE) / (TSENSE_CAL2 - TSENSE_CAL1) * (adcval - TSENSE_CAL1) + TSENSE_CAL1_VALUE;
-    //printf("TS_CAL1:%d TS_CAL2:%d ADC:%d, temp_int:%f\n", TS_CAL1, TS_CAL2, adcval, meas->temp_int);
-
-    if (ls->voltage > log_data.battery_voltage_max) {
-        log_data.battery_voltage_max = ls->voltage;
-    }
-
-    if (hs->voltage > log_data.solar_voltage_max) {
-        log_data.solar_voltage_max = hs->voltage;
-    }
-
-    if (dcdc_current_offset < 0.1) {    // already calibrated
-        if (ls->current > log_data.dcdc_current_max) {
-            log_data.dcdc_current_max = ls->current;
-        }
-
-        if (load->current > log_data.load_current_max) {
-            log_data.load_current_max = load->current;
-        }
-
-        if (ls->current > 0) {
-            uint16_t solar_power = ls->voltage * ls->current;
-            if (solar_power > log_data.solar_power_max_day) {
-                log_data.solar_power_max_day = solar_power;
-                if (log_data.solar_power_max_day > log_data.solar_power_max_total) {
-                    log_data.solar_power_max_total = log_data.solar_power_max_day;
-                }
-            }
-        }
-
-        if (load->current > 0) {
-            uint16_t load_power = ls->voltage * load->current;
-            if (load_power > log_data.load_power_max_day) {
-                log_data.load_power_max_day = load_power;
-                if (log_data.load_power_max_day > log_data.load_power_max_total) {
-                    log_data.load_power_max_total = log_data.load_power_max_day;
-                }
-            }
-        }
-    }
-
-    if (dcdc->temp_mosfets > log_data.mosfet_temp_max) {
-        log_data.mosfet_temp_max = dcdc->temp_mosfets;
-    }
-
-    if (bat->temperature > log_data.bat_temp_max) {
-        log_data.bat_temp_max = bat->temperature;
-    }
-
-    if (mcu_temp > log_data.int_temp_max) {
-        log_data.int_temp_max = mcu_temp;
-    }
-}
+extern dcdc_t dcdc[DCDC_NUM_CONVERTERS];
 
 void detect_battery_temperature(battery_state_t *bat, float bat_temp)
 {
@@ -270,10 +122,10 @@ void dma_setup()
     DMA1_Channel1->CPAR = (uint32_t)(&(ADC1->DR));
 
     /* Configure the memory address */
-    DMA1_Channel1->CMAR = (uint32_t)(&(adc_readings[0]));
+    DMA1_Channel1->CMAR = (uint32_t)(&(adc_readings[0][0][0]));
 
-    /* Configure the number of DMA tranfer to be performed on DMA channel 1 */
-    DMA1_Channel1->CNDTR = NUM_ADC_CH;
+    /* Configure the number of DMA tranfer to be performed on DMA channel 1 (both halves) */
+    DMA1_Channel1->CNDTR = 2 * ADC_DMA_FRAMES * NUM_ADC_CH;
 
     /* Configure increment, size, interrupts and circular mode */
     DMA1_Channel1->CCR =
@@ -281,6 +133,7 @@ void dma_setup()
         DMA_CCR_MSIZE_0 |       /* memory size 16-bit */
         DMA_CCR_PSIZE_0 |       /* peripheral size 16-bit */
         DMA_CCR_TEIE |          /* transfer error interrupt enable */
+        DMA_CCR_HTIE |          /* half transfer interrupt enable */
         DMA_CCR_TCIE |          /* transfer complete interrupt enable */
         DMA_CCR_CIRC;           /* circular mode enable */
                                 /* DIR = 0: read from peripheral */
@@ -291,35 +144,52 @@ void dma_setup()
     /* Configure NVIC for DMA (priority 2: second-lowest value for STM32L0/F0) */
     NVIC_SetPriority(DMA1_Channel1_IRQn, 2);
     NVIC_EnableIRQ(DMA1_Channel1_IRQn);
-
-    // Trigger ADC conversions
-    ADC1->CR |= ADC_CR_ADSTART;
 }
 
-extern "C" void DMA1_Channel1_IRQHandler(void)
+/** Filters one half of the DMA buffer and stores the raw frames for diagnosis
+ */
+static void adc_process_frames(volatile uint16_t frames[ADC_DMA_FRAMES][NUM_ADC_CH])
 {
-    if ((DMA1->ISR & DMA_ISR_TCIF1) != 0) // Test if transfer completed on DMA channel 1
-    {
-        // low pass filter with filter constant c = 1/16
-        // y(n) = c * x(n) + (c - 1) * y(n-1)
 #ifdef CHARGER_TYPE_PWM
-        for (unsigned int i = 0; i < NUM_ADC_CH; i++) {
-            if (i == ADC_POS_V_SOLAR || i == ADC_POS_I_SOLAR) {
-                // only read input voltage and current when switch is on or permanently off
-                if (GPIOB->IDR & GPIO_PIN_1 || pwm_switch_enabled() == false) {
-                    adc_filtered[i] += (uint32_t)adc_readings[i] - (adc_filtered[i] >> ADC_FILTER_CONST);
-                }
-            }
-            else {
-                adc_filtered[i] += (uint32_t)adc_readings[i] - (adc_filtered[i] >> ADC_FILTER_CONST);
-            }
-        }
+    adc_pwm_frames_t pwm;
+    adc_pwm_frames_classify(&pwm, pwm_switch_enabled(), pwm_switch_get_period_clocks(),
+        pwm_switch_get_on_clocks(), pwm_switch_get_phase_clocks(), adc_trig_period);
+    adc_filter_frames(frames, &pwm);
 #else
-        for (unsigned int i = 0; i < NUM_ADC_CH; i++) {
-            // adc_readings: 12-bit ADC values left-aligned in uint16_t
-            adc_filtered[i] += (uint32_t)adc_readings[i] - (adc_filtered[i] >> ADC_FILTER_CONST);
+#ifdef PWM_CHANNEL_PHASE2
+    // overcurrent trip of the second phase (see adc_set_phase2_trip)
+    for (int i = 0; i < ADC_DMA_FRAMES; i++) {
+        if (frames[i][ADC_POS_I_PHASE2] < phase2_trip_low
+            || frames[i][ADC_POS_I_PHASE2] > phase2_trip_high)
+        {
+            half_bridge_trip();
+            break;
         }
+    }
 #endif
+    adc_filter_frames(frames, NULL);
+
+    // inner current/voltage control loop of the DC/DC with ADC rate
+    dcdc_fast_meas_t fast_meas;
+    update_fast_measurements(&fast_meas);
+    for (int i = 0; i < DCDC_NUM_CONVERTERS; i++) {
+        dcdc_fast_control(&dcdc[i], &fast_meas);
+    }
+#endif
+
+    // raw frames for diagnosis (returns immediately if scope is not armed)
+    adc_scope_push(frames, ADC_DMA_FRAMES, 16 - ADC_READING_BITS);
+}
+
+extern "C" void DMA1_Channel1_IRQHandler(void)
+{
+    if ((DMA1->ISR & DMA_ISR_TCIF1) != 0) {
+        // transfer completed on DMA channel 1: second half of buffer ready
+        adc_process_frames(adc_readings[1]);
+    }
+    else if ((DMA1->ISR & DMA_ISR_HTIF1) != 0) {
+        // half transfer on DMA channel 1: first half of buffer ready
+        adc_process_frames(adc_readings[0]);
     }
     DMA1->IFCR |= 0x0FFFFFFF;       // clear all interrupt registers
 }
@@ -351,6 +221,9 @@ void adc_setup()
     hadc.Init.ExternalTrigConvEdge  = ADC_EXTERNALTRIGCONVEDGE_NONE;
     hadc.Init.DMAContinuousRequests = ENABLE; //DISABLE;
     hadc.Init.Overrun               = ADC_OVR_DATA_OVERWRITTEN;
+#if defined(STM32L0)
+    hadc.Init.OversamplingMode      = DISABLE;      // configured directly in registers below
+#endif
 
     if (HAL_ADC_Init(&hadc) != HAL_OK) {
         error("Cannot initialize ADC");
@@ -390,7 +263,20 @@ void adc_setup()
     // 110: 71.5 ADC clock cycles
     // 111: 239.5 ADC clock cycles
     //ADC1->SMPR = ADC_SMPR_SMP_1;      // for normal ADC OK
+#if ADC_OVS_RATIO_LOG2 > 0
+    // STM32L0 (different sampling times): 110 = 79.5 ADC clock cycles, i.e. 10 us at 8 MHz
+    // ADC clock, which is the minimum for internal reference and temperature and short
+    // enough to finish all oversampled conversions before the next trigger
+    ADC1->SMPR |= ADC_SMPR_SMP_1 | ADC_SMPR_SMP_2;
+#else
     ADC1->SMPR |= ADC_SMPR_SMP_0 | ADC_SMPR_SMP_1 | ADC_SMPR_SMP_2;      // necessary for internal reference and temperature
+#endif
+
+#if ADC_OVS_RATIO_LOG2 > 0
+    // Hardware oversampling of each conversion (ALIGN bit is ignored in this mode and the
+    // sum is stored right-aligned without shift)
+    ADC1->CFGR2 |= ADC_CFGR2_OVSE | (ADC_OVS_RATIO_LOG2 - 1) * ADC_CFGR2_OVSR_0;
+#endif
 
     // Select ADC channels based on setup in config.h
     ADC1->CHSELR = ADC_CHSEL;
@@ -400,70 +286,150 @@ void adc_setup()
     ADC->CCR |= ADC_CCR_TSEN | ADC_CCR_VREFEN;
 }
 
-#if defined(STM32F0)
+#ifndef CHARGER_TYPE_PWM
 
-void adc_timer_start(int freq_Hz)   // max. 10 kHz
+/** Right shift of raw readings to get the 12-bit watchdog thresholds
+ *
+ * The watchdog compares 12-bit values independent of the data alignment. With hardware
+ * oversampling (STM32L0), the 12 MSBs of the 16-bit oversampled sum (ADC_DR[15:4]) are used
+ * instead.
+ */
+#if ADC_OVS_RATIO_LOG2 > 0
+#define ADC_AWD_SHIFT (ADC_CONV_BITS - ADC_READING_BITS + 4)
+#else
+#define ADC_AWD_SHIFT (ADC_CONV_BITS - 12)
+#endif
+
+#if ADC_AWD_SHIFT < 0 || ADC_READING_BITS < ADC_CONV_BITS
+#error "Unsupported ADC resolution for DC/DC overcurrent trip"
+#endif
+
+// ADC channel number of a position in the conversion sequence (ascending channel numbers)
+static int adc_channel(unsigned int pos)
 {
-    // Enable TIM15 clock
-    RCC->APB2ENR |= RCC_APB2ENR_TIM15EN;
+    for (int ch = 0; ch < 32; ch++) {
+        if (ADC_CHSEL & (1UL << ch)) {
+            if (pos == 0) {
+                return ch;
+            }
+            pos--;
+        }
+    }
+    return -1;
+}
 
-    // Set timer clock to 10 kHz
-    TIM15->PSC = SystemCoreClock / 10000 - 1;
+void adc_set_dcdc_trip(uint32_t low, uint32_t high)
+{
+    // Watchdog Threshold Register
+    ADC1->TR = ((high >> ADC_AWD_SHIFT) << 16) | (low >> ADC_AWD_SHIFT);
 
-    // Interrupt on timer update
-    TIM15->DIER |= TIM_DIER_UIE;
+    if ((ADC1->CFGR1 & ADC_CFGR1_AWDEN) == 0) {
+        // AWDEN = 1, AWDSGL = 1: analog watchdog enabled on a single channel
+        ADC1->CFGR1 |= ADC_CFGR1_AWDEN | ADC_CFGR1_AWDSGL
+            | (adc_channel(ADC_POS_I_DCDC) << ADC_CFGR1_AWDCH_Pos);
 
-    // Auto Reload Register sets interrupt frequency
-    TIM15->ARR = 10000 / freq_Hz - 1;
+        // Interrupt Enable Register
+        // AWDIE = 1: analog watchdog interrupt enable
+        ADC1->IER |= ADC_IER_AWDIE;
 
-    // 2 = second-lowest priority of STM32L0/F0
-    NVIC_SetPriority(TIM15_IRQn, 2);
-    NVIC_EnableIRQ(TIM15_IRQn);
+        // highest priority (above control timer and DMA)
+        NVIC_SetPriority(ADC1_COMP_IRQn, 0);
+        NVIC_EnableIRQ(ADC1_COMP_IRQn);
+    }
+}
 
-    // Control Register 1
-    // TIM_CR1_CEN =  1: Counter enable
-    TIM15->CR1 |= TIM_CR1_CEN;
+#ifdef PWM_CHANNEL_PHASE2
+void adc_set_phase2_trip(uint32_t low, uint32_t high)
+{
+    phase2_trip_low = low << (ADC_READING_BITS - ADC_CONV_BITS);
+    phase2_trip_high = high << (ADC_READING_BITS - ADC_CONV_BITS);
 }
+#endif
 
-extern "C" void TIM15_IRQHandler(void)
+extern "C" void ADC1_COMP_IRQHandler(void)
 {
-    TIM15->SR &= ~(1 << 0);
-    ADC1->CR |= ADC_CR_ADSTART;
+    if (ADC1->ISR & ADC_ISR_AWD) {
+        half_bridge_trip();
+        ADC1->ISR = ADC_ISR_AWD;        // clear flag by writing 1
+    }
 }
 
+#else
+
+// no DC/DC converter: the PWM switch is protected by the charger control
+void adc_set_dcdc_trip(uint32_t low, uint32_t high)
+{
+    (void)low;
+    (void)high;
+}
+
+#endif
+
+// timer generating the ADC trigger via TRGO (no interrupts necessary)
+#if defined(STM32F0)
+#define ADC_TRIG_TIM TIM15
+#define ADC_TRIG_EXTSEL ADC_CFGR1_EXTSEL_2      // TRG4: TIM15_TRGO
 #elif defined(STM32L0)
+#define ADC_TRIG_TIM TIM6
+#define ADC_TRIG_EXTSEL 0                       // TRG0: TIM6_TRGO
+#endif
 
-void adc_timer_start(int freq_Hz)   // max. 10 kHz
+void adc_timer_start(int freq_Hz)   // 1-10 kHz
 {
-    // Enable TIM6 clock
+    // Enable timer clock
+#if defined(STM32F0)
+    RCC->APB2ENR |= RCC_APB2ENR_TIM15EN;
+#elif defined(STM32L0)
     RCC->APB1ENR |= RCC_APB1ENR_TIM6EN;
+#endif
 
-    // Set timer clock to 10 kHz
-    TIM6->PSC = SystemCoreClock / 10000 - 1;
+    // No prescaler --> same timer clock as PWM timer
+    ADC_TRIG_TIM->PSC = 0;
 
-    // Interrupt on timer update
-    TIM6->DIER |= TIM_DIER_UIE;
+#ifdef CHARGER_TYPE_PWM
+    // Switching period is a multiple of the trigger period (pwm_switch_init must have
+    // been called before)
+    int pwm_period = pwm_switch_get_period_clocks();
+    int num_triggers = (pwm_period + SystemCoreClock / freq_Hz / 2) / (SystemCoreClock / freq_Hz);
+    adc_trig_period = pwm_period / num_triggers;
+#else
+    // Trigger period is a multiple of the switching period (half_bridge_init must have been
+    // called before)
+    int pwm_period = half_bridge_get_period_clocks();
+    int num_periods = (SystemCoreClock / freq_Hz + pwm_period / 2) / pwm_period;
+    adc_trig_period = num_periods * pwm_period;
+#endif
 
-    // Auto Reload Register sets interrupt frequency
-    TIM6->ARR = 10000 / freq_Hz - 1;
+    // Auto Reload Register sets trigger frequency
+    ADC_TRIG_TIM->ARR = adc_trig_period - 1;
 
-    // 2 = second-lowest priority of STM32L0/F0
-    NVIC_SetPriority(TIM6_IRQn, 2);
-    NVIC_EnableIRQ(TIM6_IRQn);
+    // Master mode selection
+    // MMS = 010: Update event is used as trigger output (TRGO)
+    ADC_TRIG_TIM->CR2 = (ADC_TRIG_TIM->CR2 & ~(TIM_CR2_MMS)) | TIM_CR2_MMS_1;
 
+    // Start counter with the current phase of the PWM timer, so that the update events stay
+    // synchronized with the switching period (only delayed by a few clock cycles). For the
+    // DC/DC converter, the trigger occurs in the center of the high-side on-time.
+    __disable_irq();
+#ifdef CHARGER_TYPE_PWM
+    ADC_TRIG_TIM->CNT = pwm_switch_get_phase_clocks() % adc_trig_period;
+#else
+    ADC_TRIG_TIM->CNT = half_bridge_get_phase_clocks();
+#endif
     // Control Register 1
     // TIM_CR1_CEN =  1: Counter enable
-    TIM6->CR1 |= TIM_CR1_CEN;
-}
+    ADC_TRIG_TIM->CR1 |= TIM_CR1_CEN;
+    __enable_irq();
 
-extern "C" void TIM6_IRQHandler(void)
-{
-    TIM6->SR &= ~(1 << 0);
+    // External trigger selection (ADC must not be started yet)
+    // EXTEN = 01: Hardware trigger detection on the rising edge
+    ADC1->CFGR1 = (ADC1->CFGR1 & ~(ADC_CFGR1_EXTEN | ADC_CFGR1_EXTSEL)) |
+        ADC_CFGR1_EXTEN_0 | ADC_TRIG_EXTSEL;
+
+    // Enable ADC, conversions are started by the hardware trigger
     ADC1->CR |= ADC_CR_ADSTART;
 }
 
-#endif
-
 #endif /* TESTING_PIL */
 
 #endif /* UNIT_TEST */
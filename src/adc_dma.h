@@ -22,25 +22,21 @@
  * @brief Reads ADC via DMA and stores data into necessary structs
  */
 
-#include "dcdc.h"
-#include "load.h"
+#include "measurements.h"
 #include "battery.h"
 
-/** Sets offset to actual measured value, i.e. sets zero current point.
- *
- * All input/output switches and consumers should be switched off before calling this function
- */
-void calibrate_current_sensors(dcdc_t *dcdc, load_output_t *load);
+#include <stdint.h>
 
 /** Detects if external temperature sensor is attached, otherwise takes internal sensor
  */
 void detect_battery_temperature(battery_state_t *bat, float bat_temp);
 
-/** Updates structures with data read from ADC
- */
-void update_measurements(dcdc_t *dcdc, battery_state_t *bat, load_output_t *load, power_port_t *hs, power_port_t *ls);
-
 /** Initializes registers and starts ADC timer
+ *
+ * The timer triggers the ADC conversions in hardware, synchronized with the PWM of the
+ * half bridge or PWM switch, so the PWM has to be initialized before calling this function.
+ *
+ * @param freq_Hz Trigger frequency (rounded to match the switching frequency)
  */
 void adc_timer_start(int freq_Hz);
 
@@ -52,4 +48,29 @@ void adc_setup(void);
  */
 void dma_setup(void);
 
+/** Sets the thresholds of the fast overcurrent trip of the DC/DC
+ *
+ * The ADC analog watchdog checks each conversion of the DC/DC current and calls
+ * half_bridge_trip() from its interrupt if the reading is outside the thresholds, so the
+ * reaction time is determined by the ADC trigger period instead of the control loop.
+ *
+ * With hardware oversampling (STM32L0), the thresholds are scaled to the oversampled result
+ * compared by the watchdog.
+ *
+ * @param low Lower threshold as raw ADC reading (ADC_CONV_BITS resolution)
+ * @param high Upper threshold as raw ADC reading (ADC_CONV_BITS resolution)
+ */
+void adc_set_dcdc_trip(uint32_t low, uint32_t high);
+
+/** Sets the thresholds of the fast overcurrent trip of the second phase (interleaved DC/DC)
+ *
+ * The watchdog can only be assigned to a single channel, so the readings of the second phase
+ * are checked by software for each frame of the DMA buffer and half_bridge_trip() is called
+ * from the DMA interrupt. Only available for PCBs with PWM_CHANNEL_PHASE2.
+ *
+ * @param low Lower threshold as raw ADC reading (ADC_CONV_BITS resolution)
+ * @param high Upper threshold as raw ADC reading (ADC_CONV_BITS resolution)
+ */
+void adc_set_phase2_trip(uint32_t low, uint32_t high);
+
 #endif /* ADC_DMA */
@@ -24,13 +24,11 @@
 #include "adc_dma.h"
 #include "pcb.h"        // contains defines for pins
 #include <math.h>       // log for thermistor calculation
-#include "log.h"
 #include "pwm_switch.h"
 
 #include "pil_test.h"
 
 extern Serial serial;
-extern log_data_t log_data;
 extern float mcu_temp;
 
 extern pil_test_data_t sim_data;
@@ -68,58 +66,10 @@ void update_measurements(dcdc_t *dcdc, battery_state_t *bat, load_output_t *load
     bat->temperature = sim_data.bat_temperature;
     dcdc->temp_mosfets = sim_data.internal_temperature;
     mcu_temp = sim_data.mcu_temperature;
-
-    if (ls->voltage > log_data.battery_voltage_max) {
-        log_data.battery_voltage_max = ls->voltage;
-    }
-
-    if (hs->voltage > log_data.solar_voltage_max) {
-        log_data.solar_voltage_max = hs->voltage;
-    }
-
-    if (ls->current > log_data.dcdc_current_max) {
-        log_data.dcdc_current_max = ls->current;
-    }
-
-    if (load->current > log_data.load_current_max) {
-        log_data.load_current_max = load->current;
-    }
-
-    if (ls->current > 0) {
-        uint16_t solar_power = ls->voltage * ls->current;
-        if (solar_power > log_data.solar_power_max_day) {
-            log_data.solar_power_max_day = solar_power;
-            if (log_data.solar_power_max_day > log_data.solar_power_max_total) {
-                log_data.solar_power_max_total = log_data.solar_power_max_day;
-            }
-        }
-    }
-
-    if (load->current > 0) {
-        uint16_t load_power = ls->voltage * load->current;
-        if (load_power > log_data.load_power_max_day) {
-            log_data.load_power_max_day = load_power;
-            if (log_data.load_power_max_day > log_data.load_power_max_total) {
-                log_data.load_power_max_total = log_data.load_power_max_day;
-            }
-        }
-    }
-
-    if (dcdc->temp_mosfets > log_data.mosfet_temp_max) {
-        log_data.mosfet_temp_max = dcdc->temp_mosfets;
-    }
-
-    if (bat->temperature > log_data.bat_temp_max) {
-        log_data.bat_temp_max = bat->temperature;
-    }
-
-    if (mcu_temp > log_data.int_temp_max) {
-        log_data.int_temp_max = mcu_temp;
-    }
 }
 
 // dummy functions
-void calibrate_current_sensors(dcdc_t *dcdc, load_output_t *load) {;}
+void calibrate_current_sensors() {;}
 void detect_battery_temperature(battery_state_t *bat, float bat_temp) {;}
 void dma_setup() {;}
 void adc_setup() {;}
@@ -0,0 +1,148 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "adc_filter.h"
+#include "adc_conv.h"
+
+// filter states (readings with 16-bit scaling shifted left by filter constant)
+static volatile uint32_t adc_filtered[NUM_ADC_CH];
+
+// initialize filters with first reading to avoid slow settling of long time constants
+static bool filter_initialized = false;
+
+void adc_pwm_frames_classify(adc_pwm_frames_t *pwm, bool enabled, int period, int on_time,
+    int phase, int trig_period)
+{
+    pwm->enabled = enabled;
+    pwm->num_on = 0;
+    phase -= phase % trig_period;           // trigger of most recent frame
+    for (int f = ADC_DMA_FRAMES - 1; f >= 0; f--) {
+        pwm->on[f] = (enabled && phase < on_time);
+        pwm->num_on += pwm->on[f];
+        phase = (phase + period - trig_period) % period;
+    }
+
+    pwm->duty_q16 = 0;
+    if (enabled) {
+        pwm->duty_q16 = (on_time >= period) ? (1U << 16) : ((uint64_t)on_time << 16) / period;
+    }
+}
+
+void adc_filter_reset()
+{
+    filter_initialized = false;
+}
+
+#ifdef CHARGER_TYPE_PWM
+
+// separately filtered readings of solar current with switch on and off
+static uint32_t i_solar_on_filtered;
+static uint32_t i_solar_off_filtered;
+
+/** Filters the solar current of the PWM charger and calculates its average
+ *
+ * The result is stored in adc_filtered like for all other channels, so no additional
+ * calculation is necessary in update_measurements().
+ */
+static void adc_pwm_current_filter(volatile uint16_t frames[ADC_DMA_FRAMES][NUM_ADC_CH],
+    const adc_pwm_frames_t *pwm)
+{
+    const unsigned int pos = ADC_POS_I_SOLAR;
+    uint32_t sum_on = 0;
+    uint32_t sum_off = 0;
+    for (unsigned int f = 0; f < ADC_DMA_FRAMES; f++) {
+        if (pwm->on[f]) {
+            sum_on += frames[f][pos];
+        }
+        else {
+            sum_off += frames[f][pos];
+        }
+    }
+
+    if (filter_initialized) {
+        if (pwm->num_on > 0) {
+            uint32_t reading = (sum_on * ADC_DMA_FRAMES / pwm->num_on) >> ADC_DECIM_SHIFT;
+            i_solar_on_filtered += reading - (i_solar_on_filtered >> adc_filter_const[pos]);
+        }
+        if (pwm->num_on < ADC_DMA_FRAMES) {
+            uint32_t reading = (sum_off * ADC_DMA_FRAMES / (ADC_DMA_FRAMES - pwm->num_on))
+                >> ADC_DECIM_SHIFT;
+            i_solar_off_filtered += reading - (i_solar_off_filtered >> adc_filter_const[pos]);
+        }
+    }
+    else {
+        i_solar_on_filtered = ((sum_on + sum_off) >> ADC_DECIM_SHIFT) << adc_filter_const[pos];
+        i_solar_off_filtered = i_solar_on_filtered;
+    }
+
+    adc_filtered[pos] = adc_conv_pwm_average(i_solar_on_filtered, i_solar_off_filtered,
+        pwm->duty_q16);
+}
+
+#endif /* CHARGER_TYPE_PWM */
+
+void adc_filter_frames(volatile uint16_t frames[ADC_DMA_FRAMES][NUM_ADC_CH],
+    const adc_pwm_frames_t *pwm)
+{
+    for (unsigned int i = 0; i < NUM_ADC_CH; i++) {
+        uint32_t sum = 0;
+        for (unsigned int f = 0; f < ADC_DMA_FRAMES; f++) {
+            sum += frames[f][i];
+        }
+
+#ifdef CHARGER_TYPE_PWM
+        if (i == ADC_POS_V_SOLAR && pwm->enabled) {
+            // only frames with the switch on are used for the input voltage (or all frames
+            // if the switch is permanently off)
+            if (pwm->num_on == 0) {
+                continue;
+            }
+            else if (pwm->num_on < ADC_DMA_FRAMES) {
+                sum = 0;
+                for (unsigned int f = 0; f < ADC_DMA_FRAMES; f++) {
+                    if (pwm->on[f]) {
+                        sum += frames[f][i];
+                    }
+                }
+                sum = sum * ADC_DMA_FRAMES / pwm->num_on;
+            }
+        }
+        else if (i == ADC_POS_I_SOLAR) {
+            // input current is averaged over the entire switching period
+            adc_pwm_current_filter(frames, pwm);
+            continue;
+        }
+#endif
+
+        // decimated value with 16-bit scaling (like 12-bit values left-aligned in uint16_t)
+        uint32_t reading = sum >> ADC_DECIM_SHIFT;
+
+        if (filter_initialized) {
+            // low pass filter with channel-specific filter constant c = 1/2^adc_filter_const[i]
+            // y(n) = c * x(n) + (c - 1) * y(n-1)
+            adc_filtered[i] += reading - (adc_filtered[i] >> adc_filter_const[i]);
+        }
+        else {
+            adc_filtered[i] = reading << adc_filter_const[i];
+        }
+    }
+    filter_initialized = true;
+}
+
+uint32_t adc_filter_get(unsigned int pos)
+{
+    return adc_filtered[pos] >> (16 - ADC_CONV_BITS + adc_filter_const[pos]);
+}
@@ -0,0 +1,106 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ADC_FILTER_H
+#define ADC_FILTER_H
+
+/** @file
+ *
+ * @brief Hardware-independent decimation and low pass filtering of raw ADC frames
+ *
+ * Called from the DMA interrupt on the target. As it doesn't access any registers, the
+ * same code can be used on the host to replay recorded frames.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pcb.h"
+
+/** Number of frames (conversion sequences) in each half of the DMA buffer
+ */
+#define ADC_DMA_FRAMES (1 << ADC_DMA_FRAMES_LOG2)
+
+#if defined(STM32L0)
+#define ADC_OVS_RATIO_LOG2 3    // 8x hardware oversampling (sum is not shifted)
+#else
+#define ADC_OVS_RATIO_LOG2 0    // no hardware oversampling available
+#endif
+
+/** Scaling of readings written by the DMA
+ *
+ * 12-bit values left-aligned in uint16_t without oversampling, right-aligned sum of the
+ * oversampled conversions otherwise.
+ */
+#if ADC_OVS_RATIO_LOG2 > 0
+#define ADC_READING_BITS (12 + ADC_OVS_RATIO_LOG2)
+#else
+#define ADC_READING_BITS 16
+#endif
+
+/** Right shift of the sum of all frames to get 16-bit scaling again
+ */
+#define ADC_DECIM_SHIFT (ADC_READING_BITS + ADC_DMA_FRAMES_LOG2 - 16)
+
+#if ADC_DECIM_SHIFT < 0 || ADC_READING_BITS + ADC_DMA_FRAMES_LOG2 > 20
+#error "Unsupported ADC oversampling or decimation settings"
+#endif
+
+/** Switch state of the PWM charger during the frames of one DMA buffer half
+ */
+typedef struct {
+    bool enabled;                   ///< False if switch is permanently off
+    bool on[ADC_DMA_FRAMES];        ///< Switch state during each frame
+    unsigned int num_on;            ///< Number of frames with switch on
+    uint32_t duty_q16;              ///< Duty cycle in Q16 format (0 if disabled)
+} adc_pwm_frames_t;
+
+/** Determines the switch state of the PWM charger for each frame
+ *
+ * The ADC trigger is synchronized with the switching period, so the switch state during
+ * each frame can be determined from its trigger time. All times in timer clock cycles.
+ *
+ * @param pwm Struct to store the result
+ * @param enabled True if the switch is enabled
+ * @param period Switching period
+ * @param on_time On-time of the switch at the beginning of the period
+ * @param phase Current position within the switching period
+ * @param trig_period Period of the ADC trigger
+ */
+void adc_pwm_frames_classify(adc_pwm_frames_t *pwm, bool enabled, int period, int on_time,
+    int phase, int trig_period);
+
+/** Resets the filters, so that they are initialized with the next frames
+ */
+void adc_filter_reset();
+
+/** Decimates the frames of one half of the DMA buffer and applies the low pass filters
+ *
+ * @param frames Raw readings as written by the DMA
+ * @param pwm Switch state of PWM charger (not used for MPPT charge controllers)
+ */
+void adc_filter_frames(volatile uint16_t frames[ADC_DMA_FRAMES][NUM_ADC_CH],
+    const adc_pwm_frames_t *pwm);
+
+/** Gets the filtered reading of one ADC channel
+ *
+ * @param pos Position of the channel (ADC_POS_*)
+ *
+ * @returns Reading with ADC_CONV_BITS resolution
+ */
+uint32_t adc_filter_get(unsigned int pos);
+
+#endif /* ADC_FILTER_H */
@@ -0,0 +1,173 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "adc_scope.h"
+
+#define TS_FUNCTION_PUBMSG 0x1F     // ThingSet binary publication message
+
+adc_scope_t adc_scope = {};
+
+// capture buffer (ring buffer while armed)
+static uint16_t scope_buf[ADC_SCOPE_FRAMES][NUM_ADC_CH];
+
+void adc_scope_arm(void)
+{
+    // stop recording first, as the DMA interrupt may occur at any time
+    adc_scope.state = ADC_SCOPE_IDLE;
+    adc_scope.readout_active = false;
+
+    if (adc_scope.pretrigger_frames >= ADC_SCOPE_FRAMES) {
+        adc_scope.pretrigger_frames = ADC_SCOPE_FRAMES - 1;
+    }
+    if (adc_scope.trigger_pos >= NUM_ADC_CH) {
+        adc_scope.trigger_pos = 0;
+    }
+    adc_scope.write_pos = 0;
+    adc_scope.num_pretrigger = 0;
+    adc_scope.trigger_frame = 0;
+    adc_scope.force_trigger = false;
+    // no edge detected for the first frame
+    adc_scope.last_value = adc_scope.trigger_rising ? UINT16_MAX : 0;
+
+    adc_scope.state = ADC_SCOPE_ARMED;
+}
+
+void adc_scope_force_trigger(void)
+{
+    if (adc_scope.state != ADC_SCOPE_ARMED) {
+        adc_scope_arm();
+    }
+    adc_scope.force_trigger = true;
+}
+
+void adc_scope_start_readout(void)
+{
+    if (adc_scope.state == ADC_SCOPE_DONE) {
+        adc_scope.readout_pos = 0;
+        adc_scope.readout_active = true;
+    }
+}
+
+void adc_scope_push(volatile uint16_t frames[][NUM_ADC_CH], unsigned int num_frames,
+    unsigned int shift)
+{
+    if (adc_scope.state != ADC_SCOPE_ARMED && adc_scope.state != ADC_SCOPE_TRIGGERED) {
+        return;
+    }
+
+    for (unsigned int f = 0; f < num_frames; f++) {
+        if (adc_scope.state == ADC_SCOPE_ARMED) {
+            uint16_t value = frames[f][adc_scope.trigger_pos] << shift;
+            bool crossed = adc_scope.trigger_rising ?
+                (adc_scope.last_value < adc_scope.trigger_level && value >= adc_scope.trigger_level) :
+                (adc_scope.last_value > adc_scope.trigger_level && value <= adc_scope.trigger_level);
+            adc_scope.last_value = value;
+
+            if (crossed || adc_scope.force_trigger) {
+                // trigger frame is the first post-trigger frame
+                adc_scope.trigger_frame = adc_scope.num_pretrigger;
+                adc_scope.num_remaining = ADC_SCOPE_FRAMES - adc_scope.num_pretrigger;
+                adc_scope.force_trigger = false;
+                adc_scope.state = ADC_SCOPE_TRIGGERED;
+            }
+        }
+
+        for (unsigned int i = 0; i < NUM_ADC_CH; i++) {
+            scope_buf[adc_scope.write_pos][i] = frames[f][i] << shift;
+        }
+        adc_scope.write_pos = (adc_scope.write_pos + 1) % ADC_SCOPE_FRAMES;
+
+        if (adc_scope.state == ADC_SCOPE_ARMED) {
+            if (adc_scope.num_pretrigger < adc_scope.pretrigger_frames) {
+                adc_scope.num_pretrigger++;
+            }
+        }
+        else if (--adc_scope.num_remaining == 0) {
+            // oldest frame is now at write_pos
+            adc_scope.state = ADC_SCOPE_DONE;
+            return;
+        }
+    }
+}
+
+size_t adc_scope_next_chunk(const uint8_t **data, uint32_t *offset)
+{
+    const uint32_t size = sizeof(scope_buf);
+
+    if (adc_scope.readout_active == false || adc_scope.state != ADC_SCOPE_DONE) {
+        return 0;
+    }
+    if (adc_scope.readout_pos >= size) {
+        adc_scope.readout_active = false;
+        return 0;
+    }
+
+    // position in the ring buffer, starting with the oldest frame
+    uint32_t pos = (adc_scope.write_pos * sizeof(scope_buf[0]) + adc_scope.readout_pos) % size;
+
+    size_t len = ADC_SCOPE_CHUNK_SIZE;
+    if (len > size - adc_scope.readout_pos) {
+        len = size - adc_scope.readout_pos;
+    }
+    if (len > size - pos) {
+        len = size - pos;       // wrap-around of ring buffer
+    }
+
+    *data = (const uint8_t *)scope_buf + pos;
+    *offset = adc_scope.readout_pos;
+    adc_scope.readout_pos += len;
+    return len;
+}
+
+// writes CBOR header (major type and argument) and returns its length
+static int cbor_head(uint8_t *buf, uint8_t type, uint32_t value)
+{
+    if (value < 24) {
+        buf[0] = type | value;
+        return 1;
+    }
+    else if (value <= UINT8_MAX) {
+        buf[0] = type | 24;
+        buf[1] = value;
+        return 2;
+    }
+    else if (value <= UINT16_MAX) {
+        buf[0] = type | 25;
+        buf[1] = value >> 8;
+        buf[2] = value;
+        return 3;
+    }
+    else {
+        buf[0] = type | 26;
+        buf[1] = value >> 24;
+        buf[2] = value >> 16;
+        buf[3] = value >> 8;
+        buf[4] = value;
+        return 5;
+    }
+}
+
+int adc_scope_chunk_header(uint8_t *buf, uint32_t offset, size_t len)
+{
+    int pos = 0;
+    buf[pos++] = TS_FUNCTION_PUBMSG;
+    pos += cbor_head(&buf[pos], 0xA0, 1);                   // map with 1 element
+    pos += cbor_head(&buf[pos], 0x00, ADC_SCOPE_DATA_ID);   // key: data object ID
+    pos += cbor_head(&buf[pos], 0x80, 2);                   // array with 2 elements
+    pos += cbor_head(&buf[pos], 0x00, offset);
+    pos += cbor_head(&buf[pos], 0x40, len);                 // byte string (data follows)
+    return pos;
+}
@@ -0,0 +1,140 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ADC_SCOPE_H
+#define ADC_SCOPE_H
+
+/** @file
+ *
+ * @brief Capture of raw ADC frames at full DMA rate for diagnosis ("scope mode")
+ *
+ * The capture buffer is filled from the DMA interrupt with the unfiltered conversion
+ * sequences (frames). After arming, it continuously records the pre-trigger frames. The
+ * trigger is either a threshold crossing of one channel or a forced trigger via ThingSet.
+ * Afterwards, the buffer is read out in binary chunks directly from the capture buffer.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "pcb.h"
+
+/** Number of frames stored in the capture buffer
+ *
+ * Each frame needs 2 bytes per ADC channel of RAM.
+ */
+#ifndef ADC_SCOPE_FRAMES
+#define ADC_SCOPE_FRAMES 128
+#endif
+
+/** Maximum number of data bytes per chunk during readout
+ */
+#define ADC_SCOPE_CHUNK_SIZE 64
+
+/** Maximum size of the header of a chunk, see adc_scope_chunk_header()
+ */
+#define ADC_SCOPE_HEADER_SIZE 12
+
+/** ThingSet data object ID used for the chunks of captured data
+ */
+#define ADC_SCOPE_DATA_ID 0x7F
+
+/** Capture state
+ */
+enum adc_scope_state {
+    ADC_SCOPE_IDLE = 0,     ///< Nothing captured
+    ADC_SCOPE_ARMED,        ///< Recording pre-trigger frames and waiting for trigger
+    ADC_SCOPE_TRIGGERED,    ///< Recording post-trigger frames
+    ADC_SCOPE_DONE          ///< Capture buffer is full and can be read out
+};
+
+/** Scope configuration and state
+ */
+typedef struct {
+    volatile uint16_t state;        ///< Capture state (see adc_scope_state)
+
+    uint16_t trigger_pos;           ///< ADC channel used for threshold trigger (ADC_POS_*)
+    uint16_t trigger_level;         ///< Threshold with 16-bit scaling (like captured data)
+    bool trigger_rising;            ///< Trigger on rising (true) or falling (false) edge
+    uint16_t pretrigger_frames;     ///< Number of frames recorded before the trigger
+
+    uint16_t trigger_frame;         ///< Position of the trigger frame in captured data
+
+    // internal states, not to be changed from outside
+    volatile bool force_trigger;
+    uint16_t write_pos;             ///< Next frame to be written in capture buffer
+    uint16_t num_pretrigger;        ///< Number of valid frames recorded while armed
+    uint16_t num_remaining;         ///< Number of frames to be recorded after trigger
+    uint16_t last_value;            ///< Previous reading of trigger channel (edge detection)
+    bool readout_active;
+    uint32_t readout_pos;           ///< Byte offset of next chunk to be read out
+} adc_scope_t;
+
+extern adc_scope_t adc_scope;
+
+/** Arms the scope, i.e. starts recording of pre-trigger frames
+ *
+ * Previously captured data is discarded.
+ */
+void adc_scope_arm(void);
+
+/** Triggers the capture independent of the threshold (arms the scope if necessary)
+ */
+void adc_scope_force_trigger(void);
+
+/** Starts readout of the captured data (only possible if capture is done)
+ */
+void adc_scope_start_readout(void);
+
+/** Stores new frames in the capture buffer and checks the trigger condition
+ *
+ * Called from the DMA interrupt, so it returns immediately if the scope is not armed.
+ *
+ * @param frames Raw readings as written by the DMA
+ * @param num_frames Number of frames
+ * @param shift Left shift to get 16-bit scaling of the readings
+ */
+void adc_scope_push(volatile uint16_t frames[][NUM_ADC_CH], unsigned int num_frames,
+    unsigned int shift);
+
+/** Gets the next chunk of the captured data in chronological order
+ *
+ * The data is not copied, but referenced directly in the capture buffer. Each frame
+ * contains NUM_ADC_CH readings as uint16_t in MCU byte order (little endian).
+ *
+ * @param data Pointer to be set to the start of the chunk
+ * @param offset Byte offset of the chunk in the captured data
+ *
+ * @returns Number of bytes in the chunk (0 if readout is not active or finished)
+ */
+size_t adc_scope_next_chunk(const uint8_t **data, uint32_t *offset);
+
+/** Generates the header of a ThingSet binary publication message for a data chunk
+ *
+ * The message contains a CBOR map with ADC_SCOPE_DATA_ID as key and an array with the
+ * byte offset and the chunk data as value. The header contains everything except for the
+ * data itself, which can be sent directly afterwards.
+ *
+ * @param buf Buffer for the header (at least ADC_SCOPE_HEADER_SIZE bytes)
+ * @param offset Byte offset of the chunk in the captured data
+ * @param len Number of data bytes in the chunk
+ *
+ * @returns Length of the header
+ */
+int adc_scope_chunk_header(uint8_t *buf, uint32_t offset, size_t len);
+
+#endif /* ADC_SCOPE_H */
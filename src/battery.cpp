@@ -40,6 +40,8 @@ void battery_conf_init(battery_conf_t *bat, bat_type type, int num_cells, float
     bat->time_limit_recharge = 60;              // sec
     bat->time_limit_topping = 120*60;                // sec
 
+    bat->wire_resistance = 0;
+
     bat->charge_temp_max = 50;
     bat->charge_temp_min = -10;
     bat->discharge_temp_max = 50;
@@ -248,6 +250,8 @@ void battery_update_energy(battery_state_t *bat, float bat_voltage, float bat_cu
             bat_dis_total_Wh_prev = bat->dis_total_Wh;
             log_data.solar_in_day_Wh = 0.0;
             log_data.load_out_day_Wh = 0.0;
+            log_data.solar_power_max_day = 0;
+            log_data.load_power_max_day = 0;
             bat->chg_total_Wh = 0.0;
             bat->dis_total_Wh = 0.0;
         }
@@ -19,19 +19,19 @@
 #include "pcb.h"
 #include "half_bridge.h"
 #include "log.h"
-#include <time.h>
+#include "hardware.h"
 
 // private function
 void _enter_state(battery_state_t* bat_state, int next_state)
 {
     //printf("Enter State: %d\n", next_state);
-    bat_state->time_state_changed = time(NULL);
+    bat_state->time_state_changed = uptime;
     bat_state->chg_state = next_state;
 }
 
 void charger_state_machine(power_port_t *port, battery_conf_t *bat_conf, battery_state_t *bat_state, float voltage, float current)
 {
-    //printf("time_state_change = %d, time = %d, v_bat = %f, i_bat = %f\n", bat_state->time_state_changed, time(NULL), voltage, current);
+    //printf("time_state_change = %d, time = %d, v_bat = %f, i_bat = %f\n", bat_state->time_state_changed, uptime, voltage, current);
 
     // Load management
     // battery port input state (i.e. battery discharging direction) defines load state
@@ -77,7 +77,7 @@ void charger_state_machine(power_port_t *port, battery_conf_t *bat_conf, battery
     switch (bat_state->chg_state) {
     case CHG_STATE_IDLE: {
         if  (voltage < bat_conf->voltage_recharge
-            && (time(NULL) - bat_state->time_state_changed) > bat_conf->time_limit_recharge
+            && (uptime - bat_state->time_state_changed) > bat_conf->time_limit_recharge
             && bat_state->temperature < bat_conf->charge_temp_max - 1
             && bat_state->temperature > bat_conf->charge_temp_min + 1)
         {
@@ -103,13 +103,13 @@ void charger_state_machine(power_port_t *port, battery_conf_t *bat_conf, battery
         port->voltage_output_target = bat_conf->voltage_topping + bat_conf->temperature_compensation * (bat_state->temperature - 25);
 
         if (voltage >= port->voltage_output_target - current * port->droop_res_output) {
-            bat_state->time_voltage_limit_reached = time(NULL);
+            bat_state->time_voltage_limit_reached = uptime;
         }
 
         // cut-off limit reached because battery full (i.e. CV limit still
         // reached by available solar power within last 2s) or CV period long enough?
-        if ((current < bat_conf->current_cutoff_topping && (time(NULL) - bat_state->time_voltage_limit_reached) < 2)
-            || (time(NULL) - bat_state->time_state_changed) > bat_conf->time_limit_topping)
+        if ((current < bat_conf->current_cutoff_topping && (uptime - bat_state->time_voltage_limit_reached) < 2)
+            || (uptime - bat_state->time_state_changed) > bat_conf->time_limit_topping)
         {
             bat_state->full = true;
             bat_state->num_full_charges++;
@@ -138,10 +138,10 @@ void charger_state_machine(power_port_t *port, battery_conf_t *bat_conf, battery
         port->voltage_output_target = bat_conf->voltage_trickle + bat_conf->temperature_compensation * (bat_state->temperature - 25);
 
         if (voltage >= port->voltage_output_target - current * port->droop_res_output) {
-            bat_state->time_voltage_limit_reached = time(NULL);
+            bat_state->time_voltage_limit_reached = uptime;
         }
 
-        if (time(NULL) - bat_state->time_voltage_limit_reached > bat_conf->time_trickle_recharge)
+        if (uptime - bat_state->time_voltage_limit_reached > bat_conf->time_trickle_recharge)
         {
             port->current_output_max = bat_conf->charge_current_max;
             bat_state->full = false;
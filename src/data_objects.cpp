@@ -21,6 +21,7 @@
 #ifndef CUSTOM_DATA_OBJECTS_FILE
 
 #include "thingset.h"
+#include "data_objects.h"
 #include "battery.h"
 #include "log.h"
 #include "dcdc.h"
@@ -28,6 +29,8 @@
 #include "hardware.h"
 #include "eeprom.h"
 #include "pwm_switch.h"
+#include "adc_scope.h"
+#include "meas_snapshot.h"
 #include <stdio.h>
 
 #ifdef PIL_TESTING
@@ -39,11 +42,12 @@ extern log_data_t log_data;
 extern battery_state_t bat_state;
 extern battery_conf_t bat_conf;
 extern battery_conf_t bat_conf_user;
-extern dcdc_t dcdc;
+extern dcdc_t dcdc[DCDC_NUM_CONVERTERS];
 extern load_output_t load;
 extern power_port_t hs_port;
 extern power_port_t ls_port;
 extern pwm_switch_t pwm_switch;
+extern meas_snapshot_t meas;
 
 const char* manufacturer = "Libre Solar";
 const char* deviceName = "MPPT Solar Charge Controller";
@@ -124,7 +128,7 @@ const data_object_t data_objects[] = {
 #ifdef CHARGER_TYPE_PWM
     {0x62, TS_INPUT, TS_ACCESS_READ | TS_ACCESS_WRITE, TS_T_BOOL,   0, (void*) &(pwm_switch.enabled),                "PWMEn"},
 #else
-    {0x62, TS_INPUT, TS_ACCESS_READ | TS_ACCESS_WRITE, TS_T_BOOL,   0, (void*) &(dcdc.enabled),                      "DCDCEn"},
+    {0x62, TS_INPUT, TS_ACCESS_READ | TS_ACCESS_WRITE, TS_T_BOOL,   0, (void*) &(dcdc[0].enabled),                      "DCDCEn"},
 #endif
 
 #ifdef PIL_TESTING  // only used during processor-in-the-loop test
@@ -136,30 +140,41 @@ const data_object_t data_objects[] = {
     {0x68, TS_INPUT, TS_ACCESS_READ | TS_ACCESS_WRITE, TS_T_FLOAT32, 1, (void*) &(sim_data.mcu_temperature),            "SimMCU_degC"},
 #endif
 
+    // ADC capture (scope mode) settings
+    {0x69, TS_INPUT, TS_ACCESS_READ | TS_ACCESS_WRITE, TS_T_UINT16, 0, (void*) &(adc_scope.trigger_pos),        "ScopeTrigCh"},
+    {0x6A, TS_INPUT, TS_ACCESS_READ | TS_ACCESS_WRITE, TS_T_UINT16, 0, (void*) &(adc_scope.trigger_level),      "ScopeTrigLevel"},
+    {0x6B, TS_INPUT, TS_ACCESS_READ | TS_ACCESS_WRITE, TS_T_BOOL,   0, (void*) &(adc_scope.trigger_rising),     "ScopeTrigRising"},
+    {0x6C, TS_INPUT, TS_ACCESS_READ | TS_ACCESS_WRITE, TS_T_UINT16, 0, (void*) &(adc_scope.pretrigger_frames),  "ScopePreTrig"},
+
     // OUTPUT DATA ////////////////////////////////////////////////////////////
     // using IDs >= 0x70 except for high priority data objects
 
     // high priority data objects (low IDs)
-    {0x04, TS_OUTPUT, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(load.switch_state),             "LoadState"},
+    {0x04, TS_OUTPUT, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(meas.load_state),               "LoadState"},
     {0x05, TS_OUTPUT, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(load.usb_state),                "USBState"},
-    {0x06, TS_OUTPUT, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(bat_state.soc),                 "SOC_%"},     // output will be uint8_t
+    {0x06, TS_OUTPUT, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(meas.soc),                      "SOC_%"},     // output will be uint8_t
 
     // battery related data objects
-    {0x70, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(ls_port.voltage),               "Bat_V"},
-    {0x71, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(hs_port.voltage),               "Solar_V"},
-    {0x72, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(ls_port.current),               "Bat_A"},
-    {0x73, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(load.current),                  "Load_A"},
-    {0x74, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 1, (void*) &(bat_state.temperature),         "Bat_degC"},
+    {0x70, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(meas.ls_voltage),               "Bat_V"},
+    {0x71, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(meas.hs_voltage),               "Solar_V"},
+    {0x72, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(meas.ls_current),               "Bat_A"},
+    {0x73, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(meas.load_current),             "Load_A"},
+    {0x74, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 1, (void*) &(meas.bat_temp),                 "Bat_degC"},
     {0x75, TS_OUTPUT, TS_ACCESS_READ, TS_T_BOOL,    1, (void*) &(bat_state.ext_temp_sensor),     "BatTempExt"},
-    {0x76, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 1, (void*) &(mcu_temp),                      "MCU_degC"},
+    {0x76, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 1, (void*) &(meas.mcu_temp),                 "MCU_degC"},
 #ifdef PIN_ADC_TEMP_FETS
-    {0x77, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 1, (void*) &(dcdc.temp_mosfets),             "FETs_degC"},
+    {0x77, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 1, (void*) &(meas.mosfet_temp),              "FETs_degC"},
 #endif
     {0x78, TS_OUTPUT, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(bat_state.chg_state),           "ChgState"},
-    {0x79, TS_OUTPUT, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(dcdc.state),                    "DCDCState"},
-    {0x7A, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(hs_port.current),               "Solar_A"},
+    {0x79, TS_OUTPUT, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(meas.dcdc_state),               "DCDCState"},
+    {0x7A, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(meas.hs_current),               "Solar_A"},
     {0x7B, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(ls_port.voltage_output_target), "BatTarget_V"},
     {0x7C, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(ls_port.current_output_max),    "BatTarget_A"},
+    {0x7D, TS_OUTPUT, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(adc_scope.state),               "ScopeState"},
+    {0x7E, TS_OUTPUT, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(adc_scope.trigger_frame),       "ScopeTrigFrame"},
+    // 0x7F used for chunks of captured ADC data (see adc_scope.h)
+    {0x80, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(meas.sweep_duration),              "MpptSweep_s"},
+    {0x81, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(meas.sweep_energy_lost),           "MpptSweepLoss_Ws"},
 
     // others
     {0x90, TS_OUTPUT, TS_ACCESS_READ, TS_T_FLOAT32, 0, (void*) &(latitude),                      "Latitude"},
@@ -181,9 +196,9 @@ const data_object_t data_objects[] = {
     // accumulated data
     {0xA0, TS_REC, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(log_data.solar_in_day_Wh),             "SolarInDay_Wh"},
     {0xA1, TS_REC, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(log_data.load_out_day_Wh),             "LoadOutDay_Wh"},
-    {0xA2, TS_REC, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(bat_state.chg_day_Wh),                 "BatChgDay_Wh"},
-    {0xA3, TS_REC, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(bat_state.dis_day_Wh),                 "BatDisDay_Wh"},
-    {0xA4, TS_REC, TS_ACCESS_READ, TS_T_FLOAT32, 0, (void*) &(bat_state.discharged_Ah),              "Dis_Ah"},    // coulomb counter
+    {0xA2, TS_REC, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(meas.bat_chg_day_Wh),                  "BatChgDay_Wh"},
+    {0xA3, TS_REC, TS_ACCESS_READ, TS_T_FLOAT32, 2, (void*) &(meas.bat_dis_day_Wh),                  "BatDisDay_Wh"},
+    {0xA4, TS_REC, TS_ACCESS_READ, TS_T_FLOAT32, 0, (void*) &(meas.discharged_Ah),                   "Dis_Ah"},    // coulomb counter
     {0xA5, TS_REC, TS_ACCESS_READ, TS_T_UINT16,  0, (void*) &(bat_state.soh),                        "SOH_%"},     // output will be uint8_t
     {0xA6, TS_REC, TS_ACCESS_READ, TS_T_INT32,   0, (void*) &(log_data.day_counter),                 "DayCount"},
 
@@ -199,14 +214,34 @@ const data_object_t data_objects[] = {
     {0xB9, TS_REC, TS_ACCESS_READ, TS_T_INT32, 1, (void*) &(log_data.mosfet_temp_max),               "MosfetMax_degC"},
     {0xBA, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  1, (void*) &(log_data.error_flags),                                     "ErrorFlags"},
 
+    // timestamps of min/max recordings
+    {0xBB, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.solar_power_max_total_time),  "SolarWMaxTotalTime_s"},
+    {0xBC, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.load_power_max_total_time),   "LoadWMaxTotalTime_s"},
+    {0xBD, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.battery_voltage_max_time),    "BatVMaxTotalTime_s"},
+    {0xBE, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.solar_voltage_max_time),      "SolarVMaxTotalTime_s"},
+    {0xBF, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.dcdc_current_max_time),       "DCDCAMaxTotalTime_s"},
+    {0xC0, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.load_current_max_time),       "LoadAMaxTotalTime_s"},
+    {0xC1, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.bat_temp_max_time),           "BatTMaxTime_s"},
+    {0xC2, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.int_temp_max_time),           "IntTMaxTime_s"},
+    {0xC3, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.mosfet_temp_max_time),        "MosfetTMaxTime_s"},
+    {0xC4, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.solar_power_max_day_time),    "SolarWMaxDayTime_s"},
+    {0xC5, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.load_power_max_day_time),     "LoadWMaxDayTime_s"},
+    {0xC6, TS_REC, TS_ACCESS_READ, TS_T_UINT32,  0, (void*) &(log_data.dcdc_trip_count),             "DcdcTripCount"},
+
     // CALIBRATION DATA ///////////////////////////////////////////////////////
     // using IDs >= 0xD0
 
-    {0xD0, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 1, (void*) &(dcdc.ls_current_min),   "DcdcMin_A"},
-    {0xD1, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 1, (void*) &(dcdc.hs_voltage_max),   "SolarAbsMax_V"},
-    {0xD2, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_INT32,   0, (void*) &(dcdc.restart_interval), "DcdcRestart_s"},
-    //{0xD3, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 1, (void*) &(dcdc.offset_voltage_start), "SolarOffsetStart_V"},
-    //{0xD4, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 1, (void*) &(dcdc.offset_voltage_stop), "SolarOffsetStop_V"}
+    {0xD0, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 1, (void*) &(dcdc[0].ls_current_min),   "DcdcMin_A"},
+    {0xD1, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 1, (void*) &(dcdc[0].hs_voltage_max),   "SolarAbsMax_V"},
+    {0xD2, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_INT32,   0, (void*) &(dcdc[0].restart_interval), "DcdcRestart_s"},
+    //{0xD3, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 1, (void*) &(dcdc[0].offset_voltage_start), "SolarOffsetStart_V"},
+    //{0xD4, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 1, (void*) &(dcdc[0].offset_voltage_stop), "SolarOffsetStop_V"},
+    {0xD5, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_BOOL,    0, (void*) &(dcdc[0].mppt_adaptive),    "MpptAdaptive"},
+    {0xD6, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_UINT16,  0, (void*) &(dcdc[0].mppt_algorithm),   "MpptAlgorithm"},
+    {0xD7, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_INT32,   0, (void*) &(dcdc[0].sweep.interval),   "MpptSweepInterval_s"},
+    {0xD8, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 3, (void*) &(dcdc[0].vmpp_ratio),       "MppRatio"},
+    {0xD9, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 5, (void*) &(dcdc[0].vmpp_ratio_tc),    "MppRatioTempCoeff"},
+    {0xDA, TS_CAL, TS_ACCESS_READ | TS_ACCESS_WRITE_AUTH, TS_T_FLOAT32, 2, (void*) &(dcdc[0].light_load_current), "DcdcLightLoad_A"},
 
     // FUNCTION CALLS (EXEC) //////////////////////////////////////////////////
 #ifndef UNIT_TEST
@@ -214,8 +249,13 @@ const data_object_t data_objects[] = {
 #endif
     {0xE1, TS_EXEC, TS_ACCESS_EXEC, TS_T_BOOL, 0, (void*) &start_dfu_bootloader, "Bootloader"},
     {0xE2, TS_EXEC, TS_ACCESS_EXEC, TS_T_BOOL, 0, (void*) &eeprom_store_data,    "SaveSettings"},
+    {0xE3, TS_EXEC, TS_ACCESS_EXEC, TS_T_BOOL, 0, (void*) &adc_scope_arm,        "ScopeArm"},
+    {0xE4, TS_EXEC, TS_ACCESS_EXEC, TS_T_BOOL, 0, (void*) &adc_scope_force_trigger, "ScopeTrigger"},
+    {0xE5, TS_EXEC, TS_ACCESS_EXEC, TS_T_BOOL, 0, (void*) &adc_scope_start_readout, "ScopeRead"},
 };
 
+const size_t num_data_objects = sizeof(data_objects)/sizeof(data_object_t);
+
 // stores object-ids of values to be published via Serial
 const uint16_t pub_serial[] = {
     0x01, // internal time stamp
@@ -253,7 +293,7 @@ volatile const int PUB_CHANNEL_SERIAL = 0;
 volatile const int PUB_CHANNEL_EMONCMS = 1;
 
 ThingSet ts(
-    data_objects, sizeof(data_objects)/sizeof(data_object_t),
+    data_objects, num_data_objects,
     pub_channels, sizeof(pub_channels)/sizeof(ts_pub_channel_t)
 );
 
@@ -22,8 +22,19 @@
  * @brief Handling of ThingSet data objects
  */
 
+#include "thingset.h"
+
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+
+/** Table of all data objects accessible via ThingSet
+ */
+extern const data_object_t data_objects[];
+
+/** Number of data objects in the table
+ */
+extern const size_t num_data_objects;
 
 void data_objects_update_conf();
 void data_objects_read_eeprom();
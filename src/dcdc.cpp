@@ -18,12 +18,14 @@
 #include "config.h"
 #include "pcb.h"
 #include "log.h"
+#include "hardware.h"
 
 #include "half_bridge.h"
+#include "mppt.h"
 
-#include <time.h>       // for time(NULL) function
 #include <math.h>       // for fabs function
 #include <stdio.h>
+#include <stdint.h>     // for INT32_MAX
 
 extern log_data_t log_data;
 
@@ -34,61 +36,374 @@ void dcdc_init(dcdc_t *dcdc)
     dcdc->state          = DCDC_STATE_OFF;
     dcdc->ls_current_max = DCDC_CURRENT_MAX;
     dcdc->ls_current_min = 0.05;                // A   if lower, charger is switched off
+    dcdc->ls_current_trip = 1.5 * DCDC_CURRENT_MAX; // A   PWM switched off by hardware if exceeded
     dcdc->hs_voltage_max = HIGH_SIDE_VOLTAGE_MAX;   // V
     dcdc->ls_voltage_max = LOW_SIDE_VOLTAGE_MAX;    // V
     //dcdc->offset_voltage_start = 4.0;         // V  charging switched on if Vsolar > Vbat + offset
     //dcdc->offset_voltage_stop = 1.0;          // V  charging switched off if Vsolar < Vbat + offset
     dcdc->restart_interval = 60;                // s    --> when should we retry to start charging after low solar power cut-off?
     dcdc->off_timestamp = -10000;               // start immediately
+    dcdc->hs_short_counter = 0;
     dcdc->pwm_delta = 1;
+    dcdc->mppt_algorithm = MPPT_PERTURB_OBSERVE;
+    dcdc->mppt_adaptive = false;
+    dcdc->sweep.interval = 600;                 // s    --> global MPP sweep every 10 minutes
+    dcdc->sweep.state = DCDC_SWEEP_IDLE;
+    dcdc->sweep.counter = 0;
+    dcdc->vmpp_ratio = 0.8;                     // initial guess, learned during operation
+    dcdc->vmpp_ratio_tc = 0;
+    dcdc->voc_start = 0;
+    dcdc->temp_start = 25;
+    dcdc->light_load_current = 0.5;             // A    --> diode emulation below 0.5 A, burst mode below 0.25 A
+    dcdc->diode_emulation = false;
+    dcdc->burst = false;
+
+    dcdc->fast_voltage_max = INT32_MAX;
+    dcdc->fast_current_max = INT32_MAX;
+    dcdc->pi_voltage.kp = DCDC_PI_KP_VOLTAGE;
+    dcdc->pi_voltage.ki = DCDC_PI_KI_VOLTAGE;
+    dcdc->pi_voltage.integral = 0;
+    dcdc->pi_current.kp = DCDC_PI_KP_CURRENT;
+    dcdc->pi_current.ki = DCDC_PI_KI_CURRENT;
+    dcdc->pi_current.integral = 0;
+    dcdc->interleaved = false;
+}
+
+void dcdc_init_interleaved(dcdc_t *dcdc)
+{
+    half_bridge_set_phase_shift(&dcdc->half_bridge_2, true);
+    dcdc->pi_balance.kp = DCDC_PI_KP_BALANCE;
+    dcdc->pi_balance.ki = DCDC_PI_KI_BALANCE;
+    dcdc->pi_balance.integral = 0;
+    dcdc->interleaved = true;
+}
+
+// returns the duty cycle applied by the inner control loop (without reduction)
+float _dcdc_get_duty_base(const dcdc_t *dcdc)
+{
+    return dcdc->duty_base * (1.0f / 65536);
+}
+
+// starts the PWM of all phases with the base duty cycle (the first phase last, as the inner
+// control loop updates all phases as soon as it is enabled)
+void _dcdc_start(dcdc_t *dcdc)
+{
+    float duty = _dcdc_get_duty_base(dcdc);
+    if (dcdc->interleaved) {
+        half_bridge_start(&dcdc->half_bridge_2, duty);
+    }
+    half_bridge_start(&dcdc->half_bridge, duty);
+}
+
+// stops the PWM of all phases
+void _dcdc_stop(dcdc_t *dcdc)
+{
+    half_bridge_stop(&dcdc->half_bridge);
+    if (dcdc->interleaved) {
+        half_bridge_stop(&dcdc->half_bridge_2);
+    }
+}
+
+// sets the duty cycle to be applied by the inner control loop (converted to Q16, so that the
+// interrupt does not need floating-point arithmetics)
+void _dcdc_set_duty_base(dcdc_t *dcdc, float duty)
+{
+    if (duty < half_bridge_get_min_duty(&dcdc->half_bridge)) {
+        duty = half_bridge_get_min_duty(&dcdc->half_bridge);
+    }
+    else if (duty > half_bridge_get_max_duty(&dcdc->half_bridge)) {
+        duty = half_bridge_get_max_duty(&dcdc->half_bridge);
+    }
+    dcdc->duty_base = duty * 65536 + 0.5f;
+}
+
+// adjusts the duty cycle of the outer control loop with one clock of the PWM timer per step or
+// with the finer resolution of the half bridge (dithering) to avoid limit cycling in CV control
+void _dcdc_duty_base_step(dcdc_t *dcdc, int delta, bool fine)
+{
+    int period = half_bridge_get_period_clocks();
+    if (fine) {
+        _dcdc_set_duty_base(dcdc, _dcdc_get_duty_base(dcdc) + delta * half_bridge_get_duty_step());
+    }
+    else if (period > 0) {
+        // center-aligned PWM: one step of the compare register changes the on-time by 2 clocks
+        _dcdc_set_duty_base(dcdc, _dcdc_get_duty_base(dcdc) + delta * 2.0f / period);
+    }
+}
+
+// updates the limits of the inner control loop with the settings of the output port
+void _dcdc_set_fast_limits(dcdc_t *dcdc, power_port_t *out, bool buck)
+{
+    dcdc->fast_buck = buck;
+    dcdc->fast_voltage_max = (out->voltage_output_target - out->droop_res_output * out->current) * 1000;
+    dcdc->fast_current_max = out->current_output_max * 1000;
+}
+
+// returns the duty cycle reduction (Q16) necessary to keep the value below its limit
+//
+// Calculated in 64 bit, as the limits may be unset (INT32_MAX) and the gains multiplied with
+// large deviations would overflow.
+int32_t _dcdc_pi_limit(dcdc_pi_t *pi, int32_t value, int32_t limit)
+{
+    const int64_t integral_max = (int64_t)(1 << 16) << DCDC_PI_SHIFT;
+    int64_t excess = (int64_t)value - limit;
+
+    int64_t integral = pi->integral + pi->ki * excess;
+    if (integral < 0) {
+        integral = 0;
+    }
+    else if (integral > integral_max) {
+        integral = integral_max;
+    }
+    pi->integral = integral;
+
+    int64_t out = (integral + pi->kp * excess) >> DCDC_PI_SHIFT;
+    if (out < 0) {
+        return 0;
+    }
+    else if (out > (1 << 16)) {
+        return 1 << 16;
+    }
+    return out;
+}
+
+// returns the duty cycle difference (Q16) of the phases necessary for equal currents
+int32_t _dcdc_balance_control(dcdc_pi_t *pi, int32_t imbalance)
+{
+    const int32_t integral_max = DCDC_BALANCE_TRIM_MAX << DCDC_PI_SHIFT;
+
+    // in contrast to the limiters, the correction can be positive or negative
+    pi->integral += pi->ki * imbalance;
+    if (pi->integral < -integral_max) {
+        pi->integral = -integral_max;
+    }
+    else if (pi->integral > integral_max) {
+        pi->integral = integral_max;
+    }
+
+    int32_t out = (pi->integral + pi->kp * imbalance) >> DCDC_PI_SHIFT;
+    if (out < -DCDC_BALANCE_TRIM_MAX) {
+        return -DCDC_BALANCE_TRIM_MAX;
+    }
+    else if (out > DCDC_BALANCE_TRIM_MAX) {
+        return DCDC_BALANCE_TRIM_MAX;
+    }
+    return out;
+}
+
+// requests a global MPP sweep periodically and applies its result
+void _dcdc_sweep_control(dcdc_t *dcdc)
+{
+    dcdc_sweep_t *sweep = &dcdc->sweep;
+    if (sweep->state == DCDC_SWEEP_DONE) {
+        sweep->duration = (float)sweep->cycles / FAST_CONTROL_FREQUENCY;
+        sweep->energy_lost = sweep->energy_sum * (1e-6f / FAST_CONTROL_FREQUENCY);
+        dcdc->duty_base = sweep->duty_best;     // within the limits of the half bridge
+        mppt_get_algorithm(dcdc)->reset(dcdc);
+        sweep->counter = 0;
+        sweep->state = DCDC_SWEEP_IDLE;
+    }
+    else if (sweep->state == DCDC_SWEEP_IDLE && dcdc->state == DCDC_STATE_MPPT && sweep->interval > 0) {
+        sweep->counter++;
+        if (sweep->counter >= sweep->interval * CONTROL_FREQUENCY) {
+            // duty cycle of the points prepared here, so that the inner loop only needs integer
+            // arithmetics
+            float duty_min = half_bridge_get_min_duty(&dcdc->half_bridge);
+            float duty_max = half_bridge_get_max_duty(&dcdc->half_bridge);
+            sweep->duty_min = duty_min * 65536 + 0.5f;
+            sweep->duty_step = (duty_max - duty_min) * 65536 / (DCDC_SWEEP_POINTS - 1);
+            sweep->state = DCDC_SWEEP_REQUESTED;
+        }
+    }
+}
+
+// performs one cycle of the global MPP sweep and returns the duty cycle (Q16) to be applied
+int32_t _dcdc_sweep_step(dcdc_t *dcdc, int32_t v_in, int32_t v_out, int32_t i_out)
+{
+    dcdc_sweep_t *sweep = &dcdc->sweep;
+    int64_t power = (int64_t)v_out * i_out;    // µW
+
+    if (sweep->state == DCDC_SWEEP_REQUESTED) {
+        sweep->power_start = power;
+        sweep->power_best = 0;
+        sweep->duty_best = dcdc->duty_base;
+        sweep->energy_sum = 0;
+        sweep->cycles = 0;
+        sweep->state = DCDC_SWEEP_RUNNING;
+    }
+    else if (sweep->state == DCDC_SWEEP_RUNNING) {
+        sweep->cycles++;
+        sweep->energy_sum += sweep->power_start - power;
+    }
+    else {
+        return sweep->duty_best;        // waiting for outer control loop
+    }
+
+    int point = sweep->cycles / DCDC_SWEEP_CYCLES_PER_POINT;
+
+    if (sweep->cycles > 0 && sweep->cycles % DCDC_SWEEP_CYCLES_PER_POINT == 0) {
+        // record the previous point after settling
+        sweep->voltage[point - 1] = (v_in > 0) ? v_in / 10 : 0;
+        sweep->power[point - 1] = (power > 0) ? power / 100000 : 0;
+        if (power > sweep->power_best) {
+            sweep->power_best = power;
+            sweep->duty_best = sweep->duty_min + sweep->duty_step * (point - 1);
+        }
+        if (point == DCDC_SWEEP_POINTS) {
+            sweep->state = DCDC_SWEEP_DONE;
+            return sweep->duty_best;
+        }
+    }
+    return sweep->duty_min + sweep->duty_step * point;
+}
+
+float dcdc_vmpp_ratio(const dcdc_t *dcdc, float temp)
+{
+    float ratio = dcdc->vmpp_ratio + dcdc->vmpp_ratio_tc * (temp - 25);
+    if (ratio < DCDC_VMPP_RATIO_MIN) {
+        return DCDC_VMPP_RATIO_MIN;
+    }
+    else if (ratio > DCDC_VMPP_RATIO_MAX) {
+        return DCDC_VMPP_RATIO_MAX;
+    }
+    return ratio;
+}
+
+void dcdc_vmpp_ratio_learn(dcdc_t *dcdc, float ratio, float temp)
+{
+    if (ratio < DCDC_VMPP_RATIO_MIN || ratio > DCDC_VMPP_RATIO_MAX) {
+        return;     // e.g. partial shading or tracking not finished
+    }
+
+    // regressors 1 and temperature difference scaled to similar magnitude (25 K)
+    float x = (temp - 25) / 25;
+    float error = ratio - (dcdc->vmpp_ratio + dcdc->vmpp_ratio_tc * (temp - 25));
+    float gain = DCDC_VMPP_LEARN_RATE * error / (1 + x * x);
+    dcdc->vmpp_ratio += gain;
+    dcdc->vmpp_ratio_tc += gain * x / 25;
+}
+
+// learns the Vmpp/Voc ratio once per tracking session after the MPPT has settled
+void _dcdc_vmpp_ratio_update(dcdc_t *dcdc, const power_port_t *in)
+{
+    if (dcdc->state != DCDC_STATE_MPPT || dcdc->sweep.state != DCDC_SWEEP_IDLE) {
+        dcdc->mppt_cycles = 0;
+    }
+    else if (++dcdc->mppt_cycles == DCDC_VMPP_LEARN_CYCLES && dcdc->voc_start > 0) {
+        // temperature latched together with Voc, as the MOSFETs heat up during tracking
+        dcdc_vmpp_ratio_learn(dcdc, in->voltage / dcdc->voc_start, dcdc->temp_start);
+    }
 }
 
-// returns if output power should be increased (1), decreased (-1) or switched off (0)
-int _dcdc_output_control(dcdc_t *dcdc, power_port_t *out, power_port_t *in)
+// switches diode emulation and burst mode of the half bridge depending on the DC/DC output
+// current (with hysteresis), only in buck mode as the low-side MOSFET is the main switch in boost mode
+void _dcdc_light_load_control(dcdc_t *dcdc, float current)
 {
-    float dcdc_power_new = out->voltage * out->current;
-    static int pwm_delta = 1;
+    bool diode_emulation = dcdc->diode_emulation;
+    bool burst = dcdc->burst;
+
+    if (dcdc->mode != MODE_MPPT_BUCK || half_bridge_enabled(&dcdc->half_bridge) == false
+        || dcdc->light_load_current <= 0)
+    {
+        diode_emulation = false;
+        burst = false;
+    }
+    else {
+        if (current < dcdc->light_load_current) {
+            diode_emulation = true;
+        }
+        else if (current > 2 * dcdc->light_load_current) {
+            diode_emulation = false;
+        }
 
+        if (current < dcdc->light_load_current / 2) {
+            burst = true;
+        }
+        else if (current > dcdc->light_load_current) {
+            burst = false;
+        }
+    }
+
+    // burst mode is left one control cycle before diode emulation, so that the sequence without
+    // skipped periods was applied by the inner control loop before the low-side MOSFET is used
+    if (diode_emulation != dcdc->diode_emulation && (diode_emulation == true
+        || dcdc->burst == false || half_bridge_enabled(&dcdc->half_bridge) == false))
+    {
+        half_bridge_set_diode_emulation(&dcdc->half_bridge, diode_emulation);
+        if (dcdc->interleaved) {
+            half_bridge_set_diode_emulation(&dcdc->half_bridge_2, diode_emulation);
+        }
+        dcdc->diode_emulation = diode_emulation;
+    }
+    if (burst != dcdc->burst) {
+        half_bridge_set_burst(&dcdc->half_bridge, burst ? DCDC_BURST_RATIO : 1.0);
+        if (dcdc->interleaved) {
+            half_bridge_set_burst(&dcdc->half_bridge_2, burst ? DCDC_BURST_RATIO : 1.0);
+        }
+        dcdc->burst = burst;
+    }
+}
+
+// returns true if the output voltage is at or above its target (CV control)
+bool _dcdc_output_voltage_limit(const power_port_t *out)
+{
+    return out->voltage > (out->voltage_output_target - out->droop_res_output * out->current);
+}
+
+// determines the duty cycle step (positive to increase output power), returns false if the
+// DC/DC should be switched off
+bool _dcdc_output_control(dcdc_t *dcdc, power_port_t *out, power_port_t *in, int *step)
+{
     //printf("P: %.2f, P_prev: %.2f, v_in: %.2f, v_out: %.2f, i_in: %.2f, i_out: %.2f, i_max: %.2f, PWM: %.1f, chg_en: %d\n",
-    //     dcdc_power_new, dcdc->power, in->voltage, out->voltage, in->current, out->current,
-    //     out->current_output_max, half_bridge_get_duty_cycle() * 100.0, out->output_allowed);
+    //     out->voltage * out->current, dcdc->power, in->voltage, out->voltage, in->current, out->current,
+    //     out->current_output_max, half_bridge_get_duty_cycle(&dcdc->half_bridge) * 100.0, out->output_allowed);
 
     if (out->output_allowed == false || in->input_allowed == false
         || (in->voltage < in->voltage_input_stop && out->current < 0.1))
     {
-        return 0;
+        *step = 0;
+        return false;
     }
-    else if (out->voltage > (out->voltage_output_target - out->droop_res_output * out->current)                     // output voltage above target
+    else if (_dcdc_output_voltage_limit(out)                                                                        // output voltage above target
         || (in->voltage < (in->voltage_input_start - in->droop_res_input * in->current) && out->current > 0.1))     // input voltage below limit
     {
         dcdc->state = DCDC_STATE_CV;
-        return -1;  // decrease output power
+        *step = -1;     // decrease output power
     }
     else if (out->current > out->current_output_max         // output current limit exceeded
         || in->current < in->current_input_max)             // input current (negative signs) limit exceeded
     {
         dcdc->state = DCDC_STATE_CC;
-        return -1;  // decrease output power
+        *step = -1;     // decrease output power
     }
     else if (fabs(dcdc->ls_current) > dcdc->ls_current_max          // current above hardware maximum
         || dcdc->temp_mosfets > 80)                                 // temperature limits exceeded
     {
         dcdc->state = DCDC_STATE_DERATING;
-        return -1;  // decrease output power
+        *step = -1;     // decrease output power
     }
     else if (out->current < 0.1 && out->voltage < out->voltage_input_start)  // no load condition (e.g. start-up of nanogrid) --> raise voltage
     {
-        return 1;   // increase output power
+        *step = 1;      // increase output power
     }
     else {
         // start MPPT
-        dcdc->state = DCDC_STATE_MPPT;
-        if (dcdc->power > dcdc_power_new) {
-            pwm_delta = -pwm_delta;
+        if (dcdc->state != DCDC_STATE_MPPT) {
+            // power and step size of last MPPT step are outdated after CC/CV or derating phases
+            // (no full reset of the algorithm, as these phases may last only a single cycle)
+            dcdc->power = 0;
+            dcdc->mppt_step = 1;
+            if (dcdc->state != DCDC_STATE_OFF) {
+                // continue with reduced output power like in the limiting phase, as increasing
+                // it would lead straight back into the limit (e.g. input voltage below the MPP
+                // voltage with rising irradiance)
+                dcdc->pwm_delta = -1;
+            }
         }
-        dcdc->power = dcdc_power_new;
-        return pwm_delta;
+        dcdc->state = DCDC_STATE_MPPT;
+        *step = mppt_get_algorithm(dcdc)->step(dcdc, out, in);
     }
+    return true;
 }
 
 bool _dcdc_check_start_conditions(dcdc_t *dcdc, power_port_t *out, power_port_t *in)
@@ -100,69 +415,145 @@ bool _dcdc_check_start_conditions(dcdc_t *dcdc, power_port_t *out, power_port_t
         && in->input_allowed == true
         && in->voltage > in->voltage_input_start
         //&& dcdc->hs_voltage - dcdc->ls_voltage > dcdc->offset_voltage_start
-        && time(NULL) > (dcdc->off_timestamp + dcdc->restart_interval);
+        && uptime > (dcdc->off_timestamp + dcdc->restart_interval);
 }
 
 void dcdc_control(dcdc_t *dcdc, power_port_t *hs, power_port_t *ls)
 {
-    if (half_bridge_enabled()) {
+    if (half_bridge_tripped(&dcdc->half_bridge)) {
+        // outputs were already switched off by the fast overcurrent trip
+        _dcdc_stop(dcdc);
+        dcdc->state = DCDC_STATE_OFF;
+        dcdc->off_timestamp = uptime;
+        log_data.error_flags |= (1 << ERR_DCDC_OVERCURRENT);
+        log_data.dcdc_trip_count++;
+        printf("DC/DC emergency stop (overcurrent trip).\n");
+    }
+
+    if (half_bridge_enabled(&dcdc->half_bridge)) {
+        _dcdc_sweep_control(dcdc);
+
         int step;
-        if (ls->current > 0.1) {    // buck mode
+        bool running = true;
+        if (dcdc->sweep.state != DCDC_SWEEP_IDLE) {
+            // operating point intentionally far from the MPP during the sweep, voltage and
+            // current limits are still applied by the inner loop
+        }
+        else if (ls->current > 0.1) {    // buck mode
             //printf("-");
-            step = _dcdc_output_control(dcdc, ls, hs);
-            half_bridge_duty_cycle_step(step);
+            running = _dcdc_output_control(dcdc, ls, hs, &step);
+            _dcdc_duty_base_step(dcdc, step, _dcdc_output_voltage_limit(ls));
+            _dcdc_set_fast_limits(dcdc, ls, true);
+            _dcdc_vmpp_ratio_update(dcdc, hs);
         }
         else {
             //printf("+");
-            step = _dcdc_output_control(dcdc, hs, ls);
-            half_bridge_duty_cycle_step(-step);
+            running = _dcdc_output_control(dcdc, hs, ls, &step);
+            _dcdc_duty_base_step(dcdc, -step, _dcdc_output_voltage_limit(hs));
+            _dcdc_set_fast_limits(dcdc, hs, false);
         }
 
-        if (step == 0) {
-            half_bridge_stop();
+        if (running == false) {
+            _dcdc_stop(dcdc);
             dcdc->state = DCDC_STATE_OFF;
-            dcdc->off_timestamp = time(NULL);
+            dcdc->off_timestamp = uptime;
             printf("DC/DC stop.\n");
         }
         else if (ls->voltage > dcdc->ls_voltage_max || hs->voltage > dcdc->hs_voltage_max) {
-            half_bridge_stop();
+            _dcdc_stop(dcdc);
             dcdc->state = DCDC_STATE_OFF;
-            dcdc->off_timestamp = time(NULL);
+            dcdc->off_timestamp = uptime;
             printf("DC/DC emergency stop (voltage limits exceeded).\n");
         }
         else if (dcdc->enabled == false) {
-            half_bridge_stop();
+            _dcdc_stop(dcdc);
             dcdc->state = DCDC_STATE_OFF;
             printf("DC/DC stop (disabled).\n");
         }
+        // DC/DC current instead of battery current, as the load may draw most of the current
+        _dcdc_light_load_control(dcdc, dcdc->ls_current);
     }
     else {
-        static int debounce_counter = 0;
+        _dcdc_light_load_control(dcdc, 0);      // e.g. after emergency stop
+
         if (dcdc->ls_current > 0.5) {
             // if there is current even though the DC/DC is switched off, the
             // high-side MOSFET must be broken --> set flag and let main() decide
             // what to do... (e.g. call dcdc_self_destruction)
-            debounce_counter++;
-            if (debounce_counter > CONTROL_FREQUENCY) {      // waited 1s before setting the flag
+            dcdc->hs_short_counter++;
+            if (dcdc->hs_short_counter > CONTROL_FREQUENCY) {      // waited 1s before setting the flag
                 log_data.error_flags |= (1 << ERR_HS_MOSFET_SHORT);
             }
             return;
         }
-        debounce_counter = 0;
+        dcdc->hs_short_counter = 0;
 
         if (_dcdc_check_start_conditions(dcdc, ls, hs) && ls->voltage < dcdc->ls_voltage_max) {
-            // Vmpp at approx. 0.8 * Voc --> take 0.9 as starting point for MPP tracking
-            half_bridge_start(ls->voltage / (hs->voltage * 0.9));
+            // start close to the MPP with learned ratio of Vmpp/Voc
+            dcdc->voc_start = hs->voltage;
+            dcdc->temp_start = dcdc->temp_mosfets;
+            dcdc->mppt_cycles = 0;
+            _dcdc_set_duty_base(dcdc, ls->voltage / (hs->voltage * dcdc_vmpp_ratio(dcdc, dcdc->temp_start)));
+            _dcdc_set_fast_limits(dcdc, ls, true);
+            mppt_get_algorithm(dcdc)->reset(dcdc);
+            _dcdc_start(dcdc);
             printf("DC/DC buck mode start.\n");
         }
         else if (_dcdc_check_start_conditions(dcdc, hs, ls) && hs->voltage < dcdc->hs_voltage_max) {
             // will automatically start with max. duty (0.97) if connected to a nanogrid not yet started up (zero voltage)
-            half_bridge_start((ls->voltage * 0.9) / hs->voltage);
+            _dcdc_set_duty_base(dcdc, (ls->voltage * 0.9) / hs->voltage);
+            _dcdc_set_fast_limits(dcdc, hs, false);
+            mppt_get_algorithm(dcdc)->reset(dcdc);
+            _dcdc_start(dcdc);
             printf("DC/DC boost mode start.\n");
         }
     }
 }
 
+void dcdc_fast_control(dcdc_t *dcdc, const dcdc_fast_meas_t *meas)
+{
+    if (half_bridge_enabled(&dcdc->half_bridge) == false) {
+        // start without reduction next time
+        dcdc->pi_voltage.integral = 0;
+        dcdc->pi_current.integral = 0;
+        dcdc->pi_balance.integral = 0;
+        if (dcdc->sweep.state == DCDC_SWEEP_REQUESTED || dcdc->sweep.state == DCDC_SWEEP_RUNNING) {
+            dcdc->sweep.state = DCDC_SWEEP_IDLE;
+        }
+        return;
+    }
+
+    int32_t v_in = dcdc->fast_buck ? meas->hs_voltage : meas->ls_voltage;
+    int32_t v_out = dcdc->fast_buck ? meas->ls_voltage : meas->hs_voltage;
+    int32_t i_out = dcdc->fast_buck ? meas->ls_current : meas->hs_current;
+
+    int32_t duty = dcdc->duty_base;
+    if (dcdc->sweep.state != DCDC_SWEEP_IDLE) {
+        duty = _dcdc_sweep_step(dcdc, v_in, v_out, i_out);
+    }
+
+    // the controller requiring the largest reduction of output power is active
+    int32_t reduction = _dcdc_pi_limit(&dcdc->pi_voltage, v_out, dcdc->fast_voltage_max);
+    int32_t reduction_i = _dcdc_pi_limit(&dcdc->pi_current, i_out, dcdc->fast_current_max);
+    if (reduction_i > reduction) {
+        reduction = reduction_i;
+    }
+
+    // output power is reduced with lower duty cycle in buck mode and higher duty cycle in boost mode
+    duty = dcdc->fast_buck ? duty - reduction : duty + reduction;
+
+    if (dcdc->interleaved) {
+        // the phase with higher current gets a lower duty cycle (independent of the direction
+        // of the power flow, as the inductor current increases with the duty cycle)
+        int32_t trim = _dcdc_balance_control(&dcdc->pi_balance, meas->phase_imbalance);
+        half_bridge_set_duty_cycle_q16(&dcdc->half_bridge, duty - trim / 2);
+        half_bridge_set_duty_cycle_q16(&dcdc->half_bridge_2, duty + trim / 2);
+    }
+    else {
+        half_bridge_set_duty_cycle_q16(&dcdc->half_bridge, duty);
+    }
+}
+
 void dcdc_self_destruction()
 {
     printf("Charge controller self-destruction called!\n");
@@ -23,8 +23,10 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "battery.h"
 #include "power_port.h"
+#include "half_bridge.h"
 
 /** DC/DC basic operation mode
  *
@@ -53,6 +55,154 @@ enum dcdc_control_state
     DCDC_STATE_DERATING ///< Hardware-limits (current or temperature) reached
 };
 
+/** Gains of the inner control loop (see dcdc_fast_control)
+ *
+ * Duty cycle change (Q16) per 1024 mV or mA (approx. 1 V or 1 A) of deviation from the limit.
+ * The integral gains are applied in each cycle of the inner loop, i.e. with 250 Hz (1 kHz ADC
+ * trigger and ADC_DMA_FRAMES per DMA interrupt). The current loop gains are much lower, as
+ * small duty cycle changes result in large current changes with a stiff battery.
+ */
+#ifndef DCDC_PI_KP_VOLTAGE
+#define DCDC_PI_KP_VOLTAGE  1311    // 0.02 per V
+#endif
+#ifndef DCDC_PI_KI_VOLTAGE
+#define DCDC_PI_KI_VOLTAGE  26      // 0.1 per V and second
+#endif
+#ifndef DCDC_PI_KP_CURRENT
+#define DCDC_PI_KP_CURRENT  66      // 0.001 per A
+#endif
+#ifndef DCDC_PI_KI_CURRENT
+#define DCDC_PI_KI_CURRENT  5       // 0.02 per A and second
+#endif
+
+/** Gains of the current balancing of interleaved phases (see dcdc_fast_control)
+ *
+ * Same scaling as the other gains of the inner loop. Only the integral part is used, as the
+ * phase currents depend on the duty cycle even more strongly than the battery current.
+ */
+#ifndef DCDC_PI_KP_BALANCE
+#define DCDC_PI_KP_BALANCE  0
+#endif
+#ifndef DCDC_PI_KI_BALANCE
+#define DCDC_PI_KI_BALANCE  5       // 0.02 per A and second
+#endif
+
+/** Maximum duty cycle difference between interleaved phases for current balancing (Q16)
+ */
+#ifndef DCDC_BALANCE_TRIM_MAX
+#define DCDC_BALANCE_TRIM_MAX 3277  // 0.05
+#endif
+
+/** Fractional bits of the PI controller gains and integrator state
+ */
+#define DCDC_PI_SHIFT 10
+
+/** PI controller of the inner control loop
+ *
+ * The controller only reduces the output power if a value exceeds its limit (anti-windup by
+ * clamping the integrator at zero).
+ */
+typedef struct {
+    int32_t kp;                 ///< Proportional gain
+    int32_t ki;                 ///< Integral gain
+    int32_t integral;           ///< Integrator state (duty cycle reduction in Q16 << DCDC_PI_SHIFT)
+} dcdc_pi_t;
+
+/** Measurements for the inner control loop (mV and mA)
+ */
+typedef struct {
+    int32_t hs_voltage;         ///< High-side port voltage
+    int32_t ls_voltage;         ///< Low-side port voltage
+    int32_t hs_current;         ///< High-side port current
+    int32_t ls_current;         ///< Low-side port current
+    int32_t phase_imbalance;    ///< Inductor current of first minus second phase (interleaved)
+} dcdc_fast_meas_t;
+
+/** Number of duty cycle points of the global MPP sweep
+ */
+#ifndef DCDC_SWEEP_POINTS
+#define DCDC_SWEEP_POINTS 64
+#endif
+
+/** Cycles of the inner control loop per point of the global MPP sweep
+ *
+ * Allows the voltages and filtered ADC readings to settle before the power is recorded.
+ */
+#define DCDC_SWEEP_CYCLES_PER_POINT 2
+
+/** State of the global MPP sweep
+ *
+ * The sweep is requested by dcdc_control() and performed by dcdc_fast_control(). Each state
+ * is only changed by one of them: The inner loop owns the requested and running states, the
+ * outer loop the idle and done states.
+ */
+enum dcdc_sweep_state
+{
+    DCDC_SWEEP_IDLE,            ///< Normal MPP tracking
+    DCDC_SWEEP_REQUESTED,       ///< Sweep to be started by inner control loop
+    DCDC_SWEEP_RUNNING,         ///< Sweep in progress
+    DCDC_SWEEP_DONE             ///< Result to be applied by outer control loop
+};
+
+/** Global MPP sweep
+ *
+ * In case of partial shading, the P-V curve has multiple local maxima and the MPPT algorithm
+ * may get stuck at the wrong one. A periodic fast sweep across the entire duty cycle range
+ * records the P-V curve and moves the operating point to the global maximum.
+ */
+typedef struct {
+    volatile uint16_t state;                ///< Sweep state (see dcdc_sweep_state)
+    int interval;                           ///< Interval between sweeps (s), 0 to disable
+    int counter;                            ///< Control cycles in MPPT state since last sweep
+    int cycles;                             ///< Cycles of the inner loop since start of sweep
+    int32_t duty_min;                       ///< Duty cycle of the first point (Q16)
+    int32_t duty_step;                      ///< Duty cycle change between points (Q16)
+    int64_t power_start;                    ///< Output power before the sweep (µW)
+    int64_t power_best;                     ///< Maximum output power found (µW)
+    int32_t duty_best;                      ///< Duty cycle at maximum output power (Q16)
+    int64_t energy_sum;                     ///< Energy lost so far (µW, summed up each cycle)
+    uint16_t voltage[DCDC_SWEEP_POINTS];    ///< Input voltage of each point (10 mV)
+    uint16_t power[DCDC_SWEEP_POINTS];      ///< Output power of each point (0.1 W)
+    float duration;                         ///< Duration of the last sweep (s)
+    float energy_lost;                      ///< Energy lost during the last sweep compared to the
+                                            ///< power before the sweep (Ws)
+} dcdc_sweep_t;
+
+/** Limits of the learned ratio of MPP voltage to open-circuit voltage
+ *
+ * Learned values outside this range (e.g. because of partial shading) are ignored.
+ */
+#define DCDC_VMPP_RATIO_MIN 0.65
+#define DCDC_VMPP_RATIO_MAX 0.95
+
+/** Control cycles in MPPT state after start before the MPP voltage is used for learning
+ */
+#ifndef DCDC_VMPP_LEARN_CYCLES
+#define DCDC_VMPP_LEARN_CYCLES (30 * CONTROL_FREQUENCY)
+#endif
+
+/** Learning rate of the Vmpp/Voc ratio (weight of a new sample)
+ */
+#ifndef DCDC_VMPP_LEARN_RATE
+#define DCDC_VMPP_LEARN_RATE 0.2
+#endif
+
+/** Fraction of active switching periods in burst mode (see half_bridge_set_burst())
+ */
+#ifndef DCDC_BURST_RATIO
+#define DCDC_BURST_RATIO 0.5
+#endif
+
+/** Number of DC/DC converters (power stages) controlled by the MCU
+ *
+ * Each converter has its own half bridge instance. Only the first converter is connected to
+ * the current measurement and the ThingSet data objects on the existing PCBs, so the firmware
+ * can't be built with more than one converter until each power stage is measured.
+ */
+#ifndef DCDC_NUM_CONVERTERS
+#define DCDC_NUM_CONVERTERS 1
+#endif
+
 /** DC/DC type
  *
  * Contains all data belonging to the DC/DC sub-component of the PCB, incl.
@@ -62,6 +212,7 @@ typedef struct {
     dcdc_operation_mode mode;   ///< DC/DC mode (buck, boost or nanogrid)
     bool enabled;               ///< Can be used to disable the DC/DC power stage
     uint16_t state;             ///< Control state (off / MPPT / CC / CV)
+    half_bridge_t half_bridge;  ///< PWM generation of the power stage
 
     // actual measurements
     float ls_current;           ///< Low-side (inductor) current
@@ -69,12 +220,53 @@ typedef struct {
 
     // current state
     float power;                ///< Power at low-side (calculated by dcdc controller)
+    uint16_t mppt_algorithm;    ///< Selected MPPT algorithm (see mppt_algorithm_id in mppt.h)
+
+    // perturb and observe MPPT
     int pwm_delta;              ///< Direction of PWM change for MPPT
+    bool mppt_adaptive;         ///< Adaptive MPPT step size (fixed step of one timer count otherwise)
+    int mppt_step;              ///< Size of the last MPPT step (timer counts)
+    uint8_t mppt_reversals;     ///< Direction reversals of the last 8 MPPT steps (one bit per step)
+
+    // incremental conductance and adaptive perturb and observe MPPT
+    float mppt_voltage_prev;    ///< Input voltage of the previous step
+    float mppt_current_prev;    ///< Input current of the previous step (positive sign)
+
+    dcdc_sweep_t sweep;         ///< Global MPP sweep (partial shading)
+
+    // learned start-up operating point
+    float vmpp_ratio;           ///< Ratio of MPP voltage to open-circuit voltage at 25°C
+    float vmpp_ratio_tc;        ///< Temperature coefficient of vmpp_ratio (1/K)
+    float voc_start;            ///< Open-circuit input voltage measured before the last start
+    float temp_start;           ///< MOSFET temperature at the time voc_start was measured (°C)
+    int mppt_cycles;            ///< Control cycles in MPPT state since the last start
+
     int off_timestamp;          ///< Time when DC/DC was switched off last time
+    int hs_short_counter;       ///< Control cycles with current although switched off (debouncing)
+
+    // light load operation in buck mode
+    float light_load_current;   ///< Low-side current below which diode emulation is used, pulse
+                                ///< skipping below half of this value (A), 0 to disable
+    bool diode_emulation;       ///< Low-side MOSFET kept off to prevent reverse current
+    bool burst;                 ///< Pulse skipping (burst mode) active
+
+    // cascaded control: setpoints of the outer loop (CONTROL_FREQUENCY) for the inner loop (ADC rate)
+    volatile int32_t duty_base;             ///< Duty cycle determined by MPPT and CC/CV stepping (Q16)
+    volatile int32_t fast_voltage_max;      ///< Output voltage limit (mV)
+    volatile int32_t fast_current_max;      ///< Output current limit (mA)
+    volatile bool fast_buck;                ///< Output at low-side port (buck) or high-side port (boost)
+    dcdc_pi_t pi_voltage;                   ///< Output voltage limiter
+    dcdc_pi_t pi_current;                   ///< Output current limiter
+
+    // interleaved operation with a second phase shifted by 180°
+    bool interleaved;                       ///< Second phase in use (see dcdc_init_interleaved)
+    half_bridge_t half_bridge_2;            ///< PWM generation of the second phase
+    dcdc_pi_t pi_balance;                   ///< Current balancing of the phases
 
     // maximum allowed values
     float ls_current_max;       ///< Maximum low-side (inductor) current
     float ls_current_min;       ///< Minimum low-side current (if lower, charger is switched off)
+    float ls_current_trip;      ///< Low-side current triggering the fast overcurrent trip
     float hs_voltage_max;       ///< Maximum high-side voltage
     float ls_voltage_max;       ///< Maximum low-side voltage
 
@@ -101,6 +293,49 @@ void dcdc_init(dcdc_t *dcdc);
  */
 void dcdc_control(dcdc_t *dcdc, power_port_t *high_side, power_port_t *low_side);
 
+/** Inner current/voltage control loop for the DC/DC converter
+ *
+ * Called from the ADC DMA interrupt after each new set of filtered readings. Applies the duty
+ * cycle set by dcdc_control() and reduces the output power immediately if the output voltage
+ * or current exceeds the limits set by dcdc_control(), e.g. during load transients.
+ *
+ * @param dcdc DC/DC type description
+ * @param meas Latest measurements, see update_fast_measurements()
+ */
+void dcdc_fast_control(dcdc_t *dcdc, const dcdc_fast_meas_t *meas);
+
+/** Enables interleaved operation with a second phase
+ *
+ * The half bridge of the second phase (half_bridge_2) must have been initialized with the
+ * same duty cycle limits before. It is shifted by 180°, started and stopped together with the
+ * first phase and gets the same duty cycle, corrected by the current balancing.
+ *
+ * @param dcdc DC/DC type description
+ */
+void dcdc_init_interleaved(dcdc_t *dcdc);
+
+/** Ratio of MPP voltage to open-circuit voltage used for the start-up duty cycle
+ *
+ * @param dcdc DC/DC type description
+ * @param temp Temperature (°C), the MOSFET temperature before the start (not yet heated up
+ *             by the DC/DC) is used as an estimate of the ambient temperature
+ *
+ * @returns Learned ratio, limited to DCDC_VMPP_RATIO_MIN..DCDC_VMPP_RATIO_MAX
+ */
+float dcdc_vmpp_ratio(const dcdc_t *dcdc, float temp);
+
+/** Updates the learned ratio of MPP voltage to open-circuit voltage
+ *
+ * Called by dcdc_control() once per tracking session when the MPPT has settled. The ratio
+ * and its temperature coefficient are adjusted by a normalized least mean squares step,
+ * so that measurements at different temperatures also improve the temperature coefficient.
+ *
+ * @param dcdc DC/DC type description
+ * @param ratio Measured ratio of MPP voltage to open-circuit voltage
+ * @param temp Temperature (°C)
+ */
+void dcdc_vmpp_ratio_learn(dcdc_t *dcdc, float ratio, float temp);
+
 /** Prevent overcharging of battery in case of shorted HS MOSFET
  *
  * This function switches the LS MOSFET continuously on to blow the battery input fuse. The reason for self destruction should
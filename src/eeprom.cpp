@@ -17,12 +17,14 @@
 #include "pcb.h"
 #include "thingset.h"
 #include "eeprom.h"
+#include "hardware.h"
 #include <inttypes.h>
-#include <time.h>
+#include <stdio.h>
+#include <string.h>
 
 // versioning of EEPROM layout (2 bytes)
 // change the version number each time the data object array below is changed!
-#define EEPROM_VERSION 3
+#define EEPROM_VERSION 7
 
 #define EEPROM_HEADER_SIZE 8    // bytes
 
@@ -40,9 +42,21 @@ const uint16_t eeprom_data_objects[] = {
     0x50, 0x51, 0x52, 0x53, 0x54, 0x55, // resistances and min/max temperatures
     0x40, 0x41, 0x42, 0x43,  // load settings
     0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA,    // V, I, T max
+#ifndef PCB_LS_010  // not enough space in 128 bytes of 24AA01
+    0xBB, 0xBC, 0xBD, 0xBE, 0xBF, 0xC0, 0xC1, 0xC2, 0xC3,          // timestamps of V, I, T max
+#endif
+    0xC6, // DC/DC overcurrent trips
+    0xD5, 0xD6, 0xD7, // MPPT algorithm settings
+    0xD8, 0xD9, // learned MPP voltage ratio
+    0xDA, // DC/DC light load threshold
     0xA6 // day count
 };
 
+const size_t num_eeprom_data_objects = sizeof(eeprom_data_objects)/sizeof(uint16_t);
+
+// upper bound of the serialized data: function code and map header plus all data objects
+#define EEPROM_DATA_SIZE_MAX (4 + EEPROM_OBJECT_SIZE_MAX * sizeof(eeprom_data_objects)/sizeof(uint16_t))
+
 #ifndef UNIT_TEST
 
 uint32_t _calc_crc(uint8_t *buf, size_t len)
@@ -68,15 +82,56 @@ uint32_t _calc_crc(uint8_t *buf, size_t len)
     return CRC->DR;
 }
 
+#else
+
+// software implementation of the CRC unit (same polynomial, byte-wise)
+uint32_t _calc_crc(uint8_t *buf, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint32_t)buf[i] << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
 #endif // UNIT_TEST
 
-#if defined(PIN_EEPROM_SDA) && defined(PIN_EEPROM_SCL)
+#if defined(UNIT_TEST)  // EEPROM emulated in RAM
+
+static uint8_t eeprom_emulated[EEPROM_HEADER_SIZE + EEPROM_DATA_SIZE_MAX];
+
+#define EEPROM_SIZE sizeof(eeprom_emulated)
+
+int eeprom_write(unsigned int addr, uint8_t* data, int len)
+{
+    if (addr + len > EEPROM_SIZE)
+        return -1;
+
+    memcpy(eeprom_emulated + addr, data, len);
+    return 0;
+}
+
+int eeprom_read(unsigned int addr, uint8_t* ret, int len)
+{
+    if (addr + len > EEPROM_SIZE)
+        return -1;
+
+    memcpy(ret, eeprom_emulated + addr, len);
+    return 0;
+}
+
+#elif defined(PIN_EEPROM_SDA) && defined(PIN_EEPROM_SCL)
 
 #ifdef PCB_LS_010
-#define EEPROM_PAGE_SIZE 8      // see datasheet of 24AA01
+#define EEPROM_SIZE 128         // see datasheet of 24AA01
+#define EEPROM_PAGE_SIZE 8
 #define EEPROM_ADDRESS_SIZE 1   // bytes
 #else
-#define EEPROM_PAGE_SIZE 32     // see datasheet of 24AA32
+#define EEPROM_SIZE 4096        // see datasheet of 24AA32
+#define EEPROM_PAGE_SIZE 32
 #define EEPROM_ADDRESS_SIZE 2   // bytes
 #endif
 
@@ -93,6 +148,10 @@ int eeprom_write (unsigned int addr, uint8_t* data, int len)
 	int err = 0;
 	uint8_t buf[EEPROM_PAGE_SIZE + 2];  // page size + 2 address bytes
 
+    // addresses would wrap around and overwrite the beginning (header) of the EEPROM
+    if (addr + len > EEPROM_SIZE)
+        return -1;
+
     for (uint16_t pos = 0; pos < len; pos += EEPROM_PAGE_SIZE) {
         if (EEPROM_ADDRESS_SIZE == 1) {
             buf[0] = (addr + pos) & 0xFF;
@@ -133,6 +192,9 @@ int eeprom_read (unsigned int addr, uint8_t* ret, int len)
 	uint8_t buf[2];
     int err = 0;
 
+    if (addr + len > EEPROM_SIZE)
+        return -1;
+
     if (EEPROM_ADDRESS_SIZE == 1) {
     	// write the address we want to read
         buf[0] = addr & 0xFF;
@@ -156,6 +218,8 @@ int eeprom_read (unsigned int addr, uint8_t* ret, int len)
 
 #elif defined(STM32L0)  // internal EEPROM
 
+#define EEPROM_SIZE (DATA_EEPROM_BANK1_END - DATA_EEPROM_BASE)
+
 int eeprom_write (unsigned int addr, uint8_t* data, int len)
 {
     int timeout = 0;
@@ -171,7 +235,7 @@ int eeprom_write (unsigned int addr, uint8_t* data, int len)
         FLASH->PEKEYR = FLASH_PEKEY2;
     }
 
-    if (addr + len > DATA_EEPROM_BANK1_END - DATA_EEPROM_BASE)
+    if (addr + len > EEPROM_SIZE)
         return -1;
 
     // write data byte-wise to EEPROM
@@ -191,7 +255,7 @@ int eeprom_write (unsigned int addr, uint8_t* data, int len)
 
 int eeprom_read (unsigned int addr, uint8_t* ret, int len)
 {
-    if (addr + len > DATA_EEPROM_BANK1_END - DATA_EEPROM_BASE)
+    if (addr + len > EEPROM_SIZE)
         return -1;
 
     memcpy(ret, ((uint8_t*)addr) + DATA_EEPROM_BASE, len);
@@ -201,7 +265,7 @@ int eeprom_read (unsigned int addr, uint8_t* ret, int len)
 #endif // STM32L0
 
 
-#if (defined(PIN_EEPROM_SDA) && defined(PIN_EEPROM_SCL)) || defined(STM32L0)
+#if (defined(PIN_EEPROM_SDA) && defined(PIN_EEPROM_SCL)) || defined(STM32L0) || defined(UNIT_TEST)
 
 // EEPROM layout:
 // bytes 0-1: Version number
@@ -209,9 +273,12 @@ int eeprom_read (unsigned int addr, uint8_t* ret, int len)
 // bytes 4-7: CRC32
 // byte 8: start of data
 
+// buffer for EEPROM header and data (static, as it is too large for the stack)
+static uint8_t eeprom_buf[EEPROM_HEADER_SIZE + EEPROM_DATA_SIZE_MAX];
+
 void eeprom_restore_data()
 {
-    uint8_t buf_req[300];  // ThingSet request buffer
+    uint8_t *buf_req = eeprom_buf + EEPROM_HEADER_SIZE;    // ThingSet request buffer
 
     // EEPROM header
     uint8_t buf_header[EEPROM_HEADER_SIZE];
@@ -228,14 +295,14 @@ void eeprom_restore_data()
     //    buf_header[0], buf_header[1], buf_header[2], buf_header[3],
     //    buf_header[4], buf_header[5], buf_header[6], buf_header[7]);
 
-    if (version == EEPROM_VERSION && len <= sizeof(buf_req)) {
+    if (version == EEPROM_VERSION && len <= EEPROM_DATA_SIZE_MAX) {
         eeprom_read(EEPROM_HEADER_SIZE, buf_req, len);
 
         //printf("Data (len=%d): ", len);
         //for (int i = 0; i < len; i++) printf("%.2x ", buf_req[i]);
 
         if (_calc_crc(buf_req, len) == crc) {
-            int status = ts.init_cbor(buf_req, sizeof(buf_req));     // first byte is ignored
+            int status = ts.init_cbor(buf_req, len);     // first byte is ignored
             printf("EEPROM: Data objects read and updated, ThingSet result: %d\n", status);
         }
         else {
@@ -249,9 +316,9 @@ void eeprom_restore_data()
 
 void eeprom_store_data()
 {
-    uint8_t buf[300];
+    uint8_t *buf = eeprom_buf;
 
-    int len = ts.pub_msg_cbor(buf + EEPROM_HEADER_SIZE, sizeof(buf) - EEPROM_HEADER_SIZE, eeprom_data_objects, sizeof(eeprom_data_objects)/sizeof(uint16_t));
+    int len = ts.pub_msg_cbor(buf + EEPROM_HEADER_SIZE, EEPROM_DATA_SIZE_MAX, eeprom_data_objects, num_eeprom_data_objects);
     uint32_t crc = _calc_crc(buf + EEPROM_HEADER_SIZE, len);
 
     // store EEPROM_VERSION, number of bytes and CRC
@@ -268,6 +335,10 @@ void eeprom_store_data()
     if (len == 0) {
         printf("EEPROM: Data could not be stored, ThingSet error: %d\n", len);
     }
+    else if (len + EEPROM_HEADER_SIZE > (int)EEPROM_SIZE) {
+        printf("EEPROM: Data could not be stored, %d bytes exceed EEPROM size\n",
+            len + EEPROM_HEADER_SIZE);
+    }
     else if (eeprom_write(0, buf, len + EEPROM_HEADER_SIZE) < 0) {
         printf("EEPROM: Write error.\n");
     }
@@ -285,7 +356,7 @@ void eeprom_restore_data() {;}
 
 void eeprom_update()
 {
-    if (time(NULL) % EEPROM_UPDATE_INTERVAL == 0 && time(NULL) > 0) {
+    if (uptime % EEPROM_UPDATE_INTERVAL == 0 && uptime > 0) {
         eeprom_store_data();
     }
 }
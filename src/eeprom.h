@@ -22,6 +22,24 @@
  * @brief Handling of internal or external EEPROM to store device configuration
  */
 
+#include <stdint.h>
+#include <stddef.h>
+
+/** Upper bound of the CBOR size of one data object stored in the EEPROM (bytes)
+ *
+ * Covers an ID of up to 16 bits and a value of up to 32 bits. Strings and 64-bit values
+ * must not be stored in the EEPROM, as the buffer size is based on this value.
+ */
+#define EEPROM_OBJECT_SIZE_MAX 8
+
+/** IDs of the data objects stored in the EEPROM
+ */
+extern const uint16_t eeprom_data_objects[];
+
+/** Number of data objects stored in the EEPROM
+ */
+extern const size_t num_eeprom_data_objects;
+
 /** Write data to EEPROM address
  *
  * @returns 0 for success
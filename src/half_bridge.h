@@ -22,48 +22,210 @@
  * @brief PWM timer functions for half bridge of DC/DC converter
  */
 
+#include <stdint.h>
+
+/** Number of fractional bits of the compare value (sigma-delta dithering)
+ *
+ * The compare value of the timer is alternated between two neighbouring counts in a sequence
+ * of 2^HALF_BRIDGE_DITHER_BITS updates (written by DMA at the timer update event), so that the
+ * average duty cycle has a finer resolution than one timer clock. Set to 0 to disable dithering.
+ */
+#ifndef HALF_BRIDGE_DITHER_BITS
+#define HALF_BRIDGE_DITHER_BITS 4
+#endif
+
+/** Half bridge instance
+ *
+ * The outputs of one half bridge are bound to a channel of the PWM timer (PWM_TIM). Several
+ * instances can share the timer, e.g. for paralleled power stages. Switching frequency, dead
+ * time and the break function (half_bridge_trip) are common to all instances of the timer.
+ */
+typedef struct {
+    int channel;                ///< Timer channel of the high-side output (see half_bridge_init)
+    float min_duty;             ///< Lower duty cycle limit
+    float max_duty;             ///< Upper duty cycle limit
+    volatile int ccr_fine;      ///< Compare value with HALF_BRIDGE_DITHER_BITS fractional bits
+    int ccr_fine_min;           ///< Lower limit of ccr_fine (min_duty)
+    int ccr_fine_max;           ///< Upper limit of ccr_fine (max_duty)
+    volatile bool enabled;      ///< PWM generation started
+    bool diode_emulation;       ///< Low-side output disabled
+    bool phase_shift;           ///< Switching period shifted by 180° (interleaved operation)
+    int burst_steps;            ///< Active switching periods per dithering sequence
+    volatile bool update_pending; ///< Sequence to be rewritten by the next duty cycle update
+    unsigned int trip_count;    ///< Number of break events of the timer at the last start
+} half_bridge_t;
+
 /** Initiatializes the registers to generate the PWM signal and sets duty
  *  cycle limits
  *
+ * The timer is configured with the first call, so switching frequency and dead time of
+ * further instances are ignored.
+ *
+ * @param hb Half bridge instance
+ * @param channel Timer channel of the high-side output: 1 to 3 for TIM1 (low-side at the
+ *                complementary output CHxN), 1 or 3 for TIM3 (low-side at channel + 1)
  * @param freq_kHz Switching frequency in kHz
  * @param deadtime_ns Deadtime in ns between switching the two FETs on/off
  * @param min_duty Minimum duty cycle (e.g. 0.5 for limiting input voltage)
  * @param max_duty Maximum duty cycle (e.g. 0.97 for charge pump)
  */
-void half_bridge_init(int freq_kHz, int deadtime_ns, float min_duty, float max_duty);
+void half_bridge_init(half_bridge_t *hb, int channel, int freq_kHz, int deadtime_ns,
+    float min_duty, float max_duty);
 
 /** Start the PWM generation
  *
+ * @param hb Half bridge instance
  * @param pwm_duty Duty cycle between 0.0 and 1.0
  */
-void half_bridge_start(float pwm_duty);
+void half_bridge_start(half_bridge_t *hb, float pwm_duty);
 
 /** Stop the PWM generation
+ *
+ * @param hb Half bridge instance
  */
-void half_bridge_stop();
+void half_bridge_stop(half_bridge_t *hb);
+
+/** Switch off the PWM outputs of all instances immediately (fast overcurrent trip)
+ *
+ * Can be called from interrupts. For TIM1, a break event is generated by software, which has
+ * the same effect as a hardware break (BKIN pin or comparator output): the outputs are
+ * disabled by the timer without further CPU involvement.
+ *
+ * The half bridges stay enabled from the software point of view until half_bridge_stop()
+ * is called, see half_bridge_tripped().
+ */
+void half_bridge_trip();
+
+/** Check if the PWM outputs were switched off by a break event since the last start
+ *
+ * @param hb Half bridge instance
+ *
+ * @returns True if tripped by half_bridge_trip() or a hardware break source
+ */
+bool half_bridge_tripped(const half_bridge_t *hb);
 
 /** Get status of the PWM output
+ *
+ * @param hb Half bridge instance
  *
  * @returns True if PWM output enabled
  */
-bool half_bridge_enabled();
+bool half_bridge_enabled(const half_bridge_t *hb);
 
 /** Set the duty cycle of the PWM signal
  *
+ * @param hb Half bridge instance
  * @param duty Duty cycle between 0.0 and 1.0
  */
-void half_bridge_set_duty_cycle(float duty);
+void half_bridge_set_duty_cycle(half_bridge_t *hb, float duty);
+
+/** Set the duty cycle of the PWM signal in fixed-point format
+ *
+ * Integer-only variant of half_bridge_set_duty_cycle() for the inner control loop, which runs
+ * in an interrupt and must not use (software) floating-point arithmetics.
+ *
+ * @param hb Half bridge instance
+ * @param duty Duty cycle in Q16 format (0 to 2^16)
+ */
+void half_bridge_set_duty_cycle_q16(half_bridge_t *hb, int32_t duty);
 
 /** Adjust the duty cycle with minimum step size
  *
- * @param delta Number of steps (positive or negative)
+ * @param hb Half bridge instance
+ * @param delta Number of steps (positive or negative), see half_bridge_get_duty_step()
  */
-void half_bridge_duty_cycle_step(int delta);
+void half_bridge_duty_cycle_step(half_bridge_t *hb, int delta);
 
 /** Read the currently set duty cycle
+ *
+ * @param hb Half bridge instance
  *
  * @returns Duty cycle between 0.0 and 1.0
  */
-float half_bridge_get_duty_cycle();
+float half_bridge_get_duty_cycle(const half_bridge_t *hb);
+
+/** Get the lower duty cycle limit set during initialization
+ *
+ * @param hb Half bridge instance
+ *
+ * @returns Minimum duty cycle between 0.0 and 1.0
+ */
+float half_bridge_get_min_duty(const half_bridge_t *hb);
+
+/** Get the upper duty cycle limit set during initialization
+ *
+ * @param hb Half bridge instance
+ *
+ * @returns Maximum duty cycle between 0.0 and 1.0
+ */
+float half_bridge_get_max_duty(const half_bridge_t *hb);
+
+/** Enable or disable diode emulation
+ *
+ * The low-side MOSFET is kept off, so that its body diode takes over the freewheeling
+ * current. Prevents negative inductor current (reverse current from the battery) in buck
+ * mode at light load and reduces gate drive losses.
+ *
+ * While the PWM is running, the dithering sequence is only rewritten with the next duty cycle
+ * update (see half_bridge_set_burst). Burst mode has to be disabled and applied this way
+ * before diode emulation is disabled.
+ *
+ * @param hb Half bridge instance
+ * @param enabled True to keep the low-side MOSFET off
+ */
+void half_bridge_set_diode_emulation(half_bridge_t *hb, bool enabled);
+
+/** Set pulse skipping (burst mode) for light load
+ *
+ * The high-side MOSFET is only switched on in the given fraction of the switching periods,
+ * which reduces the switching losses. Only active together with diode emulation, as the
+ * low-side MOSFET would be permanently on during the skipped periods otherwise.
+ *
+ * While the PWM is running, the new setting is applied by the next call of
+ * half_bridge_set_duty_cycle_q16() or a similar function. The dithering sequence read by DMA
+ * is then only written by the context which updates the duty cycle (inner control loop).
+ *
+ * @param hb Half bridge instance
+ * @param ratio Fraction of active switching periods (1.0 to disable burst mode)
+ */
+void half_bridge_set_burst(half_bridge_t *hb, float ratio);
+
+/** Shift the switching period by 180° for interleaved operation
+ *
+ * The high-side on-time of a shifted instance is centered at the peak of the center-aligned
+ * timer counter instead of the valley, so two phases with the same duty cycle switch
+ * alternately. The ripple currents of the phases partly cancel each other.
+ *
+ * @param hb Half bridge instance
+ * @param shifted True for 180° phase shift
+ */
+void half_bridge_set_phase_shift(half_bridge_t *hb, bool shifted);
+
+/** Get the minimum step size of the duty cycle
+ *
+ * With dithering enabled, this is a fraction of one timer clock of the switching period.
+ *
+ * @returns Duty cycle change of one step of half_bridge_duty_cycle_step()
+ */
+float half_bridge_get_duty_step();
+
+/** Get the period of the PWM signal
+ *
+ * The PWM timer runs with SystemCoreClock, so other timers with the same clock can be
+ * synchronized to the PWM, e.g. to trigger the ADC.
+ *
+ * @returns Switching period in timer clock cycles
+ */
+int half_bridge_get_period_clocks();
+
+/** Get the current position of the timer within the switching period
+ *
+ * The position is zero in the center of the high-side MOSFET on-time, where the inductor
+ * current equals its average value. For instances shifted by 180°, this is the center of the
+ * low-side on-time, where the inductor current equals its average value as well.
+ *
+ * @returns Timer clock cycles since the last center of the high-side on-time
+ */
+int half_bridge_get_phase_clocks();
 
 #endif /* HALF_BRIDGE_H */
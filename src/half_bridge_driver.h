@@ -0,0 +1,295 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HALF_BRIDGE_DRIVER_H
+#define HALF_BRIDGE_DRIVER_H
+
+/** @file
+ *
+ * @brief Common part of the half bridge drivers
+ *
+ * Duty cycle limits, resolution, sigma-delta dithering, burst mode and the bookkeeping of
+ * start/stop/trip are implemented once in HalfBridgeDriver. The backends (TIM1, TIM3 and the
+ * host backend of the unit tests) derive from it and only implement the register access
+ * (static polymorphism, so all hooks are resolved and inlined at compile time):
+ *
+ * - `int resolution()`: Timer clocks per switching period
+ * - `unsigned int trip_count()`: Number of break events of the timer
+ * - `void init_timer(int freq_kHz, int deadtime_ns)`: Timer setup (ignored if already running)
+ * - `void init_channel(int channel)`: Output pins and compare mode of the channel
+ * - `void lock()`: Write protection of the timer configuration after each init_channel (must
+ *   keep the registers writable which are needed for further channels and at runtime)
+ * - `void write_sequence(half_bridge_t *hb, int step, int on_clocks)`: Compare value(s) of one
+ *   step of the dithering sequence for the given high-side on-time
+ * - `void write_compare(half_bridge_t *hb, int on_clocks)`: Compare value(s) used until the
+ *   sequence takes effect
+ * - `void set_outputs(half_bridge_t *hb, bool hs, bool ls)`: Enables or disables the outputs
+ * - `void set_pwm_mode2(half_bridge_t *hb, bool mode2)`: Inverted compare logic (phase shift)
+ *
+ * The C interface of half_bridge.h is generated for the backend by HALF_BRIDGE_DEFINE_API.
+ * Only the timer-wide functions half_bridge_trip(), half_bridge_get_period_clocks() and
+ * half_bridge_get_phase_clocks() are implemented by each backend directly.
+ */
+
+#include "half_bridge.h"
+
+template <class Backend>
+class HalfBridgeDriver
+{
+public:
+    static const int dither_steps = 1 << HALF_BRIDGE_DITHER_BITS;
+
+    static void init(half_bridge_t *hb, int channel, int freq_kHz, int deadtime_ns,
+        float min_duty, float max_duty)
+    {
+        Backend::init_timer(freq_kHz, deadtime_ns);
+        Backend::init_channel(channel);
+        Backend::lock();
+
+        hb->channel = channel;
+        hb->min_duty = min_duty;
+        hb->max_duty = max_duty;
+        hb->diode_emulation = false;
+        hb->phase_shift = false;
+        hb->burst_steps = dither_steps;
+        hb->update_pending = false;
+        hb->ccr_fine_min = fine_steps() * min_duty;
+        hb->ccr_fine_max = fine_steps() * max_duty;
+        hb->ccr_fine = hb->ccr_fine_max;        // init with allowed value
+        update_sequence(hb);
+
+        hb->enabled = false;
+    }
+
+    static void set_duty_cycle(half_bridge_t *hb, float duty)
+    {
+        set_ccr_fine(hb, fine_steps() * duty);
+    }
+
+    static void set_duty_cycle_q16(half_bridge_t *hb, int32_t duty)
+    {
+        // limited to 0..1 first, so that the product can't overflow (fine_steps() < 2^16)
+        if (duty < 0) {
+            duty = 0;
+        }
+        else if (duty > (1 << 16)) {
+            duty = 1 << 16;
+        }
+        set_ccr_fine(hb, ((uint32_t)duty * fine_steps() + (1 << 15)) >> 16);
+    }
+
+    static void duty_cycle_step(half_bridge_t *hb, int delta)
+    {
+        set_ccr_fine(hb, hb->ccr_fine + delta);
+    }
+
+    static float get_duty_cycle(const half_bridge_t *hb)
+    {
+        return (float)hb->ccr_fine / fine_steps();
+    }
+
+    static float get_duty_step()
+    {
+        return 1.0f / fine_steps();
+    }
+
+    static void set_diode_emulation(half_bridge_t *hb, bool enabled)
+    {
+        // outputs switched first, so that the low-side MOSFET is already off as soon as the
+        // sequence may contain skipped periods
+        if (hb->enabled && !tripped(hb)) {
+            Backend::set_outputs(hb, true, !enabled);
+        }
+        hb->diode_emulation = enabled;
+        request_update(hb);
+    }
+
+    static void set_burst(half_bridge_t *hb, float ratio)
+    {
+        int steps = ratio * dither_steps + 0.5;
+        if (steps < 1) {
+            steps = 1;
+        }
+        else if (steps > dither_steps) {
+            steps = dither_steps;
+        }
+        hb->burst_steps = steps;
+        request_update(hb);
+    }
+
+    static void set_phase_shift(half_bridge_t *hb, bool shifted)
+    {
+        hb->phase_shift = shifted;
+        Backend::set_pwm_mode2(hb, shifted);
+        request_update(hb);
+    }
+
+    static void start(half_bridge_t *hb, float pwm_duty)
+    {
+        set_duty_cycle(hb, pwm_duty);
+        hb->trip_count = Backend::trip_count();
+        Backend::set_outputs(hb, true, !hb->diode_emulation);
+        hb->enabled = true;
+    }
+
+    static void stop(half_bridge_t *hb)
+    {
+        Backend::set_outputs(hb, false, false);
+        hb->enabled = false;
+    }
+
+    static bool tripped(const half_bridge_t *hb)
+    {
+        return hb->enabled && hb->trip_count != Backend::trip_count();
+    }
+
+private:
+    // resolution of the duty cycle (timer clocks of the on-time with fractional bits)
+    static int fine_steps()
+    {
+        return Backend::resolution() / 2 * dither_steps;
+    }
+
+    static void set_ccr_fine(half_bridge_t *hb, int ccr_fine)
+    {
+        // protection against wrong settings which could destroy the hardware
+        if (ccr_fine < hb->ccr_fine_min) {
+            ccr_fine = hb->ccr_fine_min;
+        }
+        else if (ccr_fine > hb->ccr_fine_max) {
+            ccr_fine = hb->ccr_fine_max;
+        }
+
+        // the sequence is only rewritten if necessary, as this is called with each run of
+        // the inner control loop
+        if (ccr_fine != hb->ccr_fine || hb->update_pending) {
+            hb->update_pending = false;
+            hb->ccr_fine = ccr_fine;
+            update_sequence(hb);
+        }
+    }
+
+    // While the PWM is running, the sequence is only rewritten by the next duty cycle update,
+    // so that it has a single writer (the inner control loop) and is never modified by two
+    // contexts interrupting each other.
+    static void request_update(half_bridge_t *hb)
+    {
+        if (hb->enabled) {
+            hb->update_pending = true;
+        }
+        else {
+            update_sequence(hb);
+        }
+    }
+
+    // first-order sigma-delta modulation of the fractional part of the compare value
+    static void update_sequence(half_bridge_t *hb)
+    {
+        int ccr = hb->ccr_fine >> HALF_BRIDGE_DITHER_BITS;
+        int frac = hb->ccr_fine & (dither_steps - 1);
+        int active = hb->diode_emulation ? hb->burst_steps : dither_steps;
+        int acc = 0;
+        int acc_burst = 0;
+        for (int i = 0; i < dither_steps; i++) {
+            // skipped periods in burst mode are distributed evenly as well
+            int ccr_i = 0;
+            acc_burst += active;
+            if (acc_burst >= dither_steps) {
+                acc_burst -= dither_steps;
+                acc += frac;
+                ccr_i = ccr;
+                if (acc >= dither_steps) {
+                    acc -= dither_steps;
+                    ccr_i++;
+                }
+            }
+            Backend::write_sequence(hb, i, ccr_i);
+        }
+        Backend::write_compare(hb, ccr);
+    }
+};
+
+/**
+ * Defines the C interface of half_bridge.h for the given backend
+ *
+ * Expanded once at the end of the backend's translation unit (only one backend is compiled per
+ * build), so that the hooks are inlined into these functions and the header itself contains
+ * no definitions.
+ */
+#define HALF_BRIDGE_DEFINE_API(Backend) \
+    void half_bridge_init(half_bridge_t *hb, int channel, int freq_kHz, int deadtime_ns, \
+        float min_duty, float max_duty) \
+    { \
+        Backend::init(hb, channel, freq_kHz, deadtime_ns, min_duty, max_duty); \
+    } \
+    void half_bridge_set_duty_cycle(half_bridge_t *hb, float duty) \
+    { \
+        Backend::set_duty_cycle(hb, duty); \
+    } \
+    void half_bridge_set_duty_cycle_q16(half_bridge_t *hb, int32_t duty) \
+    { \
+        Backend::set_duty_cycle_q16(hb, duty); \
+    } \
+    void half_bridge_duty_cycle_step(half_bridge_t *hb, int delta) \
+    { \
+        Backend::duty_cycle_step(hb, delta); \
+    } \
+    float half_bridge_get_duty_cycle(const half_bridge_t *hb) \
+    { \
+        return Backend::get_duty_cycle(hb); \
+    } \
+    float half_bridge_get_duty_step() \
+    { \
+        return Backend::get_duty_step(); \
+    } \
+    void half_bridge_set_diode_emulation(half_bridge_t *hb, bool enabled) \
+    { \
+        Backend::set_diode_emulation(hb, enabled); \
+    } \
+    void half_bridge_set_burst(half_bridge_t *hb, float ratio) \
+    { \
+        Backend::set_burst(hb, ratio); \
+    } \
+    void half_bridge_set_phase_shift(half_bridge_t *hb, bool shifted) \
+    { \
+        Backend::set_phase_shift(hb, shifted); \
+    } \
+    void half_bridge_start(half_bridge_t *hb, float pwm_duty) \
+    { \
+        Backend::start(hb, pwm_duty); \
+    } \
+    void half_bridge_stop(half_bridge_t *hb) \
+    { \
+        Backend::stop(hb); \
+    } \
+    bool half_bridge_tripped(const half_bridge_t *hb) \
+    { \
+        return Backend::tripped(hb); \
+    } \
+    bool half_bridge_enabled(const half_bridge_t *hb) \
+    { \
+        return hb->enabled; \
+    } \
+    float half_bridge_get_min_duty(const half_bridge_t *hb) \
+    { \
+        return hb->min_duty; \
+    } \
+    float half_bridge_get_max_duty(const half_bridge_t *hb) \
+    { \
+        return hb->max_duty; \
+    }
+
+#endif /* HALF_BRIDGE_DRIVER_H */
@@ -16,159 +16,296 @@
 
 #ifndef UNIT_TEST
 
-#include "half_bridge.h"
+#include "half_bridge_driver.h"
 #include "pcb.h"
 #include "config.h"
 
 #if defined(STM32F0) && (PWM_TIM == 1)
 
-static int _pwm_resolution;
-static float _min_duty;
-static float _max_duty;
-
-static bool _enabled;
-
-void _init_registers(int freq_kHz, int deadtime_ns)
-{
-    // Enable peripheral clock of GPIOA and GPIOB
-    RCC->AHBENR |= RCC_AHBENR_GPIOAEN | RCC_AHBENR_GPIOBEN;
-
-    // Enable TIM1 clock
-    RCC->APB2ENR |= RCC_APB2ENR_TIM1EN;
-
-    // Select alternate function mode on PA8 und PB13
-    GPIOA->MODER = (GPIOA->MODER & ~(GPIO_MODER_MODER8)) | GPIO_MODER_MODER8_1;
-    GPIOB->MODER = (GPIOB->MODER & ~(GPIO_MODER_MODER13)) | GPIO_MODER_MODER13_1;
+#define DITHER_STEPS (1 << HALF_BRIDGE_DITHER_BITS)
 
-    // Select AF2 on PA8 (TIM1_CH1)
-    GPIOA->AFR[1] |= 0x2 << ((8 - 8)*4);   // AFR[1] for pins 8-15
+// complementary output channels of TIM1 (CH1/CH1N to CH3/CH3N)
+#define NUM_CHANNELS 3
 
-    // Select AF2 on PB13 (TIM1_CH1N)
-    GPIOB->AFR[1] |= 0x2 << ((13 - 8)*4);  // AFR[1] for pins 8-15
+// GPIO pins of high-side (TIM1_CHx at port A) and low-side (TIM1_CHxN at port B) outputs
+static const uint8_t _pins_hs[NUM_CHANNELS] = { 8, 9, 10 };
+static const uint8_t _pins_ls[NUM_CHANNELS] = { 13, 14, 15 };
 
-    // No prescaler --> timer frequency = 48 MHz
-    TIM1->PSC = 0;
+static int _pwm_resolution;
 
-    // Capture/Compare Mode Register 1
-    // OC1M = 110: Select PWM mode 1 on OC1
-    // OC1PE = 1:  Enable preload register on OC1 (reset value)
-    TIM1->CCMR1 |= TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE;
+// number of break events (software or hardware), see half_bridge_tripped()
+static volatile unsigned int _trip_count;
 
-    // Capture/Compare Enable Register
-    // CC1E = 1: Enable the output on OC1
-    // CC1P = 0: Active high polarity on OC1 (default)
-    // CC1NE = 1: Enable the output on OC1N
-    // CC1NP = 0: Active high polarity on OC1N (default)
-    TIM1->CCER |= TIM_CCER_CC1E | TIM_CCER_CC1NE;// | TIM_CCER_CC1NP;
+// compare values written to CCR1 to CCR3 by DMA burst at each update event
+static volatile uint16_t _ccr_sequence[DITHER_STEPS][NUM_CHANNELS];
 
-    // Control Register 1
-    // TIM_CR1_CMS = 01: Select center-aligned mode 1
-    // TIM_CR1_CEN =  1: Counter enable
-    TIM1->CR1 |= TIM_CR1_CMS_0 | TIM_CR1_CEN;
+#if HALF_BRIDGE_DITHER_BITS > 0
 
-    // Control Register 2
-    // OIS1 = OIS1N = 0: Output Idle State is set to off
-    //TIM1->CR2 |= ;
+static void _init_dithering()
+{
+    // Enable the peripheral clock on DMA
+    RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+
+    // DMA Control Register
+    // DBL = 2: burst of 3 transfers, DBA = 13: starting at CCR1
+    TIM1->DCR = ((NUM_CHANNELS - 1) << TIM_DCR_DBL_Pos)
+        | ((&(TIM1->CCR1) - &(TIM1->CR1)) << TIM_DCR_DBA_Pos);
+
+    // DMA channel 5 (TIM1_UP) writes the sequence to CCR1 to CCR3 via DMAR
+    DMA1_Channel5->CPAR = (uint32_t)(&(TIM1->DMAR));
+    DMA1_Channel5->CMAR = (uint32_t)(&(_ccr_sequence[0][0]));
+    DMA1_Channel5->CNDTR = NUM_CHANNELS * DITHER_STEPS;
+    DMA1_Channel5->CCR =
+        DMA_CCR_MINC |          // memory increment mode enabled
+        DMA_CCR_MSIZE_0 |       // memory size 16-bit
+        DMA_CCR_PSIZE_0 |       // peripheral size 16-bit
+        DMA_CCR_DIR |           // read from memory
+        DMA_CCR_CIRC;           // circular mode enable
+    DMA1_Channel5->CCR |= DMA_CCR_EN;
+
+    // DMA/Interrupt Enable Register
+    // UDE = 1: Update DMA request enable
+    TIM1->DIER |= TIM_DIER_UDE;
+}
 
-    // Force update generation (UG = 1)
-    TIM1->EGR |= TIM_EGR_UG;
+#endif
 
-    // set PWM frequency and resolution
-    _pwm_resolution = SystemCoreClock / (freq_kHz * 1000);
+// register access of TIM1 (see HalfBridgeDriver for the description of the hooks)
+struct HalfBridgeTim1 : HalfBridgeDriver<HalfBridgeTim1>
+{
+    static int resolution()
+    {
+        return _pwm_resolution;
+    }
 
-    // Auto Reload Register
-    // center-aligned mode --> divide resolution by 2
-    TIM1->ARR = _pwm_resolution / 2;
+    static unsigned int trip_count()
+    {
+        return _trip_count;
+    }
 
-    uint8_t deadtime_clocks = (SystemCoreClock / 1000 / 1000) * deadtime_ns / 1000;
+    // CCxE and CCxNE bits of the channel
+    static uint32_t ccer_hs(const half_bridge_t *hb)
+    {
+        return TIM_CCER_CC1E << ((hb->channel - 1) * 4);
+    }
 
-    // Break and Dead-Time Register
-    // MOE  = 1: Main output enable
-    // OSSR = 0: Off-state selection for Run mode -> OC/OCN = 0
-    // OSSI = 0: Off-state selection for Idle mode -> OC/OCN = 0
-    TIM1->BDTR |= (deadtime_clocks & (uint32_t)0x7F); // ensure that only the last 7 bits are changed
+    static uint32_t ccer_ls(const half_bridge_t *hb)
+    {
+        return TIM_CCER_CC1NE << ((hb->channel - 1) * 4);
+    }
 
-    // Lock Break and Dead-Time Register
-    // TODO: does not work properly... maybe HW bug?
-    TIM1->BDTR |= TIM_BDTR_LOCK_1 | TIM_BDTR_LOCK_0;
-}
+    // compare value for the given high-side on-time (PWM mode 2 if shifted by 180°)
+    static int ccr_value(const half_bridge_t *hb, int on_clocks)
+    {
+        return hb->phase_shift ? _pwm_resolution / 2 - on_clocks : on_clocks;
+    }
 
-void half_bridge_init(int freq_kHz, int deadtime_ns, float min_duty, float max_duty)
-{
-    _init_registers(freq_kHz, deadtime_ns);
+    static void write_sequence(half_bridge_t *hb, int step, int on_clocks)
+    {
+        _ccr_sequence[step][hb->channel - 1] = ccr_value(hb, on_clocks);
+    }
 
-    _min_duty = min_duty;
-    _max_duty = max_duty;
-    half_bridge_set_duty_cycle(_max_duty);      // init with allowed value
+    static void write_compare(half_bridge_t *hb, int on_clocks)
+    {
+        (&(TIM1->CCR1))[hb->channel - 1] = ccr_value(hb, on_clocks);
+    }
 
-    _enabled = false;
-}
+    static void init_timer(int freq_kHz, int deadtime_ns)
+    {
+        if (TIM1->CR1 & TIM_CR1_CEN) {
+            return;     // already configured by another instance
+        }
+
+        // Enable TIM1 clock
+        RCC->APB2ENR |= RCC_APB2ENR_TIM1EN;
+
+        // No prescaler --> timer frequency = 48 MHz
+        TIM1->PSC = 0;
+
+        // Control Register 1
+        // TIM_CR1_CMS = 01: Select center-aligned mode 1
+        // TIM_CR1_CEN =  1: Counter enable
+        TIM1->CR1 |= TIM_CR1_CMS_0 | TIM_CR1_CEN;
+
+        // Control Register 2
+        // OIS1 = OIS1N = 0: Output Idle State is set to off
+        //TIM1->CR2 |= ;
+
+        // Repetition Counter Register
+        // RCR = 1: one update event per switching period (instead of both at overflow and
+        // underflow in center-aligned mode)
+        TIM1->RCR = 1;
+
+        // Force update generation (UG = 1)
+        TIM1->EGR |= TIM_EGR_UG;
+
+        // set PWM frequency and resolution
+        _pwm_resolution = SystemCoreClock / (freq_kHz * 1000);
+
+        // Auto Reload Register
+        // center-aligned mode --> divide resolution by 2
+        TIM1->ARR = _pwm_resolution / 2;
+
+        uint8_t deadtime_clocks = (SystemCoreClock / 1000 / 1000) * deadtime_ns / 1000;
+
+        // Break and Dead-Time Register
+        // MOE  = 1: Main output enable
+        // OSSR = 1: Off-state selection for Run mode -> OC/OCN = inactive level if disabled via
+        //           CCxE/CCxNE (used for diode emulation and stopped channels)
+        // OSSI = 0: Off-state selection for Idle mode -> OC/OCN = 0
+        TIM1->BDTR |= (deadtime_clocks & (uint32_t)0x7F); // ensure that only the last 7 bits are changed
+        TIM1->BDTR |= TIM_BDTR_OSSR;
+
+        // BKE = 1: Break inputs enabled (software break via EGR and BKIN/comparator if configured)
+        // BKP = 1: Break input active high (no break if not connected)
+        // AOE = 0: MOE can only be set by software again after a break event
+        TIM1->BDTR |= TIM_BDTR_BKE | TIM_BDTR_BKP;
+
+        // DMA/Interrupt Enable Register
+        // BIE = 1: Break interrupt enable (bookkeeping of break events, see IRQ handler below)
+        TIM1->DIER |= TIM_DIER_BIE;
+        NVIC_SetPriority(TIM1_BRK_UP_TRG_COM_IRQn, 0);
+        NVIC_EnableIRQ(TIM1_BRK_UP_TRG_COM_IRQn);
+
+#if HALF_BRIDGE_DITHER_BITS > 0
+        _init_dithering();
+#endif
+    }
 
-void half_bridge_set_duty_cycle(float duty)
-{
-    float duty_target;
-    // protection against wrong settings which could destroy the hardware
-    if (duty < _min_duty) {
-        duty_target = _min_duty;
+    static void init_channel(int channel)
+    {
+        if (channel < 1 || channel > NUM_CHANNELS) {
+            error("Invalid half bridge channel");
+        }
+
+        int pin_hs = _pins_hs[channel - 1];
+        int pin_ls = _pins_ls[channel - 1];
+
+        // Enable peripheral clock of GPIOA and GPIOB
+        RCC->AHBENR |= RCC_AHBENR_GPIOAEN | RCC_AHBENR_GPIOBEN;
+
+        // Select alternate function mode on high-side and low-side pins
+        GPIOA->MODER = (GPIOA->MODER & ~(0x3U << (pin_hs * 2))) | (0x2U << (pin_hs * 2));
+        GPIOB->MODER = (GPIOB->MODER & ~(0x3U << (pin_ls * 2))) | (0x2U << (pin_ls * 2));
+
+        // Select AF2 (TIM1_CHx and TIM1_CHxN)
+        GPIOA->AFR[pin_hs / 8] |= 0x2 << ((pin_hs % 8) * 4);
+        GPIOB->AFR[pin_ls / 8] |= 0x2 << ((pin_ls % 8) * 4);
+
+        // Capture/Compare Mode Register 1 (CH1, CH2) or 2 (CH3)
+        // OCxM = 110: Select PWM mode 1 on OCx
+        // OCxPE = 1:  Enable preload register on OCx (reset value)
+        uint32_t ccmr = (TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE)
+            << (((channel - 1) % 2) * 8);
+        if (channel <= 2) {
+            TIM1->CCMR1 |= ccmr;
+        }
+        else {
+            TIM1->CCMR2 |= ccmr;
+        }
+
+        // Capture/Compare Enable Register
+        // CCxP = 0: Active high polarity on OCx (default)
+        // CCxNP = 0: Active high polarity on OCxN (default)
+        // CCxE and CCxNE are set in half_bridge_start()
     }
-    else if (duty > _max_duty) {
-        duty_target = _max_duty;
+
+    static void lock()
+    {
+        // Break and Dead-Time Register
+        // LOCK = 10: Lock level 2, dead time, break and off-state configuration as well as the
+        //            output polarity are read-only until the next reset (written only once).
+        //            Level 3 would lock the compare mode (CCMR), which is still written for
+        //            the channels of further instances and by set_pwm_mode2 afterwards.
+        TIM1->BDTR |= TIM_BDTR_LOCK_1;
     }
-    else {
-        duty_target = duty;
+
+    static void set_outputs(half_bridge_t *hb, bool hs, bool ls)
+    {
+        // Capture/Compare Enable Register
+        // CCxE = 1: Enable the output on OCx
+        // CCxNE = 1: Enable the output on OCxN
+        // CCxE = CCxNE = 0: outputs at inactive level (see OSSR)
+        TIM1->CCER = (TIM1->CCER & ~(ccer_hs(hb) | ccer_ls(hb)))
+            | (hs ? ccer_hs(hb) : 0) | (ls ? ccer_ls(hb) : 0);
+
+        // Break and Dead-Time Register
+        // MOE  = 1: Main output enable
+        // MOE  = 0: Main output disable if no other channel is running
+        if (hs) {
+            // re-arm the break interrupt (disabled by the IRQ handler after a break event), BIF
+            // is set again immediately if the break input is still active
+            TIM1->SR = ~(TIM_SR_BIF);
+            TIM1->DIER |= TIM_DIER_BIE;
+#ifndef PIL_TESTING
+            TIM1->BDTR |= TIM_BDTR_MOE;
+#endif
+        }
+        else if ((TIM1->CCER & (TIM_CCER_CC1E | TIM_CCER_CC2E | TIM_CCER_CC3E)) == 0) {
+            TIM1->BDTR &= ~(TIM_BDTR_MOE);
+        }
     }
 
-    TIM1->CCR1 = _pwm_resolution / 2 * duty_target;
-}
+    static void set_pwm_mode2(half_bridge_t *hb, bool mode2)
+    {
+        // called after lock(), so OCxM must not be write-protected (lock level below 3)
+
+        // Capture/Compare Mode Register 1 (CH1, CH2) or 2 (CH3)
+        // OCxM = 111: PWM mode 2 (active while counter is above CCR, i.e. centered at its peak)
+        // OCxM = 110: PWM mode 1
+        uint32_t bits = TIM_CCMR1_OC1M_0 << (((hb->channel - 1) % 2) * 8);
+        volatile uint32_t *ccmr = (hb->channel <= 2) ? &(TIM1->CCMR1) : &(TIM1->CCMR2);
+        if (mode2) {
+            *ccmr |= bits;
+        }
+        else {
+            *ccmr &= ~bits;
+        }
+    }
+};
 
-void half_bridge_duty_cycle_step(int delta)
+// called for software break (half_bridge_trip) and hardware break sources
+extern "C" void TIM1_BRK_UP_TRG_COM_IRQHandler(void)
 {
-    float duty_target;
-    duty_target = (float)(TIM1->CCR1 + delta) / (_pwm_resolution / 2);
-
-    // protection against wrong settings which could destroy the hardware
-    if (duty_target < _min_duty) {
-        half_bridge_set_duty_cycle(_min_duty);
-    }
-    else if (duty_target > _max_duty) {
-        half_bridge_set_duty_cycle(_max_duty);
-    }
-    else {
-        TIM1->CCR1 = TIM1->CCR1 + delta;
+    if (TIM1->SR & TIM_SR_BIF) {
+        // MOE is already cleared by hardware, disable channels so that outputs of tripped
+        // instances stay off if another instance is started before they are stopped
+        TIM1->CCER &= ~(TIM_CCER_CC1E | TIM_CCER_CC1NE | TIM_CCER_CC2E | TIM_CCER_CC2NE
+            | TIM_CCER_CC3E | TIM_CCER_CC3NE);
+        _trip_count++;
+
+        // BIF can't be cleared while the break input is active, so the interrupt is disabled
+        // until the outputs are enabled again (see set_outputs)
+        TIM1->DIER &= ~(TIM_DIER_BIE);
+        TIM1->SR = ~(TIM_SR_BIF);
     }
 }
 
-float half_bridge_get_duty_cycle()
+void half_bridge_trip()
 {
-    return (float)(TIM1->CCR1) / (_pwm_resolution / 2);;
+    // Event Generation Register
+    // BG = 1: Break generation (MOE is cleared by hardware and BIF is set)
+    TIM1->EGR = TIM_EGR_BG;
 }
 
-void half_bridge_start(float pwm_duty)
+int half_bridge_get_period_clocks()
 {
-    half_bridge_set_duty_cycle(pwm_duty);
-
-#ifndef PIL_TESTING
-    // Break and Dead-Time Register
-    // MOE  = 1: Main output enable
-    TIM1->BDTR |= TIM_BDTR_MOE;
-#endif
-
-    _enabled = true;
+    // center-aligned mode --> counting up and down
+    return 2 * TIM1->ARR;
 }
 
-void half_bridge_stop()
+int half_bridge_get_phase_clocks()
 {
-    // Break and Dead-Time Register
-    // MOE  = 1: Main output enable
-    TIM1->BDTR &= ~(TIM_BDTR_MOE);
-
-    _enabled = false;
+    // PWM mode 1 in center-aligned mode: high-side is on while counter is below CCR
+    if (TIM1->CR1 & TIM_CR1_DIR) {
+        return 2 * TIM1->ARR - TIM1->CNT;    // counting down
+    }
+    else {
+        return TIM1->CNT;                    // counting up
+    }
 }
 
-bool half_bridge_enabled()
-{
-    return _enabled;
-}
+HALF_BRIDGE_DEFINE_API(HalfBridgeTim1)
 
 #endif /* PWM_TIM */
 
@@ -16,162 +16,269 @@
 
 #ifndef UNIT_TEST
 
-/* Generates PWM signal on PB0 (high-side) and PB1 (low-side) using timer TIM3
+/* Generates PWM signals using timer TIM3, e.g. on PB0 (high-side, CH3) and PB1 (low-side, CH4)
  */
 
-#include "half_bridge.h"
+#include "half_bridge_driver.h"
 #include "pcb.h"
 #include "config.h"
 
 // timer used for PWM generation has to be globally selected for the used PCB
 #if (PWM_TIM == 3)
 
-static int _pwm_resolution;
-static float _min_duty;
-static float _max_duty;
-static uint8_t _deadtime_clocks;
+#define DITHER_STEPS (1 << HALF_BRIDGE_DITHER_BITS)
 
-static bool _enabled;
+#define NUM_CHANNELS 4
 
-void _init_registers(int freq_kHz)
-{
-    // Enable peripheral clock of GPIOB
 #if defined(STM32F0)
-    RCC->AHBENR |= RCC_AHBENR_GPIOBEN;
+#define GPIO_AF_TIM3 0x1
 #elif defined(STM32L0)
-    RCC->IOPENR |= RCC_IOPENR_IOPBEN;
+#define GPIO_AF_TIM3 0x2
 #endif
 
-    // Enable TIM3 clock
-    RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
+// GPIO pins of the two channel pairs (high-side CH1 or CH3, low-side CH2 or CH4)
+static const struct {
+    GPIO_TypeDef *port;
+    uint8_t pin_hs;
+    uint8_t pin_ls;
+} _pins[2] = {
+    { GPIOA, 6, 7 },        // TIM3_CH1, TIM3_CH2
+    { GPIOB, 0, 1 },        // TIM3_CH3, TIM3_CH4
+};
 
-    // Select alternate function mode on PB0 and PB1 (first bit _1 = 1, second bit _0 = 0)
-#if defined(STM32F0)
-    GPIOB->MODER = (GPIOB->MODER & ~(GPIO_MODER_MODER0)) | GPIO_MODER_MODER0_1;
-    GPIOB->MODER = (GPIOB->MODER & ~(GPIO_MODER_MODER1)) | GPIO_MODER_MODER1_1;
-#elif defined(STM32L0)
-    GPIOB->MODER = (GPIOB->MODER & ~(GPIO_MODER_MODE0)) | GPIO_MODER_MODE0_1;
-    GPIOB->MODER = (GPIOB->MODER & ~(GPIO_MODER_MODE1)) | GPIO_MODER_MODE1_1;
+static int _pwm_resolution;
+static uint8_t _deadtime_clocks;
+
+// number of calls of half_bridge_trip(), see half_bridge_tripped()
+static volatile unsigned int _trip_count;
+
+// compare values of CCR1 to CCR4 written by DMA burst at each update event
+static volatile uint16_t _ccr_sequence[DITHER_STEPS][NUM_CHANNELS];
+
+#if HALF_BRIDGE_DITHER_BITS > 0
+
+static void _init_dithering()
+{
+    // Enable the peripheral clock on DMA
+    RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+
+#if defined(STM32L0)
+    // DMA request mapping of channel 3: TIM3_UP
+    DMA1_CSELR->CSELR = (DMA1_CSELR->CSELR & ~DMA_CSELR_C3S) | (10 << DMA_CSELR_C3S_Pos);
 #endif
 
-#if defined(STM32F0)
-    // Select AF1 on PB0 and PB1
-    GPIOB->AFR[0] |= 0x1 << GPIO_AFRL_AFSEL0_Pos;
-    GPIOB->AFR[0] |= 0x1 << GPIO_AFRL_AFSEL1_Pos;
-#elif defined(STM32L0)
-    // Select AF2 on PB0 and PB1
-    GPIOB->AFR[0] |= 0x2 << GPIO_AFRL_AFRL0_Pos;
-    GPIOB->AFR[0] |= 0x2 << GPIO_AFRL_AFRL1_Pos;
+    // DMA Control Register
+    // DBL = 3: burst of 4 transfers, DBA = 13: starting at CCR1
+    TIM3->DCR = ((NUM_CHANNELS - 1) << TIM_DCR_DBL_Pos)
+        | ((&(TIM3->CCR1) - &(TIM3->CR1)) << TIM_DCR_DBA_Pos);
+
+    // DMA channel 3 (TIM3_UP) writes the sequence to CCR1 to CCR4 via DMAR
+    DMA1_Channel3->CPAR = (uint32_t)(&(TIM3->DMAR));
+    DMA1_Channel3->CMAR = (uint32_t)(&(_ccr_sequence[0][0]));
+    DMA1_Channel3->CNDTR = NUM_CHANNELS * DITHER_STEPS;
+    DMA1_Channel3->CCR =
+        DMA_CCR_MINC |          // memory increment mode enabled
+        DMA_CCR_MSIZE_0 |       // memory size 16-bit
+        DMA_CCR_PSIZE_0 |       // peripheral size 16-bit
+        DMA_CCR_DIR |           // read from memory
+        DMA_CCR_CIRC;           // circular mode enable
+    DMA1_Channel3->CCR |= DMA_CCR_EN;
+
+    // DMA/Interrupt Enable Register
+    // UDE = 1: Update DMA request enable
+    TIM3->DIER |= TIM_DIER_UDE;
+}
+
 #endif
 
-    // No prescaler --> timer frequency = 32/48 MHz (for L0/F0)
-    TIM3->PSC = 0;
+// register access of TIM3 (see HalfBridgeDriver for the description of the hooks)
+struct HalfBridgeTim3 : HalfBridgeDriver<HalfBridgeTim3>
+{
+    static int resolution()
+    {
+        return _pwm_resolution;
+    }
 
-    // Capture/Compare Mode Register 1
-    // OCxM = 110: Select PWM mode 1 on OCx
-    // OCxPE = 1:  Enable preload register on OCx (reset value)
-    TIM3->CCMR2 |= TIM_CCMR2_OC3M_2 | TIM_CCMR2_OC3M_1 | TIM_CCMR2_OC3PE;
-    TIM3->CCMR2 |= TIM_CCMR2_OC4M_2 | TIM_CCMR2_OC4M_1 | TIM_CCMR2_OC4PE;
+    static unsigned int trip_count()
+    {
+        return _trip_count;
+    }
 
-    // Capture/Compare Enable Register
-    // CCxP: Active high polarity on OCx (default = 0)
-    TIM3->CCER &= ~(TIM_CCER_CC3P);     // PB0 / TIM3_CH3: high-side
-    TIM3->CCER |= TIM_CCER_CC4P;        // PB1 / TIM3_CH4: low-side
+    // CCxE bits of high-side and low-side channel
+    static uint32_t ccer_hs(const half_bridge_t *hb)
+    {
+        return TIM_CCER_CC1E << ((hb->channel - 1) * 4);
+    }
 
-    // Control Register 1
-    // TIM_CR1_CMS = 01: Select center-aligned mode 1
-    // TIM_CR1_CEN =  1: Counter enable
-    TIM3->CR1 |= TIM_CR1_CMS_0 | TIM_CR1_CEN;
+    static uint32_t ccer_ls(const half_bridge_t *hb)
+    {
+        return TIM_CCER_CC1E << (hb->channel * 4);
+    }
 
-    // Control Register 2
-    // OIS1 = OIS1N = 0: Output Idle State is set to off
-    //TIM3->CR2 |= ;
+    // compare value of high-side or low-side output for the given high-side on-time
+    static int ccr_value(const half_bridge_t *hb, int on_clocks, bool low_side)
+    {
+        int ccr = low_side ? on_clocks + _deadtime_clocks : on_clocks;
+        if (hb->phase_shift) {
+            // PWM mode 2: on-time centered at the peak of the counter
+            ccr = _pwm_resolution / 2 - ccr;
+            return (ccr > 0) ? ccr : 0;
+        }
+        return ccr;
+    }
 
-    // Force update generation (UG = 1)
-    TIM3->EGR |= TIM_EGR_UG;
+    static void write_sequence(half_bridge_t *hb, int step, int on_clocks)
+    {
+        _ccr_sequence[step][hb->channel - 1] = ccr_value(hb, on_clocks, false);
+        _ccr_sequence[step][hb->channel] = ccr_value(hb, on_clocks, true);
+    }
 
-    // set PWM frequency and resolution
-    _pwm_resolution = SystemCoreClock / (freq_kHz * 1000);
+    static void write_compare(half_bridge_t *hb, int on_clocks)
+    {
+        (&(TIM3->CCR1))[hb->channel - 1] = ccr_value(hb, on_clocks, false);
+        (&(TIM3->CCR1))[hb->channel] = ccr_value(hb, on_clocks, true);
+    }
 
-    // Auto Reload Register
-    // center-aligned mode --> divide resolution by 2
-    TIM3->ARR = _pwm_resolution / 2;
-}
+    static void init_timer(int freq_kHz, int deadtime_ns)
+    {
+        if (TIM3->CR1 & TIM_CR1_CEN) {
+            return;     // already configured by another instance
+        }
 
-void half_bridge_init(int freq_kHz, int deadtime_ns, float min_duty, float max_duty)
-{
-    _init_registers(freq_kHz);
+        // Enable TIM3 clock
+        RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
 
-    _deadtime_clocks = (SystemCoreClock / 1000 / 1000) * deadtime_ns / 1000;
+        // No prescaler --> timer frequency = 32/48 MHz (for L0/F0)
+        TIM3->PSC = 0;
 
-    _min_duty = min_duty;
-    _max_duty = max_duty;
-    half_bridge_set_duty_cycle(_max_duty);      // init with allowed value
+        // Control Register 1
+        // TIM_CR1_CMS = 01: Select center-aligned mode 1
+        // TIM_CR1_CEN =  1: Counter enable
+        TIM3->CR1 |= TIM_CR1_CMS_0 | TIM_CR1_CEN;
 
-    _enabled = false;
-}
+        // Control Register 2
+        // OIS1 = OIS1N = 0: Output Idle State is set to off
+        //TIM3->CR2 |= ;
 
-void half_bridge_set_duty_cycle(float duty)
-{
-    float duty_target;
+        // Force update generation (UG = 1)
+        TIM3->EGR |= TIM_EGR_UG;
 
-    // protection against wrong settings which could destroy the hardware
-    if (duty < _min_duty) {
-        duty_target = _min_duty;
-    }
-    else if (duty > _max_duty) {
-        duty_target = _max_duty;
-    }
-    else {
-        duty_target = duty;
+        // set PWM frequency and resolution
+        _pwm_resolution = SystemCoreClock / (freq_kHz * 1000);
+
+        // Auto Reload Register
+        // center-aligned mode --> divide resolution by 2
+        TIM3->ARR = _pwm_resolution / 2;
+
+        _deadtime_clocks = (SystemCoreClock / 1000 / 1000) * deadtime_ns / 1000;
+
+#if HALF_BRIDGE_DITHER_BITS > 0
+        // TIM3 has no repetition counter, so the sequence advances twice per switching period
+        _init_dithering();
+#endif
     }
 
-    TIM3->CCR3 = _pwm_resolution / 2 * duty_target; // high-side
-    TIM3->CCR4 = _pwm_resolution / 2 * duty_target + _deadtime_clocks; // low-side
-}
+    static void init_channel(int channel)
+    {
+        if (channel != 1 && channel != 3) {
+            error("Invalid half bridge channel");
+        }
 
-void half_bridge_duty_cycle_step(int delta)
-{
-    float duty_target;
-    duty_target = (float)(TIM3->CCR3 + delta) / (_pwm_resolution / 2);
+        GPIO_TypeDef *port = _pins[channel / 2].port;
+        int pin_hs = _pins[channel / 2].pin_hs;
+        int pin_ls = _pins[channel / 2].pin_ls;
 
-    half_bridge_set_duty_cycle(duty_target);
-}
+        // Enable peripheral clock of GPIOA and GPIOB
+#if defined(STM32F0)
+        RCC->AHBENR |= RCC_AHBENR_GPIOAEN | RCC_AHBENR_GPIOBEN;
+#elif defined(STM32L0)
+        RCC->IOPENR |= RCC_IOPENR_IOPAEN | RCC_IOPENR_IOPBEN;
+#endif
 
-float half_bridge_get_duty_cycle() {
-    return (float)(TIM3->CCR3) / (_pwm_resolution / 2);;
-}
+        // Select alternate function mode on high-side and low-side pins
+        port->MODER = (port->MODER & ~(0x3U << (pin_hs * 2))) | (0x2U << (pin_hs * 2));
+        port->MODER = (port->MODER & ~(0x3U << (pin_ls * 2))) | (0x2U << (pin_ls * 2));
+
+        // Select AF1 (F0) or AF2 (L0)
+        port->AFR[0] |= GPIO_AF_TIM3 << (pin_hs * 4);
+        port->AFR[0] |= GPIO_AF_TIM3 << (pin_ls * 4);
+
+        // Capture/Compare Mode Register 1 (CH1, CH2) or 2 (CH3, CH4)
+        // OCxM = 110: Select PWM mode 1 on OCx
+        // OCxPE = 1:  Enable preload register on OCx (reset value)
+        uint32_t ccmr = (TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1 | TIM_CCMR1_OC1PE)
+            | (TIM_CCMR1_OC2M_2 | TIM_CCMR1_OC2M_1 | TIM_CCMR1_OC2PE);
+        if (channel == 1) {
+            TIM3->CCMR1 |= ccmr;
+        }
+        else {
+            TIM3->CCMR2 |= ccmr;
+        }
+
+        // Capture/Compare Enable Register
+        // CCxP: Active high polarity on OCx (default = 0)
+        TIM3->CCER &= ~(TIM_CCER_CC1P << ((channel - 1) * 4));     // high-side
+        TIM3->CCER |= TIM_CCER_CC1P << (channel * 4);               // low-side
+    }
 
-void half_bridge_start(float pwm_duty)
-{
-    half_bridge_set_duty_cycle(pwm_duty);
+    static void lock()
+    {
+        // TIM3 has no lock function
+    }
 
+    static void set_outputs(half_bridge_t *hb, bool hs, bool ls)
+    {
+        // Capture/Compare Enable Register
+        // CCxE = 1: Enable the output on OCx
+        TIM3->CCER &= ~(ccer_hs(hb) | ccer_ls(hb));
 #ifndef PIL_TESTING
-    // Capture/Compare Enable Register
-    // CCxE = 1: Enable the output on OCx
-    // CCxP = 0: Active high polarity on OCx (default)
-    // CCxNE = 1: Enable the output on OC1N
-    // CCxNP = 0: Active high polarity on OC1N (default)
-    TIM3->CCER |= TIM_CCER_CC3E;
-    TIM3->CCER |= TIM_CCER_CC4E;
+        TIM3->CCER |= (hs ? ccer_hs(hb) : 0) | (ls ? ccer_ls(hb) : 0);
 #endif
+    }
 
-    _enabled = true;
-}
+    static void set_pwm_mode2(half_bridge_t *hb, bool mode2)
+    {
+        // Capture/Compare Mode Register 1 (CH1, CH2) or 2 (CH3, CH4)
+        // OCxM = 111: PWM mode 2 (active while counter is above CCR, i.e. centered at its peak)
+        // OCxM = 110: PWM mode 1
+        uint32_t bits = TIM_CCMR1_OC1M_0 | TIM_CCMR1_OC2M_0;
+        volatile uint32_t *ccmr = (hb->channel == 1) ? &(TIM3->CCMR1) : &(TIM3->CCMR2);
+        if (mode2) {
+            *ccmr |= bits;
+        }
+        else {
+            *ccmr &= ~bits;
+        }
+    }
+};
 
-void half_bridge_stop()
+void half_bridge_trip()
 {
-    TIM3->CCER &= ~(TIM_CCER_CC3E);
-    TIM3->CCER &= ~(TIM_CCER_CC4E);
+    // no break function in TIM3: outputs of all channels disabled as in half_bridge_stop()
+    TIM3->CCER &= ~(TIM_CCER_CC1E | TIM_CCER_CC2E | TIM_CCER_CC3E | TIM_CCER_CC4E);
 
-    _enabled = false;
+    _trip_count++;
 }
 
-bool half_bridge_enabled()
+int half_bridge_get_period_clocks()
 {
-    return _enabled;
+    // center-aligned mode --> counting up and down
+    return 2 * TIM3->ARR;
 }
 
+int half_bridge_get_phase_clocks()
+{
+    // PWM mode 1 in center-aligned mode: high-side is on while counter is below CCR
+    if (TIM3->CR1 & TIM_CR1_DIR) {
+        return 2 * TIM3->ARR - TIM3->CNT;    // counting down
+    }
+    else {
+        return TIM3->CNT;                    // counting up
+    }
+}
+
+HALF_BRIDGE_DEFINE_API(HalfBridgeTim3)
+
 #endif /* PWM_TIM */
 
 #endif /* UNIT_TEST */
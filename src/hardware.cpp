@@ -197,7 +197,7 @@ void init_watchdog(float timeout) {
 // this function is called by mbed if a serious error occured: error() function called
 void mbed_die(void)
 {
-    half_bridge_stop();
+    half_bridge_trip();     // outputs of all half bridges off
     hw_load_switch(false);
     hw_usb_out(false);
 
@@ -23,6 +23,15 @@
  * Hardware-specific functions like timers, output switches, bootloader
  */
 
+#include <time.h>
+
+/** Seconds since start-up, counted by the control timer (see system_control)
+ *
+ * Used for internal timing instead of time(NULL), which is based on the inaccurate LSI, and
+ * instead of the timestamp, which can be changed by the user. Simulations can set it directly.
+ */
+extern time_t uptime;
+
 /** Enable/disable load switch
  */
 void hw_load_switch(bool enabled);
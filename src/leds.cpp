@@ -18,6 +18,7 @@
 
 #include "leds.h"
 #include "pcb.h"
+#include "hardware.h"
 
 #include "mbed.h"
 
@@ -166,7 +167,7 @@ void leds_set_load(bool enabled)
 void leds_update_rxtx()
 {
 #ifdef LED_RXTX
-    if (time(NULL) >= rxtx_trigger_timestamp + 2) {
+    if (uptime >= rxtx_trigger_timestamp + 2) {
         led_states[LED_RXTX] = false;
         tx_flag = false;
         rx_flag = false;
@@ -186,14 +187,14 @@ void leds_trigger_rx()
 {
     rx_flag = true;
     tx_flag = false;
-    rxtx_trigger_timestamp = time(NULL);
+    rxtx_trigger_timestamp = uptime;
 }
 
 void leds_trigger_tx()
 {
     rx_flag = false;
     tx_flag = true;
-    rxtx_trigger_timestamp = time(NULL);
+    rxtx_trigger_timestamp = uptime;
 }
 
 void leds_toggle_blink()
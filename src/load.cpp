@@ -18,7 +18,6 @@
 #include "pcb.h"
 #include "hardware.h"
 #include "log.h"
-#include <time.h>
 
 void load_init(load_output_t *load)
 {
@@ -114,7 +113,7 @@ void load_state_machine(load_output_t *load, bool source_enabled)
         }
         break;
     case LOAD_STATE_OFF_OVERCURRENT:
-        if (time(NULL) > load->overcurrent_timestamp + 30*60) {         // wait 5 min (TODO: make configurable)
+        if (uptime > load->overcurrent_timestamp + 30*60) {         // wait 5 min (TODO: make configurable)
             load->switch_state = LOAD_STATE_DISABLED;   // switch to normal mode again
         }
         break;
@@ -145,7 +144,7 @@ void load_control(load_output_t *load)
         hw_usb_out(false);
         load->enabled = false;
         load->switch_state = LOAD_STATE_OFF_OVERCURRENT;
-        load->overcurrent_timestamp = time(NULL);
+        load->overcurrent_timestamp = uptime;
     }
 
     static int debounce_counter = 0;
@@ -156,7 +155,7 @@ void load_control(load_output_t *load)
             hw_usb_out(false);
             load->enabled = false;
             load->switch_state = LOAD_STATE_OFF_OVERVOLTAGE;
-            load->overcurrent_timestamp = time(NULL);
+            load->overcurrent_timestamp = uptime;
             log_data.error_flags |= (1 << ERR_BAT_OVERVOLTAGE);
         }
     }
@@ -0,0 +1,79 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "log.h"
+
+void log_update_statistics(log_data_t *log, const log_snapshot_t *meas, uint32_t timestamp)
+{
+    if (meas->battery_voltage > log->battery_voltage_max) {
+        log->battery_voltage_max = meas->battery_voltage;
+        log->battery_voltage_max_time = timestamp;
+    }
+
+    if (meas->solar_voltage > log->solar_voltage_max) {
+        log->solar_voltage_max = meas->solar_voltage;
+        log->solar_voltage_max_time = timestamp;
+    }
+
+    if (meas->dcdc_current > log->dcdc_current_max) {
+        log->dcdc_current_max = meas->dcdc_current;
+        log->dcdc_current_max_time = timestamp;
+    }
+
+    if (meas->load_current > log->load_current_max) {
+        log->load_current_max = meas->load_current;
+        log->load_current_max_time = timestamp;
+    }
+
+    if (meas->dcdc_current > 0) {
+        uint16_t solar_power = meas->battery_voltage * meas->dcdc_current;
+        if (solar_power > log->solar_power_max_day) {
+            log->solar_power_max_day = solar_power;
+            log->solar_power_max_day_time = timestamp;
+            if (log->solar_power_max_day > log->solar_power_max_total) {
+                log->solar_power_max_total = log->solar_power_max_day;
+                log->solar_power_max_total_time = timestamp;
+            }
+        }
+    }
+
+    if (meas->load_current > 0) {
+        uint16_t load_power = meas->battery_voltage * meas->load_current;
+        if (load_power > log->load_power_max_day) {
+            log->load_power_max_day = load_power;
+            log->load_power_max_day_time = timestamp;
+            if (log->load_power_max_day > log->load_power_max_total) {
+                log->load_power_max_total = log->load_power_max_day;
+                log->load_power_max_total_time = timestamp;
+            }
+        }
+    }
+
+    if (meas->mosfet_temp > log->mosfet_temp_max) {
+        log->mosfet_temp_max = meas->mosfet_temp;
+        log->mosfet_temp_max_time = timestamp;
+    }
+
+    if (meas->bat_temp > log->bat_temp_max) {
+        log->bat_temp_max = meas->bat_temp;
+        log->bat_temp_max_time = timestamp;
+    }
+
+    if (meas->int_temp > log->int_temp_max) {
+        log->int_temp_max = meas->int_temp;
+        log->int_temp_max_time = timestamp;
+    }
+}
@@ -32,6 +32,7 @@ enum error_flag_t {
     ERR_HS_MOSFET_SHORT = 0,        ///< Short-circuit in HS MOSFET
     ERR_BAT_OVERVOLTAGE,
     ERR_BAT_UNDERVOLTAGE,
+    ERR_DCDC_OVERCURRENT,           ///< DC/DC switched off by fast overcurrent trip
 };
 
 /** Log Data
@@ -57,7 +58,48 @@ typedef struct {
     int int_temp_max;         // °C
     int mosfet_temp_max;
     int day_counter;
+    uint32_t dcdc_trip_count;   ///< Number of fast overcurrent trips of the DC/DC
     uint32_t error_flags;       ///< Instantaneous errors
+
+    // timestamps (s) when the above maximum values were recorded
+    uint32_t solar_power_max_day_time;
+    uint32_t load_power_max_day_time;
+    uint32_t solar_power_max_total_time;
+    uint32_t load_power_max_total_time;
+    uint32_t battery_voltage_max_time;
+    uint32_t solar_voltage_max_time;
+    uint32_t dcdc_current_max_time;
+    uint32_t load_current_max_time;
+    uint32_t bat_temp_max_time;
+    uint32_t int_temp_max_time;
+    uint32_t mosfet_temp_max_time;
 } log_data_t;
 
+/** Measurement snapshot
+ *
+ * Copy of the measurement values relevant for statistics, taken at one point in time
+ */
+typedef struct {
+    float battery_voltage;      ///< Voltage of the battery port (V)
+    float solar_voltage;        ///< Voltage of the solar port (V)
+    float dcdc_current;         ///< Current into the battery port (A)
+    float load_current;         ///< Load output current (A)
+    float bat_temp;             ///< Battery temperature (°C)
+    float int_temp;             ///< Internal (MCU) temperature (°C)
+    float mosfet_temp;          ///< MOSFET temperature (°C)
+} log_snapshot_t;
+
+/** Updates min/max values and daily records based on a measurement snapshot
+ *
+ * Daily maximum values are reset together with the daily energy counters in the morning.
+ *
+ * This function is not time critical and should be called from the main loop, e.g. once per
+ * second.
+ *
+ * @param log Log data to be updated
+ * @param meas Measurement snapshot
+ * @param timestamp Current timestamp (s), stored with each new maximum value
+ */
+void log_update_statistics(log_data_t *log, const log_snapshot_t *meas, uint32_t timestamp);
+
 #endif /* LOG_H */
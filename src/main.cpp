@@ -34,12 +34,19 @@
 #include "load.h"               // load and USB output management
 #include "leds.h"               // LED switching using charlieplexing
 #include "log.h"                // log data (error memory, min/max measurements, etc.)
+#include "meas_snapshot.h"      // consistent measurements for main loop
 #include "data_objects.h"       // for access to internal data via ThingSet
 #include "thingset_serial.h"    // UART or USB serial communication
 
 Serial serial(PIN_SWD_TX, PIN_SWD_RX, "serial");
 
-dcdc_t dcdc = {};
+// update_measurements() and the MPPT only consider the first converter, further stages would
+// be controlled blindly with the measurements of the first one
+#if DCDC_NUM_CONVERTERS != 1
+#error "Multiple DC/DC converters require measurement of each power stage"
+#endif
+
+dcdc_t dcdc[DCDC_NUM_CONVERTERS] = {};  // first converter connected to measurements and ThingSet
 power_port_t hs_port = {};       // high-side (solar for typical MPPT)
 power_port_t ls_port = {};       // low-side (battery for typical MPPT)
 power_port_t *bat_port = NULL;
@@ -49,9 +56,13 @@ battery_conf_t bat_conf_user;   // temporary storage where the user can write to
 battery_state_t bat_state;      // battery state information
 load_output_t load;
 log_data_t log_data;
+meas_snapshot_t meas;           // copy of the latest measurements for use in main loop
 extern ThingSet ts;             // defined in data_objects.cpp
 
 time_t timestamp;    // current unix timestamp (independent of time(NULL), as it is user-configurable)
+time_t uptime;       // seconds since start-up for internal timing (see hardware.h)
+
+extern float mcu_temp;
 
 /** High priority function for DC/DC control and safety functions
  *
@@ -62,16 +73,26 @@ void system_control()
     static int counter = 0;
 
     // convert ADC readings to meaningful measurement values
-    update_measurements(&dcdc, &bat_state, &load, &hs_port, &ls_port);
+    update_measurements(&dcdc[0], &bat_state, &load, &hs_port, &ls_port);
 
 #ifdef CHARGER_TYPE_PWM
     pwm_switch_control(&pwm_switch, &hs_port, bat_port);
     leds_set_charging(pwm_switch_enabled());
 #else
+    // thresholds of the fast overcurrent trip follow supply voltage and sensor offset (each
+    // phase carries half of the current if interleaved)
+    float trip_current = dcdc[0].interleaved ? dcdc[0].ls_current_trip / 2 : dcdc[0].ls_current_trip;
+    adc_set_dcdc_trip(dcdc_current_raw(-trip_current * 1000), dcdc_current_raw(trip_current * 1000));
+#ifdef PWM_CHANNEL_PHASE2
+    adc_set_phase2_trip(phase2_current_raw(-trip_current * 1000), phase2_current_raw(trip_current * 1000));
+#endif
+
     // control PWM of the DC/DC according to hs and ls port settings
     // (this function includes MPPT algorithm)
-    dcdc_control(&dcdc, &hs_port, &ls_port);
-    leds_set_charging(half_bridge_enabled());
+    for (int i = 0; i < DCDC_NUM_CONVERTERS; i++) {
+        dcdc_control(&dcdc[i], &hs_port, &ls_port);
+    }
+    leds_set_charging(half_bridge_enabled(&dcdc[0].half_bridge));
 #endif
 
     load_control(&load);
@@ -80,12 +101,37 @@ void system_control()
         // called once per second (this timer is much more accurate than time(NULL) based on LSI)
         // see also here: https://github.com/ARMmbed/mbed-os/issues/9065
         timestamp++;
+        uptime++;
         counter = 0;
         // energy + soc calculation must be called exactly once per second
-        battery_update_energy(&bat_state, bat_port->voltage, bat_port->current, dcdc.ls_current, load.current);
+        battery_update_energy(&bat_state, bat_port->voltage, bat_port->current, dcdc[0].ls_current, load.current);
         battery_update_soc(&bat_conf, &bat_state, bat_port->voltage, bat_port->current);
     }
     counter++;
+
+    // publish all values of this control cycle at once for the main loop
+    meas_snapshot_t snap;
+    snap.hs_voltage = hs_port.voltage;
+    snap.ls_voltage = ls_port.voltage;
+    snap.hs_current = hs_port.current;
+    snap.ls_current = ls_port.current;
+    snap.bat_voltage = bat_port->voltage;
+    snap.bat_current = bat_port->current;
+    snap.dcdc_current = dcdc[0].ls_current;
+    snap.load_current = load.current;
+    snap.bat_temp = bat_state.temperature;
+    snap.mcu_temp = mcu_temp;
+    snap.mosfet_temp = dcdc[0].temp_mosfets;
+    snap.bat_chg_day_Wh = bat_state.chg_day_Wh;
+    snap.bat_dis_day_Wh = bat_state.dis_day_Wh;
+    snap.discharged_Ah = bat_state.discharged_Ah;
+    snap.sweep_duration = dcdc[0].sweep.duration;
+    snap.sweep_energy_lost = dcdc[0].sweep.energy_lost;
+    snap.dcdc_state = dcdc[0].state;
+    snap.load_state = load.switch_state;
+    snap.soc = bat_state.soc;
+    snap.ls_input_allowed = ls_port.input_allowed;
+    meas_snapshot_publish(&snap);
 }
 
 /** Main function including initialization and continuous loop
@@ -105,8 +151,18 @@ int main()
 #ifdef CHARGER_TYPE_PWM
     pwm_switch_init(&pwm_switch);
 #else // MPPT
-    dcdc_init(&dcdc);
-    half_bridge_init(PWM_FREQUENCY, 300, 12 / dcdc.hs_voltage_max, 0.97);       // lower duty limit might have to be adjusted dynamically depending on LS voltage
+    const int pwm_channels[DCDC_NUM_CONVERTERS] = PWM_CHANNELS;
+    for (int i = 0; i < DCDC_NUM_CONVERTERS; i++) {
+        dcdc_init(&dcdc[i]);
+        half_bridge_init(&dcdc[i].half_bridge, pwm_channels[i], PWM_FREQUENCY, 300,
+            12 / dcdc[i].hs_voltage_max, 0.97);     // lower duty limit might have to be adjusted dynamically depending on LS voltage
+    }
+#ifdef PWM_CHANNEL_PHASE2
+    // second phase of the first converter, switching with 180° phase shift
+    half_bridge_init(&dcdc[0].half_bridge_2, PWM_CHANNEL_PHASE2, PWM_FREQUENCY, 300,
+        half_bridge_get_min_duty(&dcdc[0].half_bridge), half_bridge_get_max_duty(&dcdc[0].half_bridge));
+    dcdc_init_interleaved(&dcdc[0]);
+#endif
 #endif
 
     // Configuration from EEPROM
@@ -118,8 +174,8 @@ int main()
     dma_setup();
     adc_timer_start(1000);  // 1 kHz
     wait(0.5);      // wait for ADC to collect some measurement values
-    update_measurements(&dcdc, &bat_state, &load, &hs_port, &ls_port);
-    calibrate_current_sensors(&dcdc, &load);
+    update_measurements(&dcdc[0], &bat_state, &load, &hs_port, &ls_port);
+    calibrate_current_sensors();
 
     // Communication interfaces
     uart_serial_init(&serial);
@@ -128,7 +184,7 @@ int main()
     init_watchdog(10);      // 10s should be enough for communication ports
 
     // Setup of DC/DC power stage
-    switch(dcdc.mode) {
+    switch(dcdc[0].mode) {
         case MODE_NANOGRID:
             power_port_init_nanogrid(&hs_port);
             power_port_init_bat(&ls_port, &bat_conf);
@@ -153,6 +209,9 @@ int main()
     time_t last_call = timestamp;
     while (1) {
 
+        // all readers in the main loop use the same control cycle
+        meas_snapshot_read(&meas);
+
         thingset_serial_process_asap();
         uext_process_asap();
 
@@ -161,11 +220,21 @@ int main()
         time_t now = timestamp;
         if (now >= last_call + 1 || now < last_call) {   // called once per second (or slower if blocking wait occured somewhere)
 
-            //printf("Still alive... time: %d, mode: %d\n", (int)time(NULL), dcdc.mode);
+            //printf("Still alive... time: %d, mode: %d\n", (int)time(NULL), dcdc[0].mode);
+
+            log_snapshot_t snapshot;
+            snapshot.battery_voltage = meas.ls_voltage;
+            snapshot.solar_voltage = meas.hs_voltage;
+            snapshot.dcdc_current = meas.ls_current;
+            snapshot.load_current = meas.load_current;
+            snapshot.bat_temp = meas.bat_temp;
+            snapshot.int_temp = meas.mcu_temp;
+            snapshot.mosfet_temp = meas.mosfet_temp;
+            log_update_statistics(&log_data, &snapshot, now);
 
-            charger_state_machine(bat_port, &bat_conf, &bat_state, bat_port->voltage, bat_port->current);
+            charger_state_machine(bat_port, &bat_conf, &bat_state, meas.bat_voltage, meas.bat_current);
 
-            load_state_machine(&load, ls_port.input_allowed);
+            load_state_machine(&load, meas.ls_input_allowed);
 
             eeprom_update();
 
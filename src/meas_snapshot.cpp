@@ -0,0 +1,46 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "meas_snapshot.h"
+
+// prevents the compiler from reordering memory accesses (sufficient for single-core MCU)
+#define COMPILER_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+// latest snapshot is stored in buffers[seq & 1], the other one is written next
+static meas_snapshot_t buffers[2];
+static volatile uint32_t seq;
+
+void meas_snapshot_publish(const meas_snapshot_t *snap)
+{
+    uint32_t next = seq + 1;
+    buffers[next & 1] = *snap;
+    COMPILER_BARRIER();
+    seq = next;
+}
+
+uint32_t meas_snapshot_read(meas_snapshot_t *snap)
+{
+    uint32_t start;
+    do {
+        start = seq;
+        COMPILER_BARRIER();
+        *snap = buffers[start & 1];
+        COMPILER_BARRIER();
+        // one new snapshot written to the other buffer does not matter, the second one
+        // would overwrite the buffer currently being copied
+    } while (seq - start > 1);
+    return start;
+}
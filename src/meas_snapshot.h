@@ -0,0 +1,78 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MEAS_SNAPSHOT_H
+#define MEAS_SNAPSHOT_H
+
+/** @file
+ *
+ * @brief Consistent snapshot of measurements between control ISR and main loop
+ *
+ * The control function writes the measurements piecewise into several structs while
+ * running in the timer interrupt. At the end of each control cycle, a snapshot of all
+ * values is published into a double buffer. The main loop (communication, log, charger
+ * state machine) reads the entire snapshot at once without disabling interrupts.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Measurement snapshot of one control cycle
+ */
+typedef struct {
+    float hs_voltage;           ///< High-side port voltage (V)
+    float ls_voltage;           ///< Low-side port voltage (V)
+    float hs_current;           ///< High-side port current (A)
+    float ls_current;           ///< Low-side port current (A)
+    float bat_voltage;          ///< Battery port voltage (V)
+    float bat_current;          ///< Battery port current (A)
+    float dcdc_current;         ///< Low-side (inductor) current of DC/DC (A)
+    float load_current;         ///< Load output current (A)
+    float bat_temp;             ///< Battery temperature (°C)
+    float mcu_temp;             ///< Internal (MCU) temperature (°C)
+    float mosfet_temp;          ///< MOSFET temperature (°C)
+    float bat_chg_day_Wh;       ///< Battery charged energy of the current day (Wh)
+    float bat_dis_day_Wh;       ///< Battery discharged energy of the current day (Wh)
+    float discharged_Ah;        ///< Coulomb counter of the battery (Ah)
+    float sweep_duration;       ///< Duration of the last global MPP sweep (s)
+    float sweep_energy_lost;    ///< Energy lost during the last global MPP sweep (Ws)
+    uint16_t dcdc_state;        ///< DC/DC control state
+    uint16_t load_state;        ///< Load switch state
+    uint16_t soc;               ///< Battery state of charge (%)
+    bool ls_input_allowed;      ///< Discharging of the low-side port (battery) allowed
+} meas_snapshot_t;
+
+/** Publishes a new snapshot
+ *
+ * Must only be called from the control function (single writer). The previous snapshot
+ * stays untouched, so a reader in the main loop is only disturbed if two new snapshots are
+ * published while it is copying.
+ *
+ * @param snap Measurements of the current control cycle
+ */
+void meas_snapshot_publish(const meas_snapshot_t *snap);
+
+/** Reads the latest published snapshot
+ *
+ * Copying is repeated if the snapshot was overwritten in the meantime.
+ *
+ * @param snap Struct to store the copy of the snapshot
+ *
+ * @returns Number of published snapshots so far (can be used to detect new data)
+ */
+uint32_t meas_snapshot_read(meas_snapshot_t *snap);
+
+#endif /* MEAS_SNAPSHOT_H */
@@ -0,0 +1,252 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "config.h"
+
+// processor-in-the-loop tests use simulated measurements instead (see adc_dma_pil.cpp)
+#ifndef PIL_TESTING
+
+#include "measurements.h"
+#include "adc_dma.h"        // detect_battery_temperature
+#include "adc_conv.h"
+#include "adc_filter.h"
+#include "pcb.h"
+#include "half_bridge.h"
+#include "pwm_switch.h"
+#include <math.h>       // log for thermistor calculation (if NTC_BETA_FORMULA defined)
+
+// factory calibration values for internal voltage reference and temperature sensor (see MCU datasheet, not RM)
+#if defined(UNIT_TEST)
+    // typical values of STM32L0 for replay of recorded ADC frames on the host
+    const uint16_t VREFINT_CAL = 1656;
+    #define VREFINT_VALUE 3000 // mV
+    const uint16_t TSENSE_CAL1 = 915;
+    const uint16_t TSENSE_CAL2 = 1135;
+    #define TSENSE_CAL1_VALUE 30     // temperature of first calibration point
+    #define TSENSE_CAL2_VALUE 130    // temperature of second calibration point
+#elif defined(STM32F0)
+    const uint16_t VREFINT_CAL = *((uint16_t *)0x1FFFF7BA); // VREFINT @3.3V/30°C
+    #define VREFINT_VALUE 3300 // mV
+    const uint16_t TSENSE_CAL1 = *((uint16_t *)0x1FFFF7B8);
+    const uint16_t TSENSE_CAL2 = *((uint16_t *)0x1FFFF7C2);
+    #define TSENSE_CAL1_VALUE 30     // temperature of first calibration point
+    #define TSENSE_CAL2_VALUE 110    // temperature of second calibration point
+#elif defined(STM32L0)
+    const uint16_t VREFINT_CAL = *((uint16_t *)0x1FF80078);   // VREFINT @3.0V/25°C
+    #define VREFINT_VALUE 3000 // mV
+    const uint16_t TSENSE_CAL1 = *((uint16_t *)0x1FF8007A);
+    const uint16_t TSENSE_CAL2 = *((uint16_t *)0x1FF8007E);
+    #define TSENSE_CAL1_VALUE 30     // temperature of first calibration point
+    #define TSENSE_CAL2_VALUE 130    // temperature of second calibration point
+#endif
+
+// zero-current offsets of current sensors
+static adc_auto_zero_t dcdc_auto_zero;
+static adc_auto_zero_t load_auto_zero;
+#ifdef PWM_CHANNEL_PHASE2
+static adc_auto_zero_t phase2_auto_zero;
+#endif
+
+// currents without offset correction of last update_measurements() call (mA)
+static int32_t dcdc_current_uncal;
+static int32_t load_current_uncal;
+#ifdef PWM_CHANNEL_PHASE2
+static int32_t phase2_current_uncal;
+#endif
+
+#define NUM_ADC_CONV_CHANNELS (sizeof(adc_channels) / sizeof(adc_channels[0]))
+
+// values of last update_measurements() call used for the fast measurements
+static adc_conv_scale_t adc_scales[NUM_ADC_CONV_CHANNELS];
+static int32_t dcdc_current_offset;
+static int32_t load_current_offset;
+#ifdef PWM_CHANNEL_PHASE2
+static int32_t phase2_current_offset;
+#endif
+
+// NTC lookup tables (generated at compile time)
+#if defined(PIN_ADC_TEMP_BAT) && !defined(NTC_BETA_FORMULA)
+static const int16_t *ntc_lut_bat = ntc_lut<(int)NTC_SERIES_RESISTOR, NTC_BETA_VALUE>::values;
+#endif
+#if defined(PIN_ADC_TEMP_FETS) && !defined(NTC_BETA_FORMULA)
+static const int16_t *ntc_lut_fets = ntc_lut<10000, NTC_BETA_VALUE>::values;
+#endif
+
+extern float mcu_temp;
+
+void calibrate_current_sensors()
+{
+    adc_auto_zero_init(&dcdc_auto_zero, dcdc_current_uncal);
+    adc_auto_zero_init(&load_auto_zero, load_current_uncal);
+#ifdef PWM_CHANNEL_PHASE2
+    adc_auto_zero_init(&phase2_auto_zero, phase2_current_uncal);
+#endif
+}
+
+//----------------------------------------------------------------------------
+void update_measurements(dcdc_t *dcdc, battery_state_t *bat, load_output_t *load, power_port_t *hs, power_port_t *ls)
+{
+    // raw readings of all channels with ADC_CONV_BITS resolution
+    uint32_t raw[NUM_ADC_CH];
+    for (unsigned int i = 0; i < NUM_ADC_CH; i++) {
+        raw[i] = adc_filter_get(i);
+    }
+
+    // reference voltage of 2.5 V at PIN_V_REF
+    //int vcc = 2500 * 4096 / (adc_filtered[ADC_POS_V_REF] >> (4 + adc_filter_const[ADC_POS_V_REF]));
+
+    // internal STM reference voltage
+    int32_t vcc = adc_conv_vcc(raw[ADC_POS_VREF_MCU], VREFINT_CAL, VREFINT_VALUE);
+
+    // rely on LDO accuracy
+    //int32_t vcc = 3300;
+
+    // conversion of all linear channels as defined in PCB header
+    adc_conv_scales(adc_channels, vcc, adc_scales);
+    int32_t meas[NUM_ADC_MEAS];
+    adc_conv_channels(adc_channels, adc_scales, raw, meas);
+
+    int32_t v_bat = meas[ADC_MEAS_V_BAT];
+    int32_t v_solar = meas[ADC_MEAS_V_SOLAR];
+
+    // zero-current offsets are continuously adjusted while no current can flow
+#ifdef CHARGER_TYPE_PWM
+    bool no_current = (pwm_switch_enabled() == false && load->enabled == false);
+#else
+    // (all phases of the DC/DC must be off, otherwise their current is absorbed into the offsets)
+    bool no_current = (half_bridge_enabled(&dcdc->half_bridge) == false
+        && (dcdc->interleaved == false || half_bridge_enabled(&dcdc->half_bridge_2) == false)
+        && load->enabled == false);
+#endif
+    load_current_uncal = meas[ADC_MEAS_I_LOAD];
+    dcdc_current_uncal = meas[ADC_MEAS_I_DCDC];
+    load_current_offset = adc_auto_zero_update(&load_auto_zero, load_current_uncal, no_current);
+    dcdc_current_offset = adc_auto_zero_update(&dcdc_auto_zero, dcdc_current_uncal, no_current);
+    int32_t i_load = load_current_uncal + load_current_offset;
+    int32_t i_dcdc = dcdc_current_uncal + dcdc_current_offset;
+#ifdef PWM_CHANNEL_PHASE2
+    // total current of both interleaved phases
+    phase2_current_uncal = meas[ADC_MEAS_I_PHASE2];
+    phase2_current_offset = adc_auto_zero_update(&phase2_auto_zero, phase2_current_uncal,
+        no_current);
+    i_dcdc += phase2_current_uncal + phase2_current_offset;
+#endif
+
+    ls->voltage = v_bat * 0.001f;
+    load->voltage = ls->voltage;
+    hs->voltage = v_solar * 0.001f;
+    load->current = i_load * 0.001f;
+
+    dcdc->ls_current = i_dcdc * 0.001f;
+#ifdef CHARGER_TYPE_PWM
+    // average over switching period already calculated in DMA interrupt, the current of the
+    // PWM switch is used as DC/DC current (e.g. for the solar energy counter)
+    hs->current = dcdc->ls_current;
+#else // MPPT
+    hs->current = (v_solar > 0) ? -((int64_t)i_dcdc * v_bat / v_solar) * 0.001f : 0;
+#endif
+    ls->current = (i_dcdc - i_load) * 0.001f;
+
+    float bat_temp = 25.0;
+
+#ifdef PIN_ADC_TEMP_BAT
+    // battery temperature calculation
+#ifdef NTC_BETA_FORMULA
+    float v_temp = adc_conv_value(raw[ADC_POS_TEMP_BAT], vcc);  // voltage read by ADC (mV)
+    float rts = NTC_SERIES_RESISTOR * v_temp / (vcc - v_temp); // resistance of NTC (Ohm)
+
+    // Temperature calculation using Beta equation for 10k thermistor
+    // (25°C reference temperature for Beta equation assumed)
+    bat_temp = 1.0/(1.0/(273.15+25) + 1.0/NTC_BETA_VALUE*log(rts/10000.0)) - 273.15; // °C
+#else
+    bat_temp = adc_conv_ntc_temp(ntc_lut_bat, raw[ADC_POS_TEMP_BAT]) * 0.01f;
+#endif
+#endif
+
+    detect_battery_temperature(bat, bat_temp);
+
+#ifdef PIN_ADC_TEMP_FETS
+    // MOSFET temperature calculation
+#ifdef NTC_BETA_FORMULA
+    float v_fets = adc_conv_value(raw[ADC_POS_TEMP_FETS], vcc);  // voltage read by ADC (mV)
+    float rts_fets = 10000 * v_fets / (vcc - v_fets); // resistance of NTC (Ohm)
+    dcdc->temp_mosfets = 1.0/(1.0/(273.15+25) + 1.0/NTC_BETA_VALUE*log(rts_fets/10000.0)) - 273.15; // °C
+#else
+    dcdc->temp_mosfets = adc_conv_ntc_temp(ntc_lut_fets, raw[ADC_POS_TEMP_FETS]) * 0.01f;
+#endif
+#endif
+
+    // internal MCU temperature (integer calculation in 0.01°C)
+    int32_t adcval = (raw[ADC_POS_TEMP_MCU] >> (ADC_CONV_BITS - 12)) * vcc / VREFINT_VALUE;
+    mcu_temp = ((TSENSE_CAL2_VALUE - TSENSE_CAL1_VALUE) * 100 * (adcval - TSENSE_CAL1) / (TSENSE_CAL2 - TSENSE_CAL1)
+        + TSENSE_CAL1_VALUE * 100) * 0.01f;
+    //printf("TS_CAL1:%d TS_CAL2:%d ADC:%d, temp_int:%f\n", TS_CAL1, TS_CAL2, adcval, meas->temp_int);
+}
+
+void update_fast_measurements(dcdc_fast_meas_t *meas)
+{
+    uint32_t raw[NUM_ADC_CH];
+    for (unsigned int i = 0; i < NUM_ADC_CH; i++) {
+        raw[i] = adc_filter_get(i);
+    }
+
+    int32_t values[NUM_ADC_MEAS];
+    adc_conv_channels(adc_channels, adc_scales, raw, values);
+
+    int32_t i_dcdc = values[ADC_MEAS_I_DCDC] + dcdc_current_offset;
+    int32_t i_load = values[ADC_MEAS_I_LOAD] + load_current_offset;
+
+#ifdef PWM_CHANNEL_PHASE2
+    int32_t i_phase2 = values[ADC_MEAS_I_PHASE2] + phase2_current_offset;
+    meas->phase_imbalance = i_dcdc - i_phase2;
+    i_dcdc += i_phase2;
+#else
+    meas->phase_imbalance = 0;
+#endif
+
+    meas->ls_voltage = values[ADC_MEAS_V_BAT];
+    meas->hs_voltage = values[ADC_MEAS_V_SOLAR];
+    meas->ls_current = i_dcdc - i_load;
+    meas->hs_current = (meas->hs_voltage > 0) ?
+        -((int64_t)i_dcdc * meas->ls_voltage / meas->hs_voltage) : 0;
+}
+
+// raw reading of a current sensor with given destination in the channel table
+static uint32_t current_raw(unsigned int dest, int32_t offset, int32_t current)
+{
+    for (unsigned int i = 0; i < NUM_ADC_CONV_CHANNELS; i++) {
+        if (adc_channels[i].dest == dest) {
+            int32_t value = current - offset - adc_scales[i].offset;
+            return adc_conv_raw(value, adc_scales[i].gain);
+        }
+    }
+    return (1 << ADC_CONV_BITS) - 1;
+}
+
+uint32_t dcdc_current_raw(int32_t current)
+{
+    return current_raw(ADC_MEAS_I_DCDC, dcdc_current_offset, current);
+}
+
+#ifdef PWM_CHANNEL_PHASE2
+uint32_t phase2_current_raw(int32_t current)
+{
+    return current_raw(ADC_MEAS_I_PHASE2, phase2_current_offset, current);
+}
+#endif
+
+#endif /* PIL_TESTING */
@@ -0,0 +1,75 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef MEASUREMENTS_H
+#define MEASUREMENTS_H
+
+/** @file
+ *
+ * @brief Conversion of filtered ADC readings into measurement values of the structs
+ *
+ * Hardware independent, so that recorded ADC frames can be replayed on the host.
+ */
+
+#include "dcdc.h"
+#include "load.h"
+#include "battery.h"
+#include "power_port.h"
+
+/** Sets offset to actual measured value, i.e. sets zero current point.
+ *
+ * All input/output switches and consumers should be switched off before calling this function.
+ * Afterwards, the offsets are slowly adjusted by update_measurements() whenever the DC/DC (or
+ * PWM switch) and the load output are switched off.
+ */
+void calibrate_current_sensors();
+
+/** Updates structures with data read from ADC
+ */
+void update_measurements(dcdc_t *dcdc, battery_state_t *bat, load_output_t *load, power_port_t *hs, power_port_t *ls);
+
+/** Converts the latest readings for the inner control loop of the DC/DC
+ *
+ * Called from the DMA interrupt, so only port voltages and currents are calculated. The supply
+ * voltage and current sensor offsets of the last update_measurements() call are used.
+ *
+ * @param meas Struct to store the measurements
+ */
+void update_fast_measurements(dcdc_fast_meas_t *meas);
+
+/** Calculates the raw reading of the DC/DC current sensor for a given current
+ *
+ * Uses the supply voltage and sensor offset of the last update_measurements() call, e.g. to
+ * set the threshold of the fast overcurrent trip.
+ *
+ * @param current DC/DC current (mA)
+ *
+ * @returns Raw ADC reading (ADC_CONV_BITS resolution)
+ */
+uint32_t dcdc_current_raw(int32_t current);
+
+/** Calculates the raw reading of the current sensor of the second phase for a given current
+ *
+ * Same as dcdc_current_raw(), only available for PCBs with PWM_CHANNEL_PHASE2.
+ *
+ * @param current Current of the second phase (mA)
+ *
+ * @returns Raw ADC reading (ADC_CONV_BITS resolution)
+ */
+uint32_t phase2_current_raw(int32_t current);
+
+#endif /* MEASUREMENTS_H */
@@ -0,0 +1,133 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mppt.h"
+
+#include <math.h>       // for fabs function
+
+void mppt_perturb_observe_reset(dcdc_t *dcdc)
+{
+    dcdc->power = 0;
+    dcdc->mppt_step = 1;
+    dcdc->mppt_reversals = 0;
+    dcdc->mppt_voltage_prev = 0;
+    dcdc->mppt_current_prev = 0;
+}
+
+int mppt_perturb_observe(dcdc_t *dcdc, const power_port_t *out, const power_port_t *in)
+{
+    float power_new = out->voltage * out->current;
+    float power_change = power_new - dcdc->power;
+    bool first_step = (dcdc->power == 0);
+    bool reversal = (power_change < 0);
+    if (reversal) {
+        dcdc->pwm_delta = -dcdc->pwm_delta;
+    }
+    dcdc->mppt_reversals = (dcdc->mppt_reversals << 1) | reversal;
+
+    // relative power change, independent of the size of the panel and the irradiance level
+    float power_change_rel = first_step ? 0 : fabs(power_change) / dcdc->power;
+    dcdc->power = power_new;
+
+    // two or more reversals within the last four steps: oscillating around the MPP
+    int num_reversals = 0;
+    for (int i = 0; i < 4; i++) {
+        num_reversals += (dcdc->mppt_reversals >> i) & 1;
+    }
+
+    // changing irradiance dominates if the power changed more than the last step can cause or
+    // if input voltage and current changed in the same direction (the step moves the operating
+    // point along the falling I-V curve, changing irradiance moves the curve itself)
+    float dv = in->voltage - dcdc->mppt_voltage_prev;
+    float di = -in->current - dcdc->mppt_current_prev;      // input current has negative sign
+    dcdc->mppt_voltage_prev = in->voltage;
+    dcdc->mppt_current_prev = -in->current;
+    bool irradiance_change = power_change_rel > MPPT_PO_POWER_CHANGE_MAX * dcdc->mppt_step
+        || dv * di > 0;
+
+    int step = 1;
+    // no adaptive step directly after start, as the power change from zero says nothing about
+    // the distance to the MPP
+    if (dcdc->mppt_adaptive && num_reversals < 2 && !first_step && !irradiance_change) {
+        step = MPPT_PO_STEP_GAIN * power_change_rel / dcdc->mppt_step + 0.5;
+        if (step < 1) {
+            step = 1;
+        }
+        else if (step > MPPT_PO_STEP_MAX) {
+            step = MPPT_PO_STEP_MAX;
+        }
+    }
+    dcdc->mppt_step = step;
+    return dcdc->pwm_delta * step;
+}
+
+void mppt_inc_conductance_reset(dcdc_t *dcdc)
+{
+    dcdc->mppt_voltage_prev = 0;
+    dcdc->mppt_current_prev = 0;
+}
+
+int mppt_inc_conductance(dcdc_t *dcdc, const power_port_t *out, const power_port_t *in)
+{
+    float voltage = in->voltage;
+    float current = -in->current;       // input current has negative sign
+    float dv = voltage - dcdc->mppt_voltage_prev;
+    float di = current - dcdc->mppt_current_prev;
+    bool first_step = (dcdc->mppt_voltage_prev <= 0);
+
+    dcdc->mppt_voltage_prev = voltage;
+    dcdc->mppt_current_prev = current;
+    dcdc->power = out->voltage * out->current;
+
+    if (first_step || voltage <= 0) {
+        // start point is usually slightly above the MPP voltage, see dcdc_control()
+        return 1;
+    }
+
+    if (fabs(dv) < MPPT_INC_COND_DELTA_MIN * voltage) {
+        // voltage unchanged: irradiance changed if current changed
+        if (fabs(di) < MPPT_INC_COND_DELTA_MIN * current) {
+            return 0;
+        }
+        return (di > 0) ? -1 : 1;
+    }
+
+    // dP/dV = I + V * dI/dV, so the sign of dP/dV equals the sign of dI/dV + I/V
+    float conductance = current / voltage;
+    float slope = di / dv + conductance;
+    if (fabs(slope) < MPPT_INC_COND_TOLERANCE * conductance) {
+        return 0;       // at the MPP
+    }
+    else if (slope > 0) {
+        return -1;      // left of the MPP: increase input voltage
+    }
+    else {
+        return 1;       // right of the MPP: decrease input voltage
+    }
+}
+
+const mppt_algorithm_t mppt_algorithms[MPPT_NUM_ALGORITHMS] = {
+    { "P&O",     mppt_perturb_observe_reset, mppt_perturb_observe },
+    { "IncCond", mppt_inc_conductance_reset, mppt_inc_conductance },
+};
+
+const mppt_algorithm_t *mppt_get_algorithm(const dcdc_t *dcdc)
+{
+    if (dcdc->mppt_algorithm < MPPT_NUM_ALGORITHMS) {
+        return &mppt_algorithms[dcdc->mppt_algorithm];
+    }
+    return &mppt_algorithms[MPPT_PERTURB_OBSERVE];
+}
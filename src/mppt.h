@@ -0,0 +1,116 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MPPT_H
+#define MPPT_H
+
+/** @file
+ *
+ * @brief Maximum Power Point Tracking algorithms for the DC/DC converter
+ *
+ * The algorithm is selected per device with dcdc_t.mppt_algorithm, so that sites with
+ * fast-changing irradiance can use a different algorithm without changing the DC/DC control.
+ * Each algorithm keeps its state in the dcdc_t struct.
+ */
+
+#include "dcdc.h"
+#include "power_port.h"
+
+/** Available MPPT algorithms (index in mppt_algorithms table)
+ */
+enum mppt_algorithm_id
+{
+    MPPT_PERTURB_OBSERVE,       ///< Perturb and observe (fixed or adaptive step size)
+    MPPT_INC_CONDUCTANCE,       ///< Incremental conductance
+    MPPT_NUM_ALGORITHMS
+};
+
+/** MPPT algorithm interface
+ *
+ * Called by dcdc_control() in each control cycle if no voltage or current limits are reached.
+ */
+typedef struct {
+    const char *name;           ///< Name for debug output
+
+    /** Resets the state of the algorithm, called at DC/DC start
+     *
+     * @param dcdc DC/DC type description
+     */
+    void (*reset)(dcdc_t *dcdc);
+
+    /** Determines the next step towards the MPP
+     *
+     * @param dcdc DC/DC type description
+     * @param out Output power port (e.g. battery)
+     * @param in Input power port (e.g. solar panel)
+     *
+     * @returns Step in timer counts: positive to increase output power (i.e. decrease input
+     *          voltage), negative to decrease output power or zero to keep the duty cycle
+     */
+    int (*step)(dcdc_t *dcdc, const power_port_t *out, const power_port_t *in);
+} mppt_algorithm_t;
+
+/** Table of all available algorithms
+ */
+extern const mppt_algorithm_t mppt_algorithms[MPPT_NUM_ALGORITHMS];
+
+/** Gets the algorithm currently selected for the DC/DC
+ *
+ * @param dcdc DC/DC type description
+ *
+ * @returns Selected algorithm or perturb and observe if the selection is invalid
+ */
+const mppt_algorithm_t *mppt_get_algorithm(const dcdc_t *dcdc);
+
+/** Maximum step size of adaptive perturb and observe (timer counts of the PWM compare register)
+ */
+#ifndef MPPT_PO_STEP_MAX
+#define MPPT_PO_STEP_MAX 16
+#endif
+
+/** Gain of the adaptive step size of perturb and observe
+ *
+ * The step size is calculated as MPPT_PO_STEP_GAIN * |dP/P| / dD with the relative power change
+ * dP/P and the previous step size dD in timer counts, so it gets smaller close to the MPP.
+ */
+#ifndef MPPT_PO_STEP_GAIN
+#define MPPT_PO_STEP_GAIN 600.0
+#endif
+
+/** Maximum relative power change per timer count of the previous step caused by the step itself
+ *
+ * Larger changes are assumed to be caused by changing irradiance and don't increase the step
+ * size of adaptive perturb and observe.
+ */
+#ifndef MPPT_PO_POWER_CHANGE_MAX
+#define MPPT_PO_POWER_CHANGE_MAX 0.03
+#endif
+
+/** Minimum relative change of input voltage or current considered by incremental conductance
+ *
+ * Smaller changes are assumed to be caused by measurement noise.
+ */
+#ifndef MPPT_INC_COND_DELTA_MIN
+#define MPPT_INC_COND_DELTA_MIN 0.002
+#endif
+
+/** Tolerance of the MPP condition dI/dV = -I/V for incremental conductance (relative to I/V)
+ */
+#ifndef MPPT_INC_COND_TOLERANCE
+#define MPPT_INC_COND_TOLERANCE 0.02
+#endif
+
+#endif /* MPPT_H */
@@ -41,6 +41,13 @@
  */
 #define CONTROL_FREQUENCY 10
 
+/** Frequency of the inner DC/DC control loop (Hz)
+ *
+ * Called from the ADC DMA interrupt, i.e. once per 2^ADC_DMA_FRAMES_LOG2 frames with 1 kHz
+ * ADC trigger.
+ */
+#define FAST_CONTROL_FREQUENCY (1000 >> ADC_DMA_FRAMES_LOG2)
+
 /** Maximum Tj of MOSFETs (°C)
  *
  * This value is used for model-based control of overcurrent protection. It represents
@@ -59,6 +66,55 @@
  */
 #define MOSFET_THERMAL_TIME_CONSTANT  5
 
+/** NTC temperature calculation
+ *
+ * By default, temperatures are calculated using a lookup table generated at compile time
+ * from NTC_BETA_VALUE and the series resistor specified in the PCB header. Define
+ * NTC_BETA_FORMULA in the PCB header to use the (much slower) Beta equation with log()
+ * instead, e.g. if flash memory is too small for the tables.
+ */
+//#define NTC_BETA_FORMULA
+
+/** Number of ADC conversion sequences (frames) per DMA interrupt as power of two
+ *
+ * The DMA writes into a double buffer and interrupts after each half (half-transfer and
+ * transfer-complete). The frames of one half are summed up (decimation) before they are
+ * passed to the low-pass filters, so the DMA interrupt rate is reduced by this factor and
+ * the effective resolution of the measurements is increased.
+ *
+ * Maximum value is 4 (16 frames), as the sum has to fit into 32 bits also with the STM32L0
+ * hardware oversampling.
+ */
+#define ADC_DMA_FRAMES_LOG2 2
+
+/** ADC low-pass filter constants
+ *
+ * Each ADC channel is filtered by an exponential moving average filter with multiplier
+ * 1/2^x, applied to the decimated readings of each DMA interrupt. With a sampling rate of
+ * 1 kHz and 2^ADC_DMA_FRAMES_LOG2 = 4 frames per interrupt, the resulting time constant is
+ * 4 ms * 2^x. The constant for each channel is assigned in the adc_filter_const array of the
+ * PCB header. Currents need a short time constant for fast DC/DC and MPPT control, whereas
+ * temperatures and reference voltages change only slowly and benefit from a long one.
+ */
+#define ADC_FILTER_FAST     0       // currents (4 ms, decimation only)
+#define ADC_FILTER_MEDIUM   1       // voltages (8 ms)
+#define ADC_FILTER_SLOW     5       // temperatures and reference voltages (128 ms)
+
+
+/** Measurement values calculated from linear ADC channels
+ *
+ * Used as destination in the adc_channels table of the PCB header. Voltages are stored in mV,
+ * currents in mA.
+ */
+enum adc_meas {
+    ADC_MEAS_V_BAT,         ///< Battery voltage
+    ADC_MEAS_V_SOLAR,       ///< Solar voltage
+    ADC_MEAS_I_LOAD,        ///< Load output current
+    ADC_MEAS_I_DCDC,        ///< DC/DC or PWM switch current (first phase if interleaved)
+    ADC_MEAS_I_PHASE2,      ///< DC/DC current of second phase (PCBs with PWM_CHANNEL_PHASE2)
+    NUM_ADC_MEAS            // trick to get the number of elements
+};
+
 
 // specific board settings
 ///////////////////////////////////////////////////////////////////////////////
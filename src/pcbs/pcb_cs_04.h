@@ -18,10 +18,12 @@
 #define __PCB_CS_04_H_
 
 #include "mbed.h"
+#include "adc_conv.h"
 
 // DC/DC converter settings
 #define PWM_FREQUENCY 50 // kHz  50 = better for cloud solar to increase efficiency
 #define PWM_TIM        3 // use TIM3 timer
+#define PWM_CHANNELS { 3 } // high-side at TIM3_CH3 (PB0), low-side at TIM3_CH4 (PB1)
 
 #define DCDC_CURRENT_MAX 10  // PCB maximum DCDC output current
 #define LOAD_CURRENT_MAX 10  // PCB maximum load switch current
@@ -96,6 +98,30 @@ enum {
     NUM_ADC_CH          // trick to get the number of elements
 };
 
+// exponential moving average filter constants (has to match with above enum)
+static const uint8_t adc_filter_const[NUM_ADC_CH] = {
+    ADC_FILTER_MEDIUM,  // ADC_POS_V_BAT
+    ADC_FILTER_MEDIUM,  // ADC_POS_V_SOLAR
+    ADC_FILTER_SLOW,    // ADC_POS_TEMP_FETS
+    ADC_FILTER_FAST,    // ADC_POS_I_LOAD
+    ADC_FILTER_FAST,    // ADC_POS_I_DCDC
+#if defined(STM32F0)
+    ADC_FILTER_SLOW,    // ADC_POS_TEMP_MCU
+    ADC_FILTER_SLOW,    // ADC_POS_VREF_MCU
+#elif defined(STM32L0)
+    ADC_FILTER_SLOW,    // ADC_POS_VREF_MCU
+    ADC_FILTER_SLOW,    // ADC_POS_TEMP_MCU
+#endif
+};
+
+// conversion of linear channels into measurement values (see adc_channel_t)
+static const adc_channel_t adc_channels[] = {
+    { ADC_POS_V_BAT,      ADC_MEAS_V_BAT,     ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_V_BAT),        0 },
+    { ADC_POS_V_SOLAR,    ADC_MEAS_V_SOLAR,   ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_V_SOLAR),      0 },
+    { ADC_POS_I_LOAD,     ADC_MEAS_I_LOAD,    ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_I_LOAD),       0 },
+    { ADC_POS_I_DCDC,     ADC_MEAS_I_DCDC,    ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_I_DCDC),       0 },
+};
+
 // selected ADC channels (has to match with above enum)
 #if defined(STM32F0)
 #define ADC_CHSEL ( \
@@ -18,10 +18,12 @@
 #define __CONFIG_LS_10_H_
 
 #include "mbed.h"
+#include "adc_conv.h"
 
 // DC/DC converter settings
 #define PWM_FREQUENCY 70 // kHz  70 = good compromise between output ripple and efficiency
 #define PWM_TIM        1 // use TIM1 timer
+#define PWM_CHANNELS { 1 } // high-side at TIM1_CH1 (PA8), low-side at TIM1_CH1N (PB13)
 
 #define DCDC_CURRENT_MAX 20  // PCB maximum DCDC output current
 #define LOAD_CURRENT_MAX 20  // PCB maximum load switch current
@@ -102,6 +104,27 @@ enum {
     NUM_ADC_CH          // trick to get the number of enums
 };
 
+// exponential moving average filter constants (has to match with above enum)
+static const uint8_t adc_filter_const[NUM_ADC_CH] = {
+    ADC_FILTER_SLOW,    // ADC_POS_TEMP_BAT
+    ADC_FILTER_SLOW,    // ADC_POS_TEMP_FETS
+    ADC_FILTER_SLOW,    // ADC_POS_V_REF
+    ADC_FILTER_MEDIUM,  // ADC_POS_V_BAT
+    ADC_FILTER_MEDIUM,  // ADC_POS_V_SOLAR
+    ADC_FILTER_FAST,    // ADC_POS_I_LOAD
+    ADC_FILTER_FAST,    // ADC_POS_I_DCDC
+    ADC_FILTER_SLOW,    // ADC_POS_TEMP_MCU
+    ADC_FILTER_SLOW,    // ADC_POS_VREF_MCU
+};
+
+// conversion of linear channels into measurement values (see adc_channel_t)
+static const adc_channel_t adc_channels[] = {
+    { ADC_POS_V_BAT,      ADC_MEAS_V_BAT,     ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_V_BAT),        0 },
+    { ADC_POS_V_SOLAR,    ADC_MEAS_V_SOLAR,   ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_V_SOLAR),      0 },
+    { ADC_POS_I_LOAD,     ADC_MEAS_I_LOAD,    ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_I_LOAD),       0 },
+    { ADC_POS_I_DCDC,     ADC_MEAS_I_DCDC,    ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_I_DCDC),       0 },
+};
+
 // selected ADC channels (has to match with above enum)
 #define ADC_CHSEL ( \
     ADC_CHSELR_CHSEL0 | \
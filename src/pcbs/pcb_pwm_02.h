@@ -18,6 +18,7 @@
 #define __PCB_PWM_02_H_
 
 #include "mbed.h"
+#include "adc_conv.h"
 
 #define CHARGER_TYPE_PWM 1  // PWM charge controller instead of MPPT
 
@@ -108,6 +109,26 @@ enum {
     NUM_ADC_CH          // trick to get the number of elements
 };
 
+// exponential moving average filter constants (has to match with above enum)
+static const uint8_t adc_filter_const[NUM_ADC_CH] = {
+    ADC_FILTER_MEDIUM,  // ADC_POS_V_BAT
+    ADC_FILTER_MEDIUM,  // ADC_POS_V_SOLAR
+    ADC_FILTER_FAST,    // ADC_POS_I_LOAD
+    ADC_FILTER_FAST,    // ADC_POS_I_SOLAR
+    ADC_FILTER_SLOW,    // ADC_POS_TEMP_BAT
+    ADC_FILTER_SLOW,    // ADC_POS_VREF_MCU
+    ADC_FILTER_SLOW,    // ADC_POS_TEMP_MCU
+};
+
+// conversion of linear channels into measurement values (see adc_channel_t), solar voltage
+// is measured relative to battery voltage
+static const adc_channel_t adc_channels[] = {
+    { ADC_POS_V_BAT,      ADC_MEAS_V_BAT,     ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_V_BAT),        0 },
+    { ADC_POS_V_SOLAR,    ADC_MEAS_V_SOLAR,   ADC_MEAS_V_BAT,     ADC_Q16(-ADC_GAIN_V_SOLAR),     ADC_Q16(-ADC_OFFSET_V_SOLAR) },
+    { ADC_POS_I_LOAD,     ADC_MEAS_I_LOAD,    ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_I_LOAD),       0 },
+    { ADC_POS_I_SOLAR,    ADC_MEAS_I_DCDC,    ADC_CONV_NO_REF,    ADC_Q16(ADC_GAIN_I_SOLAR),      0 },
+};
+
 // selected ADC channels (has to match with above enum)
 #define ADC_CHSEL ( \
     ADC_CHSELR_CHSEL0 | \
@@ -19,8 +19,8 @@
 #include "pwm_switch.h"
 #include "config.h"
 #include "pcb.h"
+#include "hardware.h"
 
-#include <time.h>       // for time(NULL) function
 #include <math.h>       // for fabs function
 
 
@@ -46,7 +46,7 @@ void pwm_switch_init_registers(int freq_Hz)
     GPIOB->AFR[0] |= 0x2 << GPIO_AFRL_AFRL1_Pos;
 
     // Set timer clock to 10 kHz
-    TIM3->PSC = SystemCoreClock / 10000;
+    TIM3->PSC = SystemCoreClock / 10000 - 1;
 
     // Capture/Compare Mode Register 1
     // OCxM = 110: Select PWM mode 1 on OCx
@@ -67,8 +67,8 @@ void pwm_switch_init_registers(int freq_Hz)
     // set PWM frequency and resolution
     _pwm_resolution = 10000 / freq_Hz;
 
-    // Auto Reload Register
-    TIM3->ARR = _pwm_resolution;
+    // Auto Reload Register (period = ARR + 1)
+    TIM3->ARR = _pwm_resolution - 1;
 }
 
 void pwm_switch_set_duty_cycle(float duty)
@@ -88,6 +88,22 @@ bool pwm_switch_enabled()
     return _enabled;
 }
 
+int pwm_switch_get_period_clocks()
+{
+    return (TIM3->ARR + 1) * (TIM3->PSC + 1);
+}
+
+int pwm_switch_get_phase_clocks()
+{
+    return TIM3->CNT * (TIM3->PSC + 1);
+}
+
+int pwm_switch_get_on_clocks()
+{
+    // PWM mode 1: switch is on while counter is below CCR
+    return TIM3->CCR4 * (TIM3->PSC + 1);
+}
+
 float pwm_switch_get_duty_cycle() {
     // TODO: check why we might get > 100
     return (float)(TIM3->CCR4) / (_pwm_resolution);
@@ -165,7 +181,7 @@ void pwm_switch_control(pwm_switch_t *pwm_switch, power_port_t *solar_port, powe
             && bat_port->voltage > bat_port->voltage_output_min
             && solar_port->input_allowed == true
             && solar_port->voltage > solar_port->voltage_input_start
-            && time(NULL) > (pwm_switch->off_timestamp + pwm_switch->restart_interval)
+            && uptime > (pwm_switch->off_timestamp + pwm_switch->restart_interval)
             && pwm_switch->enabled == true)
         {
             pwm_switch_start(1);
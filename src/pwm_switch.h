@@ -57,6 +57,22 @@ void pwm_switch_control(pwm_switch_t *pwm_switch, power_port_t *solar_port, powe
 
 void pwm_switch_duty_cycle_step(int delta);
 
+/** Sets the duty cycle of the switch
+ *
+ * @param duty Duty cycle between 0.0 and 1.0
+ */
+void pwm_switch_set_duty_cycle(float duty);
+
+/** Switches the PWM output on
+ *
+ * @param pwm_duty Initial duty cycle between 0.0 and 1.0
+ */
+void pwm_switch_start(float pwm_duty);
+
+/** Switches the PWM output off
+ */
+void pwm_switch_stop();
+
 bool pwm_switch_enabled();
 
 /** Read the currently set duty cycle
@@ -65,4 +81,25 @@ bool pwm_switch_enabled();
  */
 float pwm_switch_get_duty_cycle();
 
+/** Get the period of the PWM signal
+ *
+ * @returns Switching period in SystemCoreClock cycles
+ */
+int pwm_switch_get_period_clocks();
+
+/** Get the current position of the timer within the switching period
+ *
+ * The switch is turned on at the beginning of the period.
+ *
+ * @returns SystemCoreClock cycles since the start of the switching period (resolution is
+ *          limited by the timer prescaler)
+ */
+int pwm_switch_get_phase_clocks();
+
+/** Get the on-time of the switch within the switching period
+ *
+ * @returns On-time in SystemCoreClock cycles
+ */
+int pwm_switch_get_on_clocks();
+
 #endif /* PWM_SWITCH_H */
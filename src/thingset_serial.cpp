@@ -19,6 +19,7 @@
 #include "mbed.h"
 #include "thingset.h"
 #include "config.h"
+#include "adc_scope.h"
 
 #include "thingset_serial.h"
 
@@ -59,6 +60,7 @@ void thingset_serial_process_asap()
 {
 #ifdef UART_SERIAL_ENABLED
     uart_serial_process();
+    uart_serial_scope_readout();
 #endif
 #ifdef USB_SERIAL_ENABLED
     usb_serial_process();
@@ -135,6 +137,25 @@ void uart_serial_process()
     }
 }
 
+void uart_serial_scope_readout()
+{
+    // only one chunk per call to keep the main loop responsive
+    const uint8_t *data;
+    uint32_t offset;
+    size_t len = adc_scope_next_chunk(&data, &offset);
+    if (len > 0) {
+        // send data directly from capture buffer instead of copying it into buf_resp
+        uint8_t header[ADC_SCOPE_HEADER_SIZE];
+        int header_len = adc_scope_chunk_header(header, offset, len);
+        for (int i = 0; i < header_len; i++) {
+            ser_uart->putc(header[i]);
+        }
+        for (size_t i = 0; i < len; i++) {
+            ser_uart->putc(data[i]);
+        }
+    }
+}
+
 #endif /* UART_SERIAL_ENABLED */
 
 
@@ -38,6 +38,10 @@ void uart_serial_init(Serial* s);
 void uart_serial_process();
 void uart_serial_pub();
 
+/** Sends the next chunk of captured ADC data (scope mode) if readout was started
+ */
+void uart_serial_scope_readout();
+
 /** Serial interface via USB CDC device class (currently only supported with STM32F0)
  */
 void usb_serial_init();
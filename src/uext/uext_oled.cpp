@@ -29,13 +29,15 @@
 #include "battery.h"
 #include "load.h"
 #include "log.h"
+#include "meas_snapshot.h"
 
 extern log_data_t log_data;
-extern dcdc_t dcdc;
+extern dcdc_t dcdc[DCDC_NUM_CONVERTERS];
 extern power_port_t hs_port;
 extern power_port_t ls_port;
 extern battery_state_t bat_state;
 extern load_output_t load;
+extern meas_snapshot_t meas;
 
 #include "Adafruit_SSD1306.h"
 
@@ -73,7 +75,7 @@ void uext_process_1s()
     oled.drawBitmap(6, 0, bmp_pv_panel, 16, 16, 1);
     oled.drawBitmap(104, 0, bmp_load, 16, 16, 1);
 
-    if (half_bridge_enabled() == false) {
+    if (half_bridge_enabled(&dcdc[0].half_bridge) == false) {
         oled.drawBitmap(27, 3, bmp_disconnected, 32, 8, 1);
     }
     else {
@@ -96,8 +98,8 @@ void uext_process_1s()
     oled.drawRect(66, 4, 2, 5, 1);      // bar 5
 
     // solar panel data
-    if (half_bridge_enabled()) {
-        tmp = -hs_port.voltage * hs_port.current;
+    if (half_bridge_enabled(&dcdc[0].half_bridge)) {
+        tmp = -meas.hs_voltage * meas.hs_current;
         oled.setTextCursor(0, 18);
         oled.printf("%4.0fW", (abs(tmp) < 1) ? 0 : tmp);     // remove negative zeros
     }
@@ -107,29 +109,30 @@ void uext_process_1s()
     }
     //if (solar_port->voltage > bat_port->voltage) {
         oled.setTextCursor(0, 26);
-        oled.printf("%4.1fV", hs_port.voltage);
+        oled.printf("%4.1fV", meas.hs_voltage);
     //}
 
     // battery data
-    tmp = ls_port.voltage * ls_port.current;
+    tmp = meas.ls_voltage * meas.ls_current;
     oled.setTextCursor(42, 18);
     oled.printf("%5.1fW", (abs(tmp) < 0.1) ? 0 : tmp);    // remove negative zeros
     oled.setTextCursor(42, 26);
-    oled.printf("%5.1fV", ls_port.voltage);
+    oled.printf("%5.1fV", meas.ls_voltage);
 
     // load data
-    tmp = ls_port.voltage * load.current;
+    tmp = meas.ls_voltage * meas.load_current;
     oled.setTextCursor(90, 18);
     oled.printf("%5.1fW", (abs(tmp) < 0.1) ? 0 : tmp);    // remove negative zeros
     oled.setTextCursor(90, 26);
-    oled.printf("%5.1fA\n", (abs(load.current) < 0.1) ? 0 : load.current);
+    oled.printf("%5.1fA\n", (abs(meas.load_current) < 0.1) ? 0 : meas.load_current);
 
     oled.setTextCursor(0, 36);
     oled.printf("Day +%5.0fWh -%5.0fWh", log_data.solar_in_day_Wh, fabs(log_data.load_out_day_Wh));
     oled.printf("Tot +%4.1fkWh -%4.1fkWh", log_data.solar_in_total_Wh / 1000.0, fabs(log_data.load_out_total_Wh) / 1000.0);
 
     oled.setTextCursor(0, 56);
-    oled.printf("T %.0fC PWM %.0f%% SOC %d%%", dcdc.temp_mosfets, half_bridge_get_duty_cycle() * 100.0, bat_state.soc);
+    oled.printf("T %.0fC PWM %.0f%% SOC %d%%", meas.mosfet_temp,
+        half_bridge_get_duty_cycle(&dcdc[0].half_bridge) * 100.0, meas.soc);
 
     oled.display();
 }
@@ -10,6 +10,7 @@
 #include <inttypes.h>
 
 #include "pcb.h"
+#include "hardware.h"
 
 #include "ESP32.h"
 
@@ -171,7 +172,7 @@ void uext_process_1s()
         state = STATE_WIFI_IDLE;
     }
 
-    if (time(NULL) % 10 == 0) {
+    if (uptime % 10 == 0) {
 
         printf("WiFi state: %d, error counter: %d\n", state, error_counter);
 
@@ -0,0 +1,219 @@
+
+#include "tests.h"
+
+#include "adc_filter.h"
+#include "adc_conv.h"
+#include "measurements.h"
+#include "half_bridge.h"
+#include "pwm_switch.h"
+#include "pcb.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define REPLAY_TRIGGER_FREQ 1000        // Hz, see adc_timer_start() call in main()
+#define REPLAY_FRAMES_PER_CONTROL (REPLAY_TRIGGER_FREQ / CONTROL_FREQUENCY)
+#define REPLAY_PWM_PERIOD_FRAMES (REPLAY_TRIGGER_FREQ / 20)    // see pwm_switch_init()
+
+extern float mcu_temp;
+
+/* Replays recorded ADC frames through the same filter and conversion code as on the target
+ *
+ * Each line of the trace contains the raw readings of one frame (NUM_ADC_CH values with
+ * 16-bit scaling, as captured in scope mode), optionally followed by the duty cycle of the
+ * PWM switch or DC/DC (0 = switched off). Lines starting with # are ignored.
+ *
+ * As in main(), the current sensors are calibrated in the first control cycle if the
+ * switch is off. The resulting measurements of each control cycle are written as CSV.
+ *
+ * Returns the number of control cycles or -1 for invalid traces.
+ */
+int adc_replay(FILE *trace, FILE *csv)
+{
+    static volatile uint16_t frames[ADC_DMA_FRAMES][NUM_ADC_CH];
+    dcdc_t dcdc_replay = {};
+    battery_state_t bat_replay = {};
+    load_output_t load_replay = {};
+    power_port_t hs_replay = {};
+    power_port_t ls_replay = {};
+
+    char line[200];
+    unsigned int num_frames = 0;
+    unsigned int pos = 0;
+    int num_cycles = 0;
+    float duty = 0;
+
+    adc_filter_reset();
+    fprintf(csv, "time_s,solar_V,bat_V,solar_A,bat_A,load_A,bat_degC,mcu_degC\n");
+
+    while (fgets(line, sizeof(line), trace) != NULL) {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+
+        char *p = line;
+        char *end;
+        for (unsigned int i = 0; i < NUM_ADC_CH; i++) {
+            frames[pos][i] = strtoul(p, &end, 10);
+            if (end == p) {
+                return -1;
+            }
+            p = (*end == ',') ? end + 1 : end;
+        }
+        duty = strtod(p, &end);
+        if (end == p) {
+            duty = 0;
+        }
+        pos++;
+        num_frames++;
+
+        if (pos == ADC_DMA_FRAMES) {
+            pos = 0;
+            adc_pwm_frames_t pwm;
+            adc_pwm_frames_classify(&pwm, duty > 0, REPLAY_PWM_PERIOD_FRAMES,
+                duty * REPLAY_PWM_PERIOD_FRAMES + 0.5, (num_frames - 1) % REPLAY_PWM_PERIOD_FRAMES, 1);
+            adc_filter_frames(frames, &pwm);
+
+            if (num_frames % REPLAY_FRAMES_PER_CONTROL == 0) {
+                // switch state is needed for auto-zero of current sensors
+                if (duty > 0) {
+                    pwm_switch_start(duty);
+                    half_bridge_start(&dcdc_replay.half_bridge, duty);
+                }
+                else {
+                    pwm_switch_stop();
+                    half_bridge_stop(&dcdc_replay.half_bridge);
+                }
+
+                update_measurements(&dcdc_replay, &bat_replay, &load_replay, &hs_replay, &ls_replay);
+                if (num_cycles == 0 && duty == 0) {
+                    calibrate_current_sensors();
+                }
+                num_cycles++;
+
+                fprintf(csv, "%.1f,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f,%.1f\n",
+                    (float)num_frames / REPLAY_TRIGGER_FREQ, hs_replay.voltage, ls_replay.voltage,
+                    hs_replay.current, ls_replay.current, load_replay.current,
+                    bat_replay.temperature, mcu_temp);
+            }
+        }
+    }
+    return num_cycles;
+}
+
+// converts measurement value into raw reading with 16-bit scaling at 3.0 V supply
+static unsigned int raw16(float value, float gain)
+{
+    return value / 3.0 / gain * 65536 + 0.5;
+}
+
+static void write_frames(FILE *f, int num, unsigned int v_solar_raw, unsigned int i_solar_raw,
+    float duty)
+{
+    for (int i = 0; i < num; i++) {
+        unsigned int readings[NUM_ADC_CH] = {0};
+        readings[ADC_POS_V_BAT] = raw16(12.8, ADC_GAIN_V_BAT);
+        readings[ADC_POS_V_SOLAR] = v_solar_raw;
+        readings[ADC_POS_I_LOAD] = 300;                 // offset only
+        readings[ADC_POS_I_SOLAR] = i_solar_raw;
+        readings[ADC_POS_TEMP_BAT] = 1 << 15;
+        readings[ADC_POS_VREF_MCU] = 1656 << 4;         // 3.0 V supply voltage
+        readings[ADC_POS_TEMP_MCU] = 915 << 4;          // 30°C
+        for (unsigned int ch = 0; ch < NUM_ADC_CH; ch++) {
+            fprintf(f, "%u,", readings[ch]);
+        }
+        fprintf(f, "%.2f\n", duty);
+    }
+}
+
+// reads values of the last line of the CSV output
+static void read_last_values(FILE *csv, float values[8])
+{
+    char line[200];
+    rewind(csv);
+    while (fgets(line, sizeof(line), csv) != NULL) {
+        if (line[0] != 't') {
+            sscanf(line, "%f,%f,%f,%f,%f,%f,%f,%f", &values[0], &values[1], &values[2],
+                &values[3], &values[4], &values[5], &values[6], &values[7]);
+        }
+    }
+}
+
+void replay_pwm_charger_trace()
+{
+    FILE *trace = tmpfile();
+    FILE *csv = tmpfile();
+    TEST_ASSERT(trace != NULL && csv != NULL);
+
+    const unsigned int i_offset_raw = 400;
+    const unsigned int i_on_raw = i_offset_raw + raw16(10.0, ADC_GAIN_I_SOLAR);
+
+    // solar voltage relative to battery voltage (negative gain)
+    unsigned int v_solar_raw = (-ADC_OFFSET_V_SOLAR - (18.0 - 12.8) / 3.0) / ADC_GAIN_V_SOLAR * 65536;
+
+    // switch off during start-up, afterwards 20% duty cycle (only on-frames are valid for
+    // solar voltage)
+    write_frames(trace, 200, v_solar_raw, i_offset_raw, 0);
+    for (int period = 0; period < 20; period++) {
+        write_frames(trace, REPLAY_PWM_PERIOD_FRAMES / 5, v_solar_raw, i_on_raw, 0.2);
+        write_frames(trace, REPLAY_PWM_PERIOD_FRAMES * 4 / 5, 1 << 15, i_offset_raw, 0.2);
+    }
+    rewind(trace);
+
+    TEST_ASSERT_EQUAL(12, adc_replay(trace, csv));
+
+    float values[8];
+    read_last_values(csv, values);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 1.2, values[0]);         // time
+    TEST_ASSERT_FLOAT_WITHIN(0.1, 18.0, values[1]);         // solar voltage
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 12.8, values[2]);        // battery voltage
+    TEST_ASSERT_FLOAT_WITHIN(0.1, 2.0, values[3]);          // average solar current
+    TEST_ASSERT_FLOAT_WITHIN(0.1, 2.0, values[4]);          // battery current
+    TEST_ASSERT_FLOAT_WITHIN(0.05, 0.0, values[5]);         // load current (offset removed)
+    TEST_ASSERT_FLOAT_WITHIN(0.5, 30.0, values[7]);         // MCU temperature
+
+    fclose(trace);
+    fclose(csv);
+}
+
+void replay_rejects_invalid_trace()
+{
+    FILE *trace = tmpfile();
+    FILE *csv = tmpfile();
+    TEST_ASSERT(trace != NULL && csv != NULL);
+
+    fprintf(trace, "# comment\n1000,2000,abc\n");
+    rewind(trace);
+    TEST_ASSERT_EQUAL(-1, adc_replay(trace, csv));
+
+    fclose(trace);
+    fclose(csv);
+}
+
+void adc_replay_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(replay_pwm_charger_trace);
+    RUN_TEST(replay_rejects_invalid_trace);
+
+    UNITY_END();
+
+    // replay of field captures: ADC_REPLAY_TRACE=trace.csv [ADC_REPLAY_CSV=result.csv]
+    const char *trace_file = getenv("ADC_REPLAY_TRACE");
+    if (trace_file != NULL) {
+        FILE *trace = fopen(trace_file, "r");
+        const char *csv_file = getenv("ADC_REPLAY_CSV");
+        FILE *csv = (csv_file != NULL) ? fopen(csv_file, "w") : stdout;
+        if (trace != NULL && csv != NULL) {
+            printf("Replayed %d control cycles from %s\n", adc_replay(trace, csv), trace_file);
+        }
+        if (trace != NULL) {
+            fclose(trace);
+        }
+        if (csv != NULL && csv != stdout) {
+            fclose(csv);
+        }
+    }
+}
@@ -0,0 +1,142 @@
+
+#include "tests.h"
+
+#include "adc_scope.h"
+
+#include <string.h>
+
+// frames as written by the DMA with a counter in each channel (frame number * 16 + channel)
+static volatile uint16_t frames[4][NUM_ADC_CH];
+static uint16_t frame_counter;
+
+static void push_frames(unsigned int num, unsigned int shift = 0)
+{
+    while (num > 0) {
+        unsigned int n = num > 4 ? 4 : num;
+        for (unsigned int f = 0; f < n; f++) {
+            for (unsigned int i = 0; i < NUM_ADC_CH; i++) {
+                frames[f][i] = (frame_counter << 4) + i;
+            }
+            frame_counter++;
+        }
+        adc_scope_push(frames, n, shift);
+        num -= n;
+    }
+}
+
+static void reset_scope()
+{
+    memset(&adc_scope, 0, sizeof(adc_scope));
+    frame_counter = 0;
+}
+
+// reads all captured data in chunks and checks the chunk sizes and offsets
+static void read_all(uint16_t captured[][NUM_ADC_CH])
+{
+    const uint8_t *data;
+    uint32_t offset;
+    uint32_t total = 0;
+    size_t len;
+
+    adc_scope_start_readout();
+    while ((len = adc_scope_next_chunk(&data, &offset)) > 0) {
+        TEST_ASSERT(len <= ADC_SCOPE_CHUNK_SIZE);
+        TEST_ASSERT_EQUAL(total, offset);
+        memcpy((uint8_t *)captured + offset, data, len);
+        total += len;
+    }
+    TEST_ASSERT_EQUAL(ADC_SCOPE_FRAMES * NUM_ADC_CH * sizeof(uint16_t), total);
+    TEST_ASSERT_FALSE(adc_scope.readout_active);
+}
+
+void scope_idle_does_not_record()
+{
+    reset_scope();
+    push_frames(ADC_SCOPE_FRAMES * 2);
+    TEST_ASSERT_EQUAL(ADC_SCOPE_IDLE, adc_scope.state);
+
+    const uint8_t *data;
+    uint32_t offset;
+    adc_scope_start_readout();
+    TEST_ASSERT_EQUAL(0, adc_scope_next_chunk(&data, &offset));
+}
+
+void scope_threshold_trigger_with_pretrigger()
+{
+    static uint16_t captured[ADC_SCOPE_FRAMES][NUM_ADC_CH];
+
+    reset_scope();
+    adc_scope.trigger_pos = 1;
+    adc_scope.trigger_rising = true;
+    adc_scope.pretrigger_frames = 10;
+    // channel 1 of frame 150 (with 1 bit shift) crosses the threshold
+    adc_scope.trigger_level = ((150 << 4) + 1) << 1;
+    adc_scope_arm();
+
+    push_frames(150, 1);
+    TEST_ASSERT_EQUAL(ADC_SCOPE_ARMED, adc_scope.state);
+    push_frames(1, 1);
+    TEST_ASSERT_EQUAL(ADC_SCOPE_TRIGGERED, adc_scope.state);
+    push_frames(ADC_SCOPE_FRAMES, 1);
+    TEST_ASSERT_EQUAL(ADC_SCOPE_DONE, adc_scope.state);
+    TEST_ASSERT_EQUAL(10, adc_scope.trigger_frame);
+
+    // captured data in chronological order with 16-bit scaling
+    read_all(captured);
+    for (unsigned int f = 0; f < ADC_SCOPE_FRAMES; f++) {
+        for (unsigned int i = 0; i < NUM_ADC_CH; i++) {
+            TEST_ASSERT_EQUAL((((140 + f) << 4) + i) << 1, captured[f][i]);
+        }
+    }
+}
+
+void scope_forced_trigger_before_pretrigger_complete()
+{
+    static uint16_t captured[ADC_SCOPE_FRAMES][NUM_ADC_CH];
+
+    reset_scope();
+    adc_scope.trigger_level = UINT16_MAX;      // never reached
+    adc_scope.pretrigger_frames = 50;
+    adc_scope_arm();
+
+    push_frames(8);
+    adc_scope_force_trigger();
+    push_frames(ADC_SCOPE_FRAMES * 2);
+    TEST_ASSERT_EQUAL(ADC_SCOPE_DONE, adc_scope.state);
+    TEST_ASSERT_EQUAL(8, adc_scope.trigger_frame);
+
+    read_all(captured);
+    for (unsigned int f = 0; f < ADC_SCOPE_FRAMES; f++) {
+        TEST_ASSERT_EQUAL(f << 4, captured[f][0]);
+    }
+
+    // re-arming discards the captured data
+    adc_scope_arm();
+    TEST_ASSERT_EQUAL(ADC_SCOPE_ARMED, adc_scope.state);
+}
+
+void scope_chunk_header_encoding()
+{
+    uint8_t buf[ADC_SCOPE_HEADER_SIZE];
+
+    const uint8_t small[] = { 0x1F, 0xA1, 0x18, ADC_SCOPE_DATA_ID, 0x82, 0x00, 0x50 };
+    TEST_ASSERT_EQUAL(sizeof(small), adc_scope_chunk_header(buf, 0, 16));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(small, buf, sizeof(small));
+
+    const uint8_t large[] = { 0x1F, 0xA1, 0x18, ADC_SCOPE_DATA_ID, 0x82,
+        0x1A, 0x00, 0x01, 0x00, 0x00, 0x58, 0x40 };
+    TEST_ASSERT_EQUAL(sizeof(large), adc_scope_chunk_header(buf, 0x10000, 64));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(large, buf, sizeof(large));
+}
+
+void adc_scope_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(scope_idle_does_not_record);
+    RUN_TEST(scope_threshold_trigger_with_pretrigger);
+    RUN_TEST(scope_forced_trigger_before_pretrigger_complete);
+    RUN_TEST(scope_chunk_header_encoding);
+
+    UNITY_END();
+}
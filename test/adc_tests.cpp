@@ -0,0 +1,339 @@
+
+#include "tests.h"
+
+#include "adc_conv.h"
+#include "pcb.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+// gains of the channels as defined in the PCB header (pcb_stub.h for unit tests)
+static const float gains[] = {
+    ADC_GAIN_V_BAT, ADC_GAIN_V_SOLAR, ADC_GAIN_I_LOAD, ADC_GAIN_I_SOLAR
+};
+#define NUM_GAINS (sizeof(gains)/sizeof(float))
+
+// float conversion as previously used in update_measurements() (12-bit raw value)
+static float convert_float(uint32_t raw, int vcc, float gain)
+{
+    return (float)(((raw >> (ADC_CONV_BITS - 12)) * vcc) / 4096) * gain / 1000.0;
+}
+
+static float convert_fixed(uint32_t raw, int32_t vcc, int32_t gain_q16)
+{
+    return adc_conv_value(raw, adc_conv_full_scale(vcc, gain_q16)) * 0.001f;
+}
+
+void fixed_point_vcc_matches_float()
+{
+    const uint16_t vrefint_cal = 1656;      // typical value for STM32L0 @ 3.0V
+    for (uint32_t raw = 1500 << 2; raw < (2000 << 2); raw++) {
+        float vcc_float = 3000.0 * vrefint_cal / (raw / 4.0);
+        TEST_ASSERT_FLOAT_WITHIN(1.0, vcc_float, adc_conv_vcc(raw, vrefint_cal, 3000));
+    }
+}
+
+void fixed_point_conversion_at_least_as_accurate_as_float()
+{
+    const int32_t vcc_values[] = { 2900, 3000, 3300 };
+    for (unsigned int g = 0; g < NUM_GAINS; g++) {
+        int32_t gain_q16 = ADC_Q16(gains[g]);
+        for (unsigned int v = 0; v < sizeof(vcc_values)/sizeof(int32_t); v++) {
+            int32_t vcc = vcc_values[v];
+            for (uint32_t raw = 0; raw < (1U << ADC_CONV_BITS); raw++) {
+                double exact = (double)raw * vcc / (1U << ADC_CONV_BITS) * gains[g] / 1000.0;
+                // fixed-point error is below 2 mV (truncation of full scale and result)
+                TEST_ASSERT_FLOAT_WITHIN(0.002, exact, convert_fixed(raw, vcc, gain_q16));
+                // previous float calculation lost resolution already before float conversion
+                TEST_ASSERT(fabs(exact - convert_fixed(raw, vcc, gain_q16)) <=
+                    fabs(exact - convert_float(raw, vcc, gains[g])) + 0.002);
+            }
+        }
+    }
+}
+
+void fixed_point_conversion_negative_offset()
+{
+    // solar voltage offset of PWM charger (to be multiplied with VDDA)
+    int32_t offset = adc_conv_full_scale(3300, ADC_Q16(ADC_OFFSET_V_SOLAR));
+    TEST_ASSERT_INT_WITHIN(1, (int32_t)(3300 * ADC_OFFSET_V_SOLAR), offset);
+}
+
+void channel_table_matches_single_conversions()
+{
+    const int32_t vcc = 3300;
+    uint32_t raw[NUM_ADC_CH] = {0};
+    int32_t meas[NUM_ADC_MEAS];
+    adc_conv_scale_t scales[sizeof(adc_channels) / sizeof(adc_channels[0])];
+    adc_conv_scales(adc_channels, vcc, scales);
+
+    for (uint32_t r = 0; r < (1U << ADC_CONV_BITS); r += 7) {
+        for (unsigned int i = 0; i < NUM_ADC_CH; i++) {
+            raw[i] = (r + i * 1000) & ((1U << ADC_CONV_BITS) - 1);
+        }
+        adc_conv_channels(adc_channels, scales, raw, meas);
+
+        // conversion as previously hand-coded in update_measurements() for PWM charger
+        int32_t v_bat = adc_conv_value(raw[ADC_POS_V_BAT],
+            adc_conv_full_scale(vcc, ADC_Q16(ADC_GAIN_V_BAT)));
+        int32_t v_solar = v_bat - (adc_conv_full_scale(vcc, ADC_Q16(ADC_OFFSET_V_SOLAR)) +
+            adc_conv_value(raw[ADC_POS_V_SOLAR], adc_conv_full_scale(vcc, ADC_Q16(ADC_GAIN_V_SOLAR))));
+        int32_t i_load = adc_conv_value(raw[ADC_POS_I_LOAD],
+            adc_conv_full_scale(vcc, ADC_Q16(ADC_GAIN_I_LOAD)));
+        int32_t i_solar = adc_conv_value(raw[ADC_POS_I_SOLAR],
+            adc_conv_full_scale(vcc, ADC_Q16(ADC_GAIN_I_SOLAR)));
+
+        TEST_ASSERT_EQUAL(v_bat, meas[ADC_MEAS_V_BAT]);
+        TEST_ASSERT_INT_WITHIN(3, v_solar, meas[ADC_MEAS_V_SOLAR]);   // rounding of negative gain
+        TEST_ASSERT_EQUAL(i_load, meas[ADC_MEAS_I_LOAD]);
+        TEST_ASSERT_EQUAL(i_solar, meas[ADC_MEAS_I_DCDC]);
+    }
+}
+
+void pwm_average_weighted_with_duty_cycle()
+{
+    const uint32_t off = 800;           // sensor offset at zero current
+    const uint32_t on = 800 + 20000;
+
+    TEST_ASSERT_EQUAL(off, adc_conv_pwm_average(on, off, 0));
+    TEST_ASSERT_EQUAL(on, adc_conv_pwm_average(on, off, 1 << 16));
+    TEST_ASSERT_EQUAL(off + 5000, adc_conv_pwm_average(on, off, 1 << 14));
+
+    // 16-bit readings with filter constant shift
+    TEST_ASSERT_EQUAL(0x100000 + 0x3FFFFF / 2, adc_conv_pwm_average(0x4FFFFF, 0x100000, 1 << 15));
+
+    // negative currents (on-state reading below offset) possible for sensor noise
+    TEST_ASSERT_EQUAL(off - 50, adc_conv_pwm_average(off - 100, off, 1 << 15));
+}
+
+void auto_zero_converges_slowly_after_delay()
+{
+    adc_auto_zero_t az;
+    adc_auto_zero_init(&az, 0);
+
+    // offset drifted to 40 mA, first cycles are ignored until filters have settled
+    for (int i = 0; i < ADC_AUTO_ZERO_DELAY; i++) {
+        TEST_ASSERT_EQUAL(0, adc_auto_zero_update(&az, 40, true));
+    }
+
+    // approx. 63% after one time constant
+    for (int i = 0; i < (1 << ADC_AUTO_ZERO_SHIFT); i++) {
+        adc_auto_zero_update(&az, 40, true);
+    }
+    TEST_ASSERT_INT_WITHIN(2, -25, az.offset_q8 >> 8);
+
+    for (int i = 0; i < 20 * (1 << ADC_AUTO_ZERO_SHIFT); i++) {
+        adc_auto_zero_update(&az, 40, true);
+    }
+    TEST_ASSERT_INT_WITHIN(1, -40, adc_auto_zero_update(&az, 40, true));
+}
+
+void auto_zero_ignores_actual_current()
+{
+    adc_auto_zero_t az;
+    adc_auto_zero_init(&az, 10);
+    TEST_ASSERT_EQUAL(-10, adc_auto_zero_update(&az, 10, true));
+
+    // switches on: offset is kept
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_EQUAL(-10, adc_auto_zero_update(&az, 3000, false));
+    }
+
+    // switches off, but reading too high for an offset
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_EQUAL(-10, adc_auto_zero_update(&az, 10 + ADC_AUTO_ZERO_LIMIT + 1, true));
+    }
+}
+
+void auto_zero_limits_drift()
+{
+    adc_auto_zero_t az;
+    adc_auto_zero_init(&az, 0);
+    for (int i = 0; i < 20 * (1 << ADC_AUTO_ZERO_SHIFT); i++) {
+        adc_auto_zero_update(&az, -ADC_AUTO_ZERO_LIMIT, true);
+    }
+    TEST_ASSERT_INT_WITHIN(1, ADC_AUTO_ZERO_LIMIT, adc_auto_zero_update(&az, -ADC_AUTO_ZERO_LIMIT, true));
+
+    // larger deviation is considered as actual current
+    for (int i = 0; i < 20 * (1 << ADC_AUTO_ZERO_SHIFT); i++) {
+        adc_auto_zero_update(&az, -ADC_AUTO_ZERO_LIMIT - 100, true);
+    }
+    TEST_ASSERT_INT_WITHIN(1, ADC_AUTO_ZERO_LIMIT, adc_auto_zero_update(&az, 0, false));
+}
+
+void auto_zero_tracks_drift_of_biased_sensor()
+{
+    // current sensor biased with 0.1 * Vcc (e.g. 3.3 A offset at zero current)
+    const int32_t bias = -3300;
+    adc_auto_zero_t az;
+    adc_auto_zero_init(&az, bias);
+    TEST_ASSERT_EQUAL(-bias, adc_auto_zero_update(&az, bias, false));
+
+    // actual current is not considered as drift
+    for (int i = 0; i < 1000; i++) {
+        TEST_ASSERT_EQUAL(-bias, adc_auto_zero_update(&az, bias + 2000, true));
+    }
+
+    // drift of 40 mA is compensated
+    for (int i = 0; i < 20 * (1 << ADC_AUTO_ZERO_SHIFT); i++) {
+        adc_auto_zero_update(&az, bias + 40, true);
+    }
+    TEST_ASSERT_INT_WITHIN(1, -bias - 40, adc_auto_zero_update(&az, bias + 40, true));
+
+    // drift limited around the calibrated offset
+    for (int i = 0; i < 20 * (1 << ADC_AUTO_ZERO_SHIFT); i++) {
+        adc_auto_zero_update(&az, bias - ADC_AUTO_ZERO_LIMIT, true);
+    }
+    TEST_ASSERT_INT_WITHIN(1, -bias + ADC_AUTO_ZERO_LIMIT, adc_auto_zero_update(&az, bias, false));
+}
+
+// temperature calculated with Beta equation as previously used in update_measurements()
+static double ntc_beta_temp(uint32_t raw, double r_series)
+{
+    double v_temp = (double)raw / (1 << ADC_CONV_BITS);
+    double rts = r_series * v_temp / (1.0 - v_temp);
+    return 1.0/(1.0/(273.15+25) + 1.0/NTC_BETA_VALUE*log(rts/10000.0)) - 273.15;
+}
+
+void ntc_lookup_table_matches_beta_equation()
+{
+    const int16_t *lut_bat = ntc_lut<(int)NTC_SERIES_RESISTOR, NTC_BETA_VALUE>::values;
+    const int16_t *lut_fets = ntc_lut<10000, NTC_BETA_VALUE>::values;
+
+    int num_checked = 0;
+    for (uint32_t raw = 1; raw < (1U << ADC_CONV_BITS); raw++) {
+        double temp = ntc_beta_temp(raw, NTC_SERIES_RESISTOR);
+        if (temp >= -40.0 && temp <= 125.0) {
+            TEST_ASSERT_FLOAT_WITHIN(0.1, temp, adc_conv_ntc_temp(lut_bat, raw) / 100.0);
+            num_checked++;
+        }
+        temp = ntc_beta_temp(raw, 10000);
+        if (temp >= -40.0 && temp <= 125.0) {
+            TEST_ASSERT_FLOAT_WITHIN(0.1, temp, adc_conv_ntc_temp(lut_fets, raw) / 100.0);
+        }
+    }
+    // make sure that the entire temperature range was covered
+    TEST_ASSERT(num_checked > (1 << ADC_CONV_BITS) / 2);
+}
+
+void ntc_lookup_table_limits()
+{
+    const int16_t *lut = ntc_lut<(int)NTC_SERIES_RESISTOR, NTC_BETA_VALUE>::values;
+
+    TEST_ASSERT_EQUAL(NTC_LUT_TEMP_MAX * 100, adc_conv_ntc_temp(lut, 0));
+    // open input (no external sensor connected) must result in very low temperature
+    TEST_ASSERT(adc_conv_ntc_temp(lut, (1 << ADC_CONV_BITS) - 1) < -5000);
+    TEST_ASSERT_EQUAL(NTC_LUT_TEMP_MIN * 100, adc_conv_ntc_temp(lut, 1 << ADC_CONV_BITS));
+}
+
+void raw_conversion_inverse_of_value_conversion()
+{
+    int32_t full_scale = adc_conv_full_scale(3300, ADC_Q16(ADC_GAIN_I_LOAD));
+    for (uint32_t raw = 100; raw < (1 << ADC_CONV_BITS); raw += 1000) {
+        int32_t value = adc_conv_value(raw, full_scale);
+        TEST_ASSERT_INT_WITHIN(1, raw, adc_conv_raw(value, full_scale));
+    }
+    TEST_ASSERT_EQUAL(0, adc_conv_raw(-100, full_scale));
+    TEST_ASSERT_EQUAL((1 << ADC_CONV_BITS) - 1, adc_conv_raw(full_scale * 2, full_scale));
+}
+
+// float type which counts the number of arithmetic operations and conversions, as they
+// are expensive software library calls on the target MCU without FPU
+static int float_ops;
+
+struct counted_float {
+    double v;
+    counted_float(double x) : v(x) {}                   // compile-time constant
+    counted_float(int32_t x) : v(x) { float_ops++; }    // int to float conversion
+};
+
+static counted_float operator*(counted_float a, counted_float b) { float_ops++; return a.v * b.v; }
+static counted_float operator/(counted_float a, counted_float b) { float_ops++; return a.v / b.v; }
+static counted_float operator+(counted_float a, counted_float b) { float_ops++; return a.v + b.v; }
+
+// volatile sink to prevent the compiler from optimizing the benchmark loops away
+static volatile double sink;
+
+// one cycle of update_measurements() before switching to fixed-point arithmetics
+static void update_cycle_float(const uint32_t raw[], uint32_t vref_raw)
+{
+    int vcc = 3000 * 1656 / (vref_raw >> (ADC_CONV_BITS - 12));
+    for (unsigned int g = 0; g < NUM_GAINS; g++) {
+        counted_float res = counted_float((int32_t)(((raw[g] >> (ADC_CONV_BITS - 12)) * vcc) / 4096))
+            * counted_float((double)gains[g]) / counted_float(1000.0)
+            + counted_float(0.0);     // current offset
+        sink = res.v;
+    }
+}
+
+// one cycle of update_measurements() using fixed-point arithmetics
+static void update_cycle_fixed(const uint32_t raw[], uint32_t vref_raw, const int32_t gain_q16[])
+{
+    int32_t vcc = adc_conv_vcc(vref_raw, 1656, 3000);
+    for (unsigned int g = 0; g < NUM_GAINS; g++) {
+        int32_t value = adc_conv_value(raw[g], adc_conv_full_scale(vcc, gain_q16[g])) + 0;
+        sink = (counted_float(value) * counted_float(0.001)).v;
+    }
+}
+
+void fixed_point_conversion_benchmark()
+{
+    const int cycles = 1000000;
+    int32_t gain_q16[NUM_GAINS];
+    uint32_t raw[NUM_GAINS];
+    for (unsigned int g = 0; g < NUM_GAINS; g++) {
+        gain_q16[g] = ADC_Q16(gains[g]);
+        raw[g] = 1000 + g * 3000;
+    }
+
+    float_ops = 0;
+    update_cycle_float(raw, 1656 << 2);
+    int ops_float = float_ops;
+
+    float_ops = 0;
+    update_cycle_fixed(raw, 1656 << 2, gain_q16);
+    int ops_fixed = float_ops;
+
+    clock_t start = clock();
+    for (int i = 0; i < cycles; i++) {
+        update_cycle_float(raw, (1656 << 2) + (i & 0xFF));
+    }
+    clock_t ticks_float = clock() - start;
+
+    start = clock();
+    for (int i = 0; i < cycles; i++) {
+        update_cycle_fixed(raw, (1656 << 2) + (i & 0xFF), gain_q16);
+    }
+    clock_t ticks_fixed = clock() - start;
+
+    // host timing is only indicative, as the host has an FPU (unlike the target MCU)
+    printf("ADC conversion benchmark (%d channels, %d cycles):\n", (int)NUM_GAINS, cycles);
+    printf("    float: %3d float ops/cycle, %8.2f ns/cycle\n", ops_float,
+        1e9 * ticks_float / CLOCKS_PER_SEC / cycles);
+    printf("    fixed: %3d float ops/cycle, %8.2f ns/cycle\n", ops_fixed,
+        1e9 * ticks_fixed / CLOCKS_PER_SEC / cycles);
+
+    TEST_ASSERT(ops_fixed * 2 <= ops_float);
+}
+
+void adc_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(fixed_point_vcc_matches_float);
+    RUN_TEST(fixed_point_conversion_at_least_as_accurate_as_float);
+    RUN_TEST(fixed_point_conversion_negative_offset);
+    RUN_TEST(channel_table_matches_single_conversions);
+    RUN_TEST(pwm_average_weighted_with_duty_cycle);
+    RUN_TEST(raw_conversion_inverse_of_value_conversion);
+    RUN_TEST(auto_zero_converges_slowly_after_delay);
+    RUN_TEST(auto_zero_ignores_actual_current);
+    RUN_TEST(auto_zero_limits_drift);
+    RUN_TEST(auto_zero_tracks_drift_of_biased_sensor);
+    RUN_TEST(ntc_lookup_table_matches_beta_equation);
+    RUN_TEST(ntc_lookup_table_limits);
+    RUN_TEST(fixed_point_conversion_benchmark);
+
+    UNITY_END();
+}
@@ -4,8 +4,8 @@
 #include "battery.h"
 #include "power_port.h"
 #include "charger.h"
+#include "hardware.h"
 
-#include <time.h>
 #include <stdio.h>
 
 extern battery_conf_t bat_conf;
@@ -30,7 +30,7 @@ void no_start_at_high_voltage()
 void no_start_after_short_rest()
 {
     init_structs();
-    bat_state.time_state_changed = time(NULL) - bat_conf.time_limit_recharge + 1;
+    bat_state.time_state_changed = uptime - bat_conf.time_limit_recharge + 1;
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_recharge - 0.1, 0);
     TEST_ASSERT_EQUAL(CHG_STATE_IDLE, bat_state.chg_state);
 }
@@ -50,7 +50,7 @@ void no_start_outside_temperature_limits()
 void start_if_everything_just_fine()
 {
     init_structs();
-    bat_state.time_state_changed = time(NULL) - bat_conf.time_limit_recharge - 1;
+    bat_state.time_state_changed = uptime - bat_conf.time_limit_recharge - 1;
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_recharge - 0.1, 0);
     TEST_ASSERT_EQUAL(CHG_STATE_BULK, bat_state.chg_state);
 }
@@ -58,7 +58,7 @@ void start_if_everything_just_fine()
 void enter_topping_at_voltage_setpoint()
 {
     init_structs();
-    bat_state.time_state_changed = time(NULL) - bat_conf.time_limit_recharge - 1;
+    bat_state.time_state_changed = uptime - bat_conf.time_limit_recharge - 1;
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_recharge - 0.1, 0);
     TEST_ASSERT_EQUAL(CHG_STATE_BULK, bat_state.chg_state);
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_topping + 0.1, 0);
@@ -69,11 +69,11 @@ void stop_topping_after_time_limit()
 {
     enter_topping_at_voltage_setpoint();
 
-    bat_state.time_state_changed = time(NULL) - bat_conf.time_limit_topping + 1;
+    bat_state.time_state_changed = uptime - bat_conf.time_limit_topping + 1;
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_topping + 0.1, bat_conf.current_cutoff_topping + 0.1);
     TEST_ASSERT_EQUAL(CHG_STATE_TOPPING, bat_state.chg_state);
 
-    bat_state.time_state_changed = time(NULL) - bat_conf.time_limit_topping - 1;
+    bat_state.time_state_changed = uptime - bat_conf.time_limit_topping - 1;
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_topping + 0.1, bat_conf.current_cutoff_topping + 0.1);
     TEST_ASSERT_EQUAL(CHG_STATE_TRICKLE, bat_state.chg_state);
 }
@@ -82,7 +82,7 @@ void stop_topping_at_cutoff_current()
 {
     enter_topping_at_voltage_setpoint();
 
-    bat_state.time_state_changed = time(NULL) - 1;
+    bat_state.time_state_changed = uptime - 1;
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_topping + 0.1, bat_conf.current_cutoff_topping - 0.1);
     TEST_ASSERT_EQUAL(CHG_STATE_TRICKLE, bat_state.chg_state);
 }
@@ -92,7 +92,7 @@ void trickle_to_idle_for_li_ion()
     enter_topping_at_voltage_setpoint();
     battery_conf_init(&bat_conf, BAT_TYPE_LFP, 4, 100);
 
-    bat_state.time_state_changed = time(NULL) - 1;
+    bat_state.time_state_changed = uptime - 1;
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_topping + 0.1, bat_conf.current_cutoff_topping - 0.1);
     TEST_ASSERT_EQUAL(CHG_STATE_IDLE, bat_state.chg_state);
 }
@@ -102,7 +102,7 @@ void trickle_to_equalization_if_enabled()
     enter_topping_at_voltage_setpoint();
     bat_conf.equalization_enabled = true;
 
-    bat_state.time_state_changed = time(NULL) - 1;
+    bat_state.time_state_changed = uptime - 1;
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_topping + 0.1, bat_conf.current_cutoff_topping - 0.1);
     TEST_ASSERT_EQUAL(CHG_STATE_EQUALIZATION, bat_state.chg_state);
 }
@@ -111,12 +111,12 @@ void no_trickle_if_low_current_because_of_low_input()
 {
     enter_topping_at_voltage_setpoint();
 
-    bat_state.time_state_changed = time(NULL) - 200;
-    bat_state.time_voltage_limit_reached = time(NULL) - 3;
+    bat_state.time_state_changed = uptime - 200;
+    bat_state.time_voltage_limit_reached = uptime - 3;
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_topping - 0.1, bat_conf.current_cutoff_topping - 0.1);
     TEST_ASSERT_EQUAL(CHG_STATE_TOPPING, bat_state.chg_state);
 
-    bat_state.time_voltage_limit_reached = time(NULL) - 1;
+    bat_state.time_voltage_limit_reached = uptime - 1;
     charger_state_machine(&ls_port, &bat_conf, &bat_state, bat_conf.voltage_topping - 0.1, bat_conf.current_cutoff_topping - 0.1);
     TEST_ASSERT_EQUAL(CHG_STATE_TRICKLE, bat_state.chg_state);
 }
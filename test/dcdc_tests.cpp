@@ -0,0 +1,475 @@
+
+#include "tests.h"
+
+#include "dcdc.h"
+#include "mppt.h"
+#include "half_bridge.h"
+#include "battery.h"
+#include "power_port.h"
+#include "log.h"
+#include "pcb.h"
+
+extern log_data_t log_data;
+
+static dcdc_t dcdc_fast;
+
+static void init_fast_control(bool buck)
+{
+    dcdc_init(&dcdc_fast);
+    half_bridge_init(&dcdc_fast.half_bridge, 1, 70, 300, 0.1, 0.97);
+    dcdc_fast.duty_base = 0.5 * 65536;
+    dcdc_fast.fast_buck = buck;
+    dcdc_fast.fast_voltage_max = 14400;
+    dcdc_fast.fast_current_max = 10000;
+    half_bridge_start(&dcdc_fast.half_bridge, dcdc_fast.duty_base / 65536.0);
+}
+
+void fast_control_applies_base_duty_within_limits()
+{
+    init_fast_control(true);
+    dcdc_fast_meas_t meas = { 20000, 13000, -4000, 6000, 0 };
+    for (int i = 0; i < 100; i++) {
+        dcdc_fast_control(&dcdc_fast, &meas);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(0.5, half_bridge_get_duty_cycle(&dcdc_fast.half_bridge));
+    TEST_ASSERT_EQUAL(0, dcdc_fast.pi_voltage.integral);
+    TEST_ASSERT_EQUAL(0, dcdc_fast.pi_current.integral);
+}
+
+void fast_control_reduces_duty_at_voltage_overshoot_in_buck_mode()
+{
+    init_fast_control(true);
+    dcdc_fast_meas_t meas = { 20000, 14900, -4000, 6000, 0 };
+    dcdc_fast_control(&dcdc_fast, &meas);
+    float duty_first = half_bridge_get_duty_cycle(&dcdc_fast.half_bridge);
+    TEST_ASSERT(duty_first < 0.5);
+
+    // integral part continues to reduce the duty cycle while overshoot persists
+    for (int i = 0; i < 10; i++) {
+        dcdc_fast_control(&dcdc_fast, &meas);
+    }
+    TEST_ASSERT(half_bridge_get_duty_cycle(&dcdc_fast.half_bridge) < duty_first);
+
+    // back to base duty cycle after the overshoot
+    meas.ls_voltage = 14000;
+    for (int i = 0; i < 1000; i++) {
+        dcdc_fast_control(&dcdc_fast, &meas);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(0.5, half_bridge_get_duty_cycle(&dcdc_fast.half_bridge));
+}
+
+void fast_control_increases_duty_at_current_overshoot_in_boost_mode()
+{
+    init_fast_control(false);
+    dcdc_fast.fast_voltage_max = 48000;
+    dcdc_fast_meas_t meas = { 40000, 30000, 12000, -16000, 0 };
+    for (int i = 0; i < 10; i++) {
+        dcdc_fast_control(&dcdc_fast, &meas);
+    }
+    TEST_ASSERT(half_bridge_get_duty_cycle(&dcdc_fast.half_bridge) > 0.5);
+    TEST_ASSERT(dcdc_fast.pi_current.integral > 0);
+    TEST_ASSERT_EQUAL(0, dcdc_fast.pi_voltage.integral);
+}
+
+void fast_control_resets_integrators_if_stopped()
+{
+    init_fast_control(true);
+    dcdc_fast_meas_t meas = { 20000, 14900, -4000, 6000, 0 };
+    dcdc_fast_control(&dcdc_fast, &meas);
+    TEST_ASSERT(dcdc_fast.pi_voltage.integral > 0);
+
+    half_bridge_stop(&dcdc_fast.half_bridge);
+    dcdc_fast_control(&dcdc_fast, &meas);
+    TEST_ASSERT_EQUAL(0, dcdc_fast.pi_voltage.integral);
+}
+
+void fast_control_handles_unset_limits_without_overflow()
+{
+    init_fast_control(false);
+    dcdc_fast.fast_voltage_max = INT32_MAX;
+    dcdc_fast.fast_current_max = INT32_MAX;
+
+    // reverse current, deviation from the unset limit exceeds the int32 range
+    dcdc_fast_meas_t meas = { 40000, 30000, -12000, 16000, 0 };
+    for (int i = 0; i < 100; i++) {
+        dcdc_fast_control(&dcdc_fast, &meas);
+    }
+    TEST_ASSERT_EQUAL_FLOAT(0.5, half_bridge_get_duty_cycle(&dcdc_fast.half_bridge));
+    TEST_ASSERT_EQUAL(0, dcdc_fast.pi_voltage.integral);
+    TEST_ASSERT_EQUAL(0, dcdc_fast.pi_current.integral);
+
+    // large overshoot saturates the reduction instead of wrapping around
+    dcdc_fast.fast_voltage_max = INT32_MIN;
+    dcdc_fast_control(&dcdc_fast, &meas);
+    TEST_ASSERT_FLOAT_WITHIN(half_bridge_get_duty_step(), 0.97,
+        half_bridge_get_duty_cycle(&dcdc_fast.half_bridge));
+    TEST_ASSERT_EQUAL((1 << 16) << DCDC_PI_SHIFT, dcdc_fast.pi_voltage.integral);
+    half_bridge_stop(&dcdc_fast.half_bridge);
+}
+
+void vmpp_ratio_learned_with_temperature_dependency()
+{
+    dcdc_t dcdc_learn;
+    dcdc_init(&dcdc_learn);
+
+    // real panel: ratio 0.78 at 25°C, -0.001 per K
+    for (int i = 0; i < 100; i++) {
+        float temp = (i % 2) ? 0 : 50;
+        dcdc_vmpp_ratio_learn(&dcdc_learn, 0.78 - 0.001 * (temp - 25), temp);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.002, 0.78, dcdc_vmpp_ratio(&dcdc_learn, 25));
+    TEST_ASSERT_FLOAT_WITHIN(0.002, 0.805, dcdc_vmpp_ratio(&dcdc_learn, 0));
+    TEST_ASSERT_FLOAT_WITHIN(0.002, 0.755, dcdc_vmpp_ratio(&dcdc_learn, 50));
+}
+
+void vmpp_ratio_ignores_implausible_values()
+{
+    dcdc_t dcdc_learn;
+    dcdc_init(&dcdc_learn);
+    float ratio = dcdc_vmpp_ratio(&dcdc_learn, 25);
+
+    // e.g. global MPP at low voltage because of partial shading
+    dcdc_vmpp_ratio_learn(&dcdc_learn, 0.5, 25);
+    TEST_ASSERT_EQUAL_FLOAT(ratio, dcdc_vmpp_ratio(&dcdc_learn, 25));
+}
+
+void buck_start_uses_learned_vmpp_ratio()
+{
+    dcdc_t dcdc_start;
+    power_port_t hs = {};
+    power_port_t ls = {};
+    battery_conf_t bat;
+
+    battery_conf_init(&bat, BAT_TYPE_GEL, 6, 100);
+    power_port_init_solar(&hs);
+    power_port_init_bat(&ls, &bat);
+    dcdc_init(&dcdc_start);
+    half_bridge_init(&dcdc_start.half_bridge, 1, 70, 300, 0.1, 0.97);
+    half_bridge_stop(&dcdc_start.half_bridge);
+
+    dcdc_start.vmpp_ratio = 0.75;
+    dcdc_start.temp_mosfets = 25;
+    hs.voltage = 40.0;
+    ls.voltage = 12.0;
+    dcdc_control(&dcdc_start, &hs, &ls);
+
+    TEST_ASSERT(half_bridge_enabled(&dcdc_start.half_bridge));
+    TEST_ASSERT_EQUAL_FLOAT(40.0, dcdc_start.voc_start);
+    TEST_ASSERT_FLOAT_WITHIN(0.005, 12.0 / (40.0 * 0.75), dcdc_start.duty_base / 65536.0);
+    half_bridge_stop(&dcdc_start.half_bridge);
+}
+
+void vmpp_ratio_learned_with_temperature_at_start()
+{
+    dcdc_t dcdc_start;
+    dcdc_t dcdc_expected;
+    power_port_t hs = {};
+    power_port_t ls = {};
+    battery_conf_t bat;
+
+    battery_conf_init(&bat, BAT_TYPE_GEL, 6, 100);
+    power_port_init_solar(&hs);
+    power_port_init_bat(&ls, &bat);
+    dcdc_init(&dcdc_start);
+    dcdc_init(&dcdc_expected);
+    half_bridge_init(&dcdc_start.half_bridge, 1, 70, 300, 0.1, 0.97);
+    half_bridge_stop(&dcdc_start.half_bridge);
+
+    dcdc_start.temp_mosfets = 10;
+    hs.voltage = 40.0;
+    ls.voltage = 12.0;
+    dcdc_control(&dcdc_start, &hs, &ls);
+    TEST_ASSERT_EQUAL_FLOAT(10, dcdc_start.temp_start);
+
+    // MOSFETs heat up during tracking
+    dcdc_start.temp_mosfets = 60;
+    hs.voltage = 30.0;
+    hs.current = -3.0;
+    ls.current = 7.0;
+    for (int i = 0; i < DCDC_VMPP_LEARN_CYCLES; i++) {
+        dcdc_control(&dcdc_start, &hs, &ls);
+    }
+    TEST_ASSERT_EQUAL(DCDC_STATE_MPPT, dcdc_start.state);
+
+    dcdc_vmpp_ratio_learn(&dcdc_expected, 30.0 / 40.0, 10);
+    TEST_ASSERT_EQUAL_FLOAT(dcdc_expected.vmpp_ratio, dcdc_start.vmpp_ratio);
+    TEST_ASSERT_EQUAL_FLOAT(dcdc_expected.vmpp_ratio_tc, dcdc_start.vmpp_ratio_tc);
+    half_bridge_stop(&dcdc_start.half_bridge);
+}
+
+void cv_control_uses_fine_duty_step()
+{
+    dcdc_t dcdc_cv;
+    power_port_t hs = {};
+    power_port_t ls = {};
+    battery_conf_t bat;
+
+    battery_conf_init(&bat, BAT_TYPE_GEL, 6, 100);
+    power_port_init_solar(&hs);
+    power_port_init_bat(&ls, &bat);
+    dcdc_init(&dcdc_cv);
+    half_bridge_init(&dcdc_cv.half_bridge, 1, 70, 300, 0.1, 0.97);
+    dcdc_cv.duty_base = 0.7 * 65536;
+    half_bridge_start(&dcdc_cv.half_bridge, dcdc_cv.duty_base / 65536.0);
+
+    // battery voltage above target
+    hs.voltage = 20.0;
+    hs.current = -3.0;
+    ls.voltage = ls.voltage_output_target + 0.1;
+    ls.current = 4.0;
+    dcdc_control(&dcdc_cv, &hs, &ls);
+
+    TEST_ASSERT_EQUAL(DCDC_STATE_CV, dcdc_cv.state);
+    TEST_ASSERT(half_bridge_get_duty_step() < 2.0 / half_bridge_get_period_clocks());
+    TEST_ASSERT_FLOAT_WITHIN(1.0 / 65536, 0.7 - half_bridge_get_duty_step(),
+        dcdc_cv.duty_base / 65536.0);
+    half_bridge_stop(&dcdc_cv.half_bridge);
+}
+
+void mppt_step_size_reset_after_cv()
+{
+    dcdc_t dcdc_cv;
+    power_port_t hs = {};
+    power_port_t ls = {};
+    battery_conf_t bat;
+
+    battery_conf_init(&bat, BAT_TYPE_GEL, 6, 100);
+    power_port_init_solar(&hs);
+    power_port_init_bat(&ls, &bat);
+    dcdc_init(&dcdc_cv);
+    dcdc_cv.mppt_adaptive = true;
+    half_bridge_init(&dcdc_cv.half_bridge, 1, 70, 300, 0.1, 0.97);
+    dcdc_cv.duty_base = 0.7 * 65536;
+    half_bridge_start(&dcdc_cv.half_bridge, dcdc_cv.duty_base / 65536.0);
+
+    hs.voltage = 20.0;
+    hs.current = -3.0;
+    ls.voltage = ls.voltage_output_target + 0.1;
+    ls.current = 4.0;
+    dcdc_control(&dcdc_cv, &hs, &ls);
+    TEST_ASSERT_EQUAL(DCDC_STATE_CV, dcdc_cv.state);
+
+    // state of an MPPT phase before the CV phase
+    dcdc_cv.power = 100;
+    dcdc_cv.mppt_step = MPPT_PO_STEP_MAX;
+    dcdc_cv.pwm_delta = 1;
+
+    // load switched on: battery voltage drops below target
+    ls.voltage = ls.voltage_output_target - 1.0;
+    dcdc_control(&dcdc_cv, &hs, &ls);
+    TEST_ASSERT_EQUAL(DCDC_STATE_MPPT, dcdc_cv.state);
+    TEST_ASSERT_EQUAL(1, dcdc_cv.mppt_step);
+    TEST_ASSERT_EQUAL(-1, dcdc_cv.pwm_delta);   // not straight back into the limit
+    half_bridge_stop(&dcdc_cv.half_bridge);
+}
+
+void light_load_enables_diode_emulation_and_burst_mode()
+{
+    dcdc_t dcdc_ll;
+    power_port_t hs = {};
+    power_port_t ls = {};
+    battery_conf_t bat;
+
+    battery_conf_init(&bat, BAT_TYPE_GEL, 6, 100);
+    power_port_init_solar(&hs);
+    power_port_init_bat(&ls, &bat);
+    dcdc_init(&dcdc_ll);
+    dcdc_ll.mode = MODE_MPPT_BUCK;
+    half_bridge_init(&dcdc_ll.half_bridge, 1, 70, 300, 0.1, 0.97);
+    dcdc_ll.duty_base = 0.7 * 65536;
+    half_bridge_start(&dcdc_ll.half_bridge, dcdc_ll.duty_base / 65536.0);
+
+    hs.voltage = 20.0;
+    ls.voltage = 13.0;
+    // burst mode is left one cycle before diode emulation after a step of the current
+    const float currents[] = { 0.3, 0.2, 0.6, 1.2, 0.2, 1.2, 1.2 };
+    const bool diode_emulation[] = { true, true, true, false, true, true, false };
+    const bool burst[] = { false, true, false, false, true, false, false };
+    for (int i = 0; i < 7; i++) {
+        ls.current = currents[i];
+        dcdc_ll.ls_current = currents[i];
+        hs.current = -ls.current * ls.voltage / hs.voltage;
+        dcdc_control(&dcdc_ll, &hs, &ls);
+        TEST_ASSERT_EQUAL(diode_emulation[i], dcdc_ll.diode_emulation);
+        TEST_ASSERT_EQUAL(burst[i], dcdc_ll.burst);
+    }
+
+    // large load current: low battery current, but high DC/DC current
+    ls.current = 0.2;
+    dcdc_ll.ls_current = 5.2;
+    hs.current = -dcdc_ll.ls_current * ls.voltage / hs.voltage;
+    dcdc_control(&dcdc_ll, &hs, &ls);
+    TEST_ASSERT_EQUAL(false, dcdc_ll.diode_emulation);
+    TEST_ASSERT_EQUAL(false, dcdc_ll.burst);
+
+    // disabled after stop
+    dcdc_ll.ls_current = 0.2;
+    dcdc_control(&dcdc_ll, &hs, &ls);
+    half_bridge_stop(&dcdc_ll.half_bridge);
+    dcdc_control(&dcdc_ll, &hs, &ls);
+    TEST_ASSERT_EQUAL(false, dcdc_ll.diode_emulation);
+    TEST_ASSERT_EQUAL(false, dcdc_ll.burst);
+}
+
+void overcurrent_trip_stops_dcdc_and_is_logged()
+{
+    dcdc_t dcdc_trip;
+    power_port_t hs = {};
+    power_port_t ls = {};
+    battery_conf_t bat;
+
+    battery_conf_init(&bat, BAT_TYPE_GEL, 6, 100);
+    power_port_init_solar(&hs);
+    power_port_init_bat(&ls, &bat);
+    dcdc_init(&dcdc_trip);
+    half_bridge_init(&dcdc_trip.half_bridge, 1, 70, 300, 0.1, 0.97);
+    dcdc_trip.duty_base = 0.7 * 65536;
+    half_bridge_start(&dcdc_trip.half_bridge, dcdc_trip.duty_base / 65536.0);
+    uint32_t trip_count = log_data.dcdc_trip_count;
+
+    // e.g. called by analog watchdog interrupt
+    half_bridge_trip();
+    TEST_ASSERT(half_bridge_tripped(&dcdc_trip.half_bridge));
+
+    hs.voltage = 20.0;
+    ls.voltage = 13.0;
+    dcdc_control(&dcdc_trip, &hs, &ls);
+
+    TEST_ASSERT_EQUAL(false, half_bridge_enabled(&dcdc_trip.half_bridge));
+    TEST_ASSERT_EQUAL(DCDC_STATE_OFF, dcdc_trip.state);
+    TEST_ASSERT(log_data.error_flags & (1 << ERR_DCDC_OVERCURRENT));
+    TEST_ASSERT_EQUAL(trip_count + 1, log_data.dcdc_trip_count);
+
+    // trip state is reset by next start
+    half_bridge_start(&dcdc_trip.half_bridge, 0.5);
+    TEST_ASSERT_EQUAL(false, half_bridge_tripped(&dcdc_trip.half_bridge));
+    half_bridge_stop(&dcdc_trip.half_bridge);
+    log_data.error_flags &= ~(1 << ERR_DCDC_OVERCURRENT);
+}
+
+void converters_with_own_half_bridges_are_independent()
+{
+    dcdc_t stage[2];
+    for (int i = 0; i < 2; i++) {
+        dcdc_init(&stage[i]);
+        half_bridge_init(&stage[i].half_bridge, i + 1, 70, 300, 0.1, 0.97);
+    }
+
+    half_bridge_start(&stage[0].half_bridge, 0.4);
+    TEST_ASSERT_EQUAL(true, half_bridge_enabled(&stage[0].half_bridge));
+    TEST_ASSERT_EQUAL(false, half_bridge_enabled(&stage[1].half_bridge));
+
+    half_bridge_start(&stage[1].half_bridge, 0.6);
+    half_bridge_duty_cycle_step(&stage[1].half_bridge, 16);
+    TEST_ASSERT_FLOAT_WITHIN(0.001, 0.4, half_bridge_get_duty_cycle(&stage[0].half_bridge));
+    TEST_ASSERT(half_bridge_get_duty_cycle(&stage[1].half_bridge) > 0.6);
+
+    // break of the timer affects all running stages
+    half_bridge_stop(&stage[1].half_bridge);
+    half_bridge_trip();
+    TEST_ASSERT_EQUAL(true, half_bridge_tripped(&stage[0].half_bridge));
+    TEST_ASSERT_EQUAL(false, half_bridge_tripped(&stage[1].half_bridge));
+    half_bridge_start(&stage[1].half_bridge, 0.6);
+    TEST_ASSERT_EQUAL(true, half_bridge_tripped(&stage[0].half_bridge));
+    TEST_ASSERT_EQUAL(false, half_bridge_tripped(&stage[1].half_bridge));
+
+    half_bridge_stop(&stage[0].half_bridge);
+    half_bridge_stop(&stage[1].half_bridge);
+}
+
+// average inductor current over one switching period
+static float stub_current_avg(const half_bridge_t *hb, float r_ohm)
+{
+    float sum = 0;
+    for (int i = 0; i < 100; i++) {
+        sum += half_bridge_stub_current(hb, 40.0, 13.0, r_ohm, 33, i / 100.0);
+    }
+    return sum / 100;
+}
+
+static void init_interleaved()
+{
+    init_fast_control(true);
+    dcdc_fast.fast_current_max = 100000;
+    dcdc_fast.duty_base = 0.35 * 65536;
+    half_bridge_init(&dcdc_fast.half_bridge_2, 2, 70, 300, 0.1, 0.97);
+    dcdc_init_interleaved(&dcdc_fast);
+    half_bridge_start(&dcdc_fast.half_bridge, dcdc_fast.duty_base / 65536.0);
+    half_bridge_start(&dcdc_fast.half_bridge_2, dcdc_fast.duty_base / 65536.0);
+}
+
+void interleaved_phases_are_balanced_with_mismatched_resistance()
+{
+    init_interleaved();
+
+    // second phase has higher resistance, so it carries less current with equal duty cycle
+    dcdc_fast_meas_t meas_zero = { 40000, 13000, 0, 0, 0 };
+    dcdc_fast_control(&dcdc_fast, &meas_zero);
+    float i1 = stub_current_avg(&dcdc_fast.half_bridge, 0.05);
+    float i2 = stub_current_avg(&dcdc_fast.half_bridge_2, 0.08);
+    TEST_ASSERT(i1 - i2 > 5.0);
+
+    for (int i = 0; i < 500; i++) {
+        dcdc_fast_meas_t meas = { 40000, 13000, 0, (int32_t)((i1 + i2) * 1000),
+            (int32_t)((i1 - i2) * 1000) };
+        dcdc_fast_control(&dcdc_fast, &meas);
+        i1 = stub_current_avg(&dcdc_fast.half_bridge, 0.05);
+        i2 = stub_current_avg(&dcdc_fast.half_bridge_2, 0.08);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.5, i1, i2);
+    TEST_ASSERT(half_bridge_get_duty_cycle(&dcdc_fast.half_bridge)
+        < half_bridge_get_duty_cycle(&dcdc_fast.half_bridge_2));
+
+    // balancing starts from zero after stop
+    half_bridge_stop(&dcdc_fast.half_bridge);
+    dcdc_fast_control(&dcdc_fast, &meas_zero);
+    TEST_ASSERT_EQUAL(0, dcdc_fast.pi_balance.integral);
+    half_bridge_stop(&dcdc_fast.half_bridge_2);
+}
+
+void interleaved_phases_reduce_current_ripple()
+{
+    init_interleaved();
+
+    float ripple[2];
+    for (int shifted = 0; shifted < 2; shifted++) {
+        half_bridge_set_phase_shift(&dcdc_fast.half_bridge_2, shifted);
+        float i_min = 1000;
+        float i_max = -1000;
+        for (int i = 0; i < 100; i++) {
+            float i_sum = half_bridge_stub_current(&dcdc_fast.half_bridge, 40.0, 13.0, 0.05, 33, i / 100.0)
+                + half_bridge_stub_current(&dcdc_fast.half_bridge_2, 40.0, 13.0, 0.05, 33, i / 100.0);
+            i_min = (i_sum < i_min) ? i_sum : i_min;
+            i_max = (i_sum > i_max) ? i_sum : i_max;
+        }
+        ripple[shifted] = i_max - i_min;
+    }
+    TEST_ASSERT(ripple[1] < ripple[0] / 2);
+
+    half_bridge_stop(&dcdc_fast.half_bridge);
+    half_bridge_stop(&dcdc_fast.half_bridge_2);
+}
+
+void dcdc_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(fast_control_applies_base_duty_within_limits);
+    RUN_TEST(fast_control_reduces_duty_at_voltage_overshoot_in_buck_mode);
+    RUN_TEST(fast_control_increases_duty_at_current_overshoot_in_boost_mode);
+    RUN_TEST(fast_control_resets_integrators_if_stopped);
+    RUN_TEST(fast_control_handles_unset_limits_without_overflow);
+    RUN_TEST(vmpp_ratio_learned_with_temperature_dependency);
+    RUN_TEST(vmpp_ratio_ignores_implausible_values);
+    RUN_TEST(buck_start_uses_learned_vmpp_ratio);
+    RUN_TEST(vmpp_ratio_learned_with_temperature_at_start);
+    RUN_TEST(cv_control_uses_fine_duty_step);
+    RUN_TEST(mppt_step_size_reset_after_cv);
+    RUN_TEST(light_load_enables_diode_emulation_and_burst_mode);
+    RUN_TEST(overcurrent_trip_stops_dcdc_and_is_logged);
+    RUN_TEST(converters_with_own_half_bridges_are_independent);
+    RUN_TEST(interleaved_phases_are_balanced_with_mismatched_resistance);
+    RUN_TEST(interleaved_phases_reduce_current_ripple);
+
+    UNITY_END();
+}
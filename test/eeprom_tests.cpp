@@ -0,0 +1,122 @@
+
+#include "tests.h"
+
+#include "eeprom.h"
+#include "data_objects.h"
+
+#include <string.h>
+
+static const data_object_t *find_object(uint16_t id)
+{
+    for (size_t i = 0; i < num_data_objects; i++) {
+        if (data_objects[i].id == id) {
+            return &data_objects[i];
+        }
+    }
+    return NULL;
+}
+
+// size of the variable in RAM (0 for types not allowed in the EEPROM)
+static size_t value_size(const data_object_t *obj)
+{
+    switch (obj->type) {
+        case TS_T_BOOL:
+            return sizeof(bool);
+        case TS_T_UINT16:
+        case TS_T_INT16:
+            return 2;
+        case TS_T_UINT32:
+        case TS_T_INT32:
+        case TS_T_FLOAT32:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// sets the value with the longest CBOR encoding of the type (made unique by n)
+static void set_value_max(const data_object_t *obj, int n)
+{
+    switch (obj->type) {
+        case TS_T_BOOL:
+            *(bool *)obj->data = true;
+            break;
+        case TS_T_UINT16:
+            *(uint16_t *)obj->data = UINT16_MAX - n;
+            break;
+        case TS_T_INT16:
+            *(int16_t *)obj->data = INT16_MIN + n;
+            break;
+        case TS_T_UINT32:
+            *(uint32_t *)obj->data = UINT32_MAX - n;
+            break;
+        case TS_T_INT32:
+            *(int32_t *)obj->data = INT32_MIN + n;
+            break;
+        case TS_T_FLOAT32:
+            *(float *)obj->data = 1000000 + n;
+            break;
+    }
+}
+
+void eeprom_objects_fit_into_buffer()
+{
+    for (size_t i = 0; i < num_eeprom_data_objects; i++) {
+        const data_object_t *obj = find_object(eeprom_data_objects[i]);
+        TEST_ASSERT(obj != NULL);
+
+        // CBOR: ID as unsigned int, value with 1 byte header
+        size_t id_size = (obj->id < 24) ? 1 : (obj->id <= 0xFF ? 2 : 3);
+        TEST_ASSERT(value_size(obj) > 0);
+        TEST_ASSERT(id_size + 1 + value_size(obj) <= EEPROM_OBJECT_SIZE_MAX);
+
+        for (size_t j = 0; j < i; j++) {
+            TEST_ASSERT(eeprom_data_objects[j] != eeprom_data_objects[i]);
+        }
+    }
+}
+
+void eeprom_store_restore_all_objects()
+{
+    static uint8_t original[256][4];
+    static uint8_t stored[256][4];
+    TEST_ASSERT(num_eeprom_data_objects <= 256);
+
+    for (size_t i = 0; i < num_eeprom_data_objects; i++) {
+        const data_object_t *obj = find_object(eeprom_data_objects[i]);
+        memcpy(original[i], obj->data, value_size(obj));
+        set_value_max(obj, i);
+        memcpy(stored[i], obj->data, value_size(obj));
+    }
+
+    eeprom_store_data();
+
+    // header contains length of stored data
+    uint8_t header[8];
+    eeprom_read(0, header, sizeof(header));
+    uint16_t len = header[2] | header[3] << 8;
+    TEST_ASSERT(len > num_eeprom_data_objects * 2);
+
+    for (size_t i = 0; i < num_eeprom_data_objects; i++) {
+        const data_object_t *obj = find_object(eeprom_data_objects[i]);
+        memset(obj->data, 0, value_size(obj));
+    }
+
+    eeprom_restore_data();
+
+    for (size_t i = 0; i < num_eeprom_data_objects; i++) {
+        const data_object_t *obj = find_object(eeprom_data_objects[i]);
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(stored[i], obj->data, value_size(obj));
+        memcpy(obj->data, original[i], value_size(obj));
+    }
+}
+
+void eeprom_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(eeprom_objects_fit_into_buffer);
+    RUN_TEST(eeprom_store_restore_all_objects);
+
+    UNITY_END();
+}
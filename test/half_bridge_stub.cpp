@@ -14,92 +14,149 @@
  * limitations under the License.
  */
 
-#include "half_bridge.h"
+#include "half_bridge_driver.h"
 #include "pcb.h"
 #include "config.h"
 
+#include "tests.h"
 
-static int _pwm_resolution;
-static float _min_duty;
-static float _max_duty;
+#include <string.h>
 
-static bool _enabled;
+#define HISTORY_SIZE 1024
 
-void _init_registers(int freq_kHz, int deadtime_ns)
-{
-}
+static int _pwm_resolution;
+static unsigned int _trip_count;
 
-void half_bridge_init(int freq_kHz, int deadtime_ns, float min_duty, float max_duty)
-{
-    _init_registers(freq_kHz, deadtime_ns);
+// ring buffer of compare values written by the driver
+static struct {
+    const half_bridge_t *hb;
+    int ccr_fine;
+} _history[HISTORY_SIZE];
+static unsigned int _history_count;
 
-    _min_duty = min_duty;
-    _max_duty = max_duty;
-    half_bridge_set_duty_cycle(_max_duty);      // init with allowed value
+// names of the configuration hooks in the order of their calls
+static char _config_log[256];
 
-    _enabled = false;
+static void log_config(const char *hook)
+{
+    if (strlen(_config_log) + strlen(hook) + 2 < sizeof(_config_log)) {
+        if (_config_log[0] != '\0') {
+            strcat(_config_log, " ");
+        }
+        strcat(_config_log, hook);
+    }
 }
 
-void half_bridge_set_duty_cycle(float duty)
+// host backend with the timer clock of STM32F0 (48 MHz), recording all duty cycle updates
+struct HalfBridgeHost : HalfBridgeDriver<HalfBridgeHost>
 {
-    float duty_target;
-    // protection against wrong settings which could destroy the hardware
-    if (duty < _min_duty) {
-        duty_target = _min_duty;
+    static int resolution()
+    {
+        return _pwm_resolution;
     }
-    else if (duty > _max_duty) {
-        duty_target = _max_duty;
-    }
-    else {
-        duty_target = duty;
+
+    static unsigned int trip_count()
+    {
+        return _trip_count;
     }
 
-    //TIM1->CCR1 = _pwm_resolution / 2 * duty_target;
-}
+    static void init_timer(int freq_kHz, int)
+    {
+        _pwm_resolution = 48000 / freq_kHz;
+        log_config("init_timer");
+    }
 
-void half_bridge_duty_cycle_step(int delta)
-{
-    float duty_target;
-    //duty_target = (float)(TIM1->CCR1 + delta) / (_pwm_resolution / 2);
+    static void init_channel(int)
+    {
+        log_config("init_channel");
+    }
 
-    // protection against wrong settings which could destroy the hardware
-    if (duty_target < _min_duty) {
-        half_bridge_set_duty_cycle(_min_duty);
+    static void lock()
+    {
+        log_config("lock");
     }
-    else if (duty_target > _max_duty) {
-        half_bridge_set_duty_cycle(_max_duty);
+
+    static void write_sequence(half_bridge_t *, int, int) {}
+
+    static void write_compare(half_bridge_t *hb, int)
+    {
+        _history[_history_count % HISTORY_SIZE].hb = hb;
+        _history[_history_count % HISTORY_SIZE].ccr_fine = hb->ccr_fine;
+        _history_count++;
     }
-    else {
-        //TIM1->CCR1 = TIM1->CCR1 + delta;
+
+    static void set_outputs(half_bridge_t *, bool, bool) {}
+
+    static void set_pwm_mode2(half_bridge_t *, bool)
+    {
+        log_config("set_pwm_mode2");
     }
+};
+
+void half_bridge_trip()
+{
+    _trip_count++;
 }
 
-float half_bridge_get_duty_cycle()
+int half_bridge_get_period_clocks()
 {
-    return 0;//(float)(TIM1->CCR1) / (_pwm_resolution / 2);;
+    return _pwm_resolution;
 }
 
-void half_bridge_start(float pwm_duty)
+int half_bridge_get_phase_clocks()
 {
-    half_bridge_set_duty_cycle(pwm_duty);
+    return 0;
+}
 
-    // Break and Dead-Time Register
-    // MOE  = 1: Main output enable
-    //TIM1->BDTR |= TIM_BDTR_MOE;
+HALF_BRIDGE_DEFINE_API(HalfBridgeHost)
 
-    _enabled = true;
+int half_bridge_host_history(const half_bridge_t *hb, float *duty, int max_entries)
+{
+    unsigned int first = (_history_count > HISTORY_SIZE) ? _history_count - HISTORY_SIZE : 0;
+    int num = 0;
+    for (unsigned int i = first; i < _history_count && num < max_entries; i++) {
+        if (_history[i % HISTORY_SIZE].hb == hb) {
+            duty[num++] = (float)_history[i % HISTORY_SIZE].ccr_fine
+                / (_pwm_resolution / 2 * HalfBridgeHost::dither_steps);
+        }
+    }
+    return num;
 }
 
-void half_bridge_stop()
+void half_bridge_host_clear_history()
 {
-    // Break and Dead-Time Register
-    // MOE  = 1: Main output enable
-    //TIM1->BDTR &= ~(TIM_BDTR_MOE);
+    _history_count = 0;
+}
 
-    _enabled = false;
+const char *half_bridge_host_config_log()
+{
+    return _config_log;
 }
 
-bool half_bridge_enabled()
+void half_bridge_host_clear_config_log()
 {
-    return _enabled;
+    _config_log[0] = '\0';
+}
+
+float half_bridge_stub_current(const half_bridge_t *hb, float v_hs, float v_ls, float r_ohm,
+    float l_uH, float pos)
+{
+    float duty = half_bridge_get_duty_cycle(hb);
+    float period = _pwm_resolution / 48e6;
+
+    // averaged model of the buck converter with losses in r_ohm
+    float i_avg = (duty * v_hs - v_ls) / r_ohm;
+    float ripple = (v_hs - v_ls) * duty * period / (l_uH * 1e-6);
+
+    // time since the high-side switch was turned on (relative to period), the on-time is
+    // centered at counter value 0 or at the half period if shifted
+    float t = pos + duty / 2 + (hb->phase_shift ? 0.5 : 0);
+    t -= (int)t;
+
+    if (t < duty) {
+        return i_avg - ripple / 2 + ripple * t / duty;
+    }
+    else {
+        return i_avg + ripple / 2 - ripple * (t - duty) / (1 - duty);
+    }
 }
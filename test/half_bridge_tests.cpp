@@ -0,0 +1,128 @@
+
+#include "tests.h"
+
+#include "half_bridge.h"
+
+#include <string.h>
+
+static half_bridge_t hb;
+
+void duty_cycle_is_clamped_to_limits()
+{
+    half_bridge_init(&hb, 1, 70, 300, 0.1, 0.97);
+
+    half_bridge_set_duty_cycle(&hb, 0.05);
+    TEST_ASSERT_FLOAT_WITHIN(half_bridge_get_duty_step(), 0.1, half_bridge_get_duty_cycle(&hb));
+
+    half_bridge_set_duty_cycle(&hb, 1.0);
+    TEST_ASSERT_FLOAT_WITHIN(half_bridge_get_duty_step(), 0.97, half_bridge_get_duty_cycle(&hb));
+}
+
+void duty_cycle_step_is_clamped_to_limits()
+{
+    half_bridge_init(&hb, 1, 70, 300, 0.1, 0.97);
+    half_bridge_set_duty_cycle(&hb, 0.5);
+
+    half_bridge_duty_cycle_step(&hb, 1);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001, 0.5 + half_bridge_get_duty_step(),
+        half_bridge_get_duty_cycle(&hb));
+
+    half_bridge_duty_cycle_step(&hb, 100000);
+    TEST_ASSERT_FLOAT_WITHIN(half_bridge_get_duty_step(), 0.97, half_bridge_get_duty_cycle(&hb));
+
+    half_bridge_duty_cycle_step(&hb, -100000);
+    TEST_ASSERT_FLOAT_WITHIN(half_bridge_get_duty_step(), 0.1, half_bridge_get_duty_cycle(&hb));
+}
+
+void duty_cycle_q16_is_rounded_and_clamped()
+{
+    half_bridge_init(&hb, 1, 70, 300, 0.1, 0.97);
+
+    half_bridge_set_duty_cycle_q16(&hb, 0.5 * 65536);
+    TEST_ASSERT_FLOAT_WITHIN(half_bridge_get_duty_step() / 2, 0.5, half_bridge_get_duty_cycle(&hb));
+
+    // no overflow for values out of range (e.g. inner control loop with large reduction)
+    half_bridge_set_duty_cycle_q16(&hb, -65536);
+    TEST_ASSERT_FLOAT_WITHIN(half_bridge_get_duty_step(), 0.1, half_bridge_get_duty_cycle(&hb));
+
+    half_bridge_set_duty_cycle_q16(&hb, 2 * 65536);
+    TEST_ASSERT_FLOAT_WITHIN(half_bridge_get_duty_step(), 0.97, half_bridge_get_duty_cycle(&hb));
+}
+
+void host_backend_records_duty_cycle_history()
+{
+    half_bridge_t hb2;
+    half_bridge_init(&hb, 1, 70, 300, 0.1, 0.97);
+    half_bridge_init(&hb2, 2, 70, 300, 0.1, 0.97);
+    half_bridge_host_clear_history();
+
+    half_bridge_start(&hb, 0.3);
+    half_bridge_set_duty_cycle(&hb2, 0.6);
+    half_bridge_set_duty_cycle(&hb, 0.001);
+    half_bridge_stop(&hb);
+
+    float duty[10];
+    TEST_ASSERT_EQUAL(2, half_bridge_host_history(&hb, duty, 10));
+    TEST_ASSERT_FLOAT_WITHIN(half_bridge_get_duty_step(), 0.3, duty[0]);
+    TEST_ASSERT_FLOAT_WITHIN(half_bridge_get_duty_step(), 0.1, duty[1]);     // clamped
+
+    // recorded values have the resolution of the timer with dithering
+    TEST_ASSERT_EQUAL(1, half_bridge_host_history(&hb2, duty, 10));
+    float steps = duty[0] / half_bridge_get_duty_step();
+    TEST_ASSERT_FLOAT_WITHIN(0.01, (int)(steps + 0.5), steps);
+}
+
+void sequence_only_rewritten_by_duty_cycle_update_while_running()
+{
+    half_bridge_init(&hb, 1, 70, 300, 0.1, 0.97);
+    half_bridge_set_diode_emulation(&hb, true);
+    half_bridge_start(&hb, 0.5);
+    half_bridge_host_clear_history();
+
+    float duty[10];
+    half_bridge_set_burst(&hb, 0.5);
+    TEST_ASSERT_EQUAL(0, half_bridge_host_history(&hb, duty, 10));
+
+    // same duty cycle, but burst mode applied
+    half_bridge_set_duty_cycle_q16(&hb, 0.5 * 65536);
+    TEST_ASSERT_EQUAL(1, half_bridge_host_history(&hb, duty, 10));
+    half_bridge_set_duty_cycle_q16(&hb, 0.5 * 65536);
+    TEST_ASSERT_EQUAL(1, half_bridge_host_history(&hb, duty, 10));
+
+    // applied immediately if stopped
+    half_bridge_stop(&hb);
+    half_bridge_set_burst(&hb, 1.0);
+    TEST_ASSERT_EQUAL(2, half_bridge_host_history(&hb, duty, 10));
+}
+
+void timer_locked_after_channel_configuration()
+{
+    half_bridge_t hb2;
+    half_bridge_host_clear_config_log();
+
+    // further instances configure their channel after the first lock, so the backend must
+    // keep the compare mode writable (see lock level of TIM1)
+    half_bridge_init(&hb, 1, 70, 300, 0.1, 0.97);
+    half_bridge_init(&hb2, 2, 70, 300, 0.1, 0.97);
+    TEST_ASSERT(strcmp(half_bridge_host_config_log(),
+        "init_timer init_channel lock init_timer init_channel lock") == 0);
+
+    // the compare mode is changed for the phase shift after the lock as well
+    half_bridge_host_clear_config_log();
+    half_bridge_set_phase_shift(&hb2, true);
+    TEST_ASSERT(strcmp(half_bridge_host_config_log(), "set_pwm_mode2") == 0);
+}
+
+void half_bridge_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(duty_cycle_is_clamped_to_limits);
+    RUN_TEST(duty_cycle_step_is_clamped_to_limits);
+    RUN_TEST(duty_cycle_q16_is_rounded_and_clamped);
+    RUN_TEST(host_backend_records_duty_cycle_history);
+    RUN_TEST(sequence_only_rewritten_by_duty_cycle_update_while_running);
+    RUN_TEST(timer_locked_after_channel_configuration);
+
+    UNITY_END();
+}
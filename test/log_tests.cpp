@@ -0,0 +1,94 @@
+
+#include "tests.h"
+
+#include "log.h"
+
+static log_data_t log_test;
+static log_snapshot_t meas;
+
+static void init_structs()
+{
+    log_test = {};
+    meas.battery_voltage = 12.0;
+    meas.solar_voltage = 18.0;
+    meas.dcdc_current = 5.0;
+    meas.load_current = 2.0;
+    meas.bat_temp = 25.0;
+    meas.int_temp = 30.0;
+    meas.mosfet_temp = 40.0;
+}
+
+void max_values_recorded_with_timestamp()
+{
+    init_structs();
+    log_update_statistics(&log_test, &meas, 1000);
+
+    TEST_ASSERT_EQUAL_FLOAT(12.0, log_test.battery_voltage_max);
+    TEST_ASSERT_EQUAL_FLOAT(18.0, log_test.solar_voltage_max);
+    TEST_ASSERT_EQUAL_FLOAT(5.0, log_test.dcdc_current_max);
+    TEST_ASSERT_EQUAL_FLOAT(2.0, log_test.load_current_max);
+    TEST_ASSERT_EQUAL(60, log_test.solar_power_max_day);
+    TEST_ASSERT_EQUAL(24, log_test.load_power_max_day);
+    TEST_ASSERT_EQUAL(25, log_test.bat_temp_max);
+    TEST_ASSERT_EQUAL(30, log_test.int_temp_max);
+    TEST_ASSERT_EQUAL(40, log_test.mosfet_temp_max);
+
+    TEST_ASSERT_EQUAL(1000, log_test.battery_voltage_max_time);
+    TEST_ASSERT_EQUAL(1000, log_test.solar_power_max_day_time);
+    TEST_ASSERT_EQUAL(1000, log_test.solar_power_max_total_time);
+    TEST_ASSERT_EQUAL(1000, log_test.mosfet_temp_max_time);
+}
+
+void lower_values_keep_max_and_timestamp()
+{
+    init_structs();
+    log_update_statistics(&log_test, &meas, 1000);
+
+    meas.battery_voltage = 11.0;
+    meas.dcdc_current = 10.0;
+    log_update_statistics(&log_test, &meas, 2000);
+
+    TEST_ASSERT_EQUAL_FLOAT(12.0, log_test.battery_voltage_max);
+    TEST_ASSERT_EQUAL(1000, log_test.battery_voltage_max_time);
+    TEST_ASSERT_EQUAL_FLOAT(10.0, log_test.dcdc_current_max);
+    TEST_ASSERT_EQUAL(2000, log_test.dcdc_current_max_time);
+    TEST_ASSERT_EQUAL(110, log_test.solar_power_max_day);
+    TEST_ASSERT_EQUAL(2000, log_test.solar_power_max_day_time);
+}
+
+void daily_max_below_total_max_keeps_total()
+{
+    init_structs();
+    log_test.solar_power_max_total = 100;
+    log_test.solar_power_max_total_time = 500;
+    log_update_statistics(&log_test, &meas, 1000);
+
+    TEST_ASSERT_EQUAL(60, log_test.solar_power_max_day);
+    TEST_ASSERT_EQUAL(1000, log_test.solar_power_max_day_time);
+    TEST_ASSERT_EQUAL(100, log_test.solar_power_max_total);
+    TEST_ASSERT_EQUAL(500, log_test.solar_power_max_total_time);
+}
+
+void no_power_recorded_for_negative_currents()
+{
+    init_structs();
+    meas.dcdc_current = -5.0;
+    meas.load_current = -1.0;
+    log_update_statistics(&log_test, &meas, 1000);
+
+    TEST_ASSERT_EQUAL(0, log_test.solar_power_max_day);
+    TEST_ASSERT_EQUAL(0, log_test.load_power_max_day);
+    TEST_ASSERT_EQUAL(0, log_test.solar_power_max_day_time);
+}
+
+void log_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(max_values_recorded_with_timestamp);
+    RUN_TEST(lower_values_keep_max_and_timestamp);
+    RUN_TEST(daily_max_below_total_max_keeps_total);
+    RUN_TEST(no_power_recorded_for_negative_currents);
+
+    UNITY_END();
+}
@@ -15,10 +15,11 @@
 #include "leds.h"               // LED switching using charlieplexing
 #include "log.h"                // log data (error memory, min/max measurements, etc.)
 #include "data_objects.h"       // for access to internal data via ThingSet
+#include "meas_snapshot.h"      // consistent measurements for main loop
 
 #include "tests.h"
 
-dcdc_t dcdc = {};
+dcdc_t dcdc[DCDC_NUM_CONVERTERS] = {};
 power_port_t hs_port = {};       // high-side (solar for typical MPPT)
 power_port_t ls_port = {};       // low-side (battery for typical MPPT)
 power_port_t *bat_port = NULL;
@@ -28,12 +29,25 @@ battery_conf_t bat_conf_user;   // temporary storage where the user can write to
 battery_state_t bat_state;      // battery state information
 load_output_t load;
 log_data_t log_data;
+meas_snapshot_t meas;           // copy of the latest measurements for use in main loop
 extern ThingSet ts;             // defined in data_objects.cpp
 
 time_t timestamp;    // current unix timestamp (independent of time(NULL), as it is user-configurable)
+time_t uptime;       // seconds since start-up for internal timing (see hardware.h)
 
 int main() {
     charger_tests();
+    adc_tests();
+    log_tests();
+    eeprom_tests();
+    adc_scope_tests();
+    meas_snapshot_tests();
+    adc_replay_tests();
+    dcdc_tests();
+    half_bridge_tests();
+    mppt_tests();
+    plant_sim_tests();
+    mppt_benchmark_tests();
 
     // TODO
     //battery_tests();
@@ -0,0 +1,54 @@
+
+#include "tests.h"
+
+#include "meas_snapshot.h"
+
+void snapshot_read_returns_latest_published()
+{
+    meas_snapshot_t snap = {};
+    meas_snapshot_t copy;
+
+    uint32_t seq_start = meas_snapshot_read(&copy);
+    for (int i = 1; i <= 3; i++) {
+        snap.bat_voltage = 12.0 + i;
+        snap.soc = 50 + i;
+        meas_snapshot_publish(&snap);
+    }
+
+    TEST_ASSERT_EQUAL(seq_start + 3, meas_snapshot_read(&copy));
+    TEST_ASSERT_EQUAL_FLOAT(15.0, copy.bat_voltage);
+    TEST_ASSERT_EQUAL(53, copy.soc);
+}
+
+void snapshot_copy_not_changed_by_next_cycle()
+{
+    meas_snapshot_t snap = {};
+    meas_snapshot_t copy;
+
+    snap.ls_voltage = 13.0;
+    snap.ls_current = 2.0;
+    meas_snapshot_publish(&snap);
+    uint32_t seq = meas_snapshot_read(&copy);
+
+    snap.ls_voltage = 14.0;
+    snap.ls_current = 3.0;
+    meas_snapshot_publish(&snap);
+
+    // values of the copy belong to the same control cycle
+    TEST_ASSERT_EQUAL_FLOAT(13.0, copy.ls_voltage);
+    TEST_ASSERT_EQUAL_FLOAT(2.0, copy.ls_current);
+
+    TEST_ASSERT_EQUAL(seq + 1, meas_snapshot_read(&copy));
+    TEST_ASSERT_EQUAL_FLOAT(14.0, copy.ls_voltage);
+    TEST_ASSERT_EQUAL_FLOAT(3.0, copy.ls_current);
+}
+
+void meas_snapshot_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(snapshot_read_returns_latest_published);
+    RUN_TEST(snapshot_copy_not_changed_by_next_cycle);
+
+    UNITY_END();
+}
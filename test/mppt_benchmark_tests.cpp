@@ -0,0 +1,361 @@
+
+#include "tests.h"
+
+#include "plant_sim.h"
+#include "mppt.h"
+#include "half_bridge.h"
+#include "pcb.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* MPPT tracking efficiency benchmark
+ *
+ * The DC/DC control (dcdc_control, dcdc_fast_control) is run in closed loop with the plant
+ * simulation for standard irradiance profiles, based on the test procedure of EN 50530:
+ *
+ * - Static efficiency: constant irradiance after the MPP was found (warm-up)
+ * - Dynamic efficiency: ramps between two irradiance levels with different slopes, steps and
+ *   fast-changing irradiance caused by broken clouds
+ *
+ * Each measurement starts from an operating point away from the MPP, so that the settling time
+ * is measured for all profiles. Steps from very low irradiance (dawn, deep shade) move the MPP
+ * far away from the previous operating point, where the adaptive step size of P&O matters most.
+ *
+ * The results are printed as a markdown table and can be written to a CSV file for comparison
+ * of different variants of the control: MPPT_BENCHMARK_CSV=mppt.csv
+ */
+
+#define WARMUP_DURATION 60      // s with constant irradiance before measurement starts
+
+// duty cycle relative to the MPP found during warm-up at the start of the measurement, so that
+// the settling time is also measured for profiles without steps
+#define START_DUTY_OFFSET 0.9
+
+enum mppt_profile_type
+{
+    PROFILE_CONSTANT,           ///< Constant irradiance (static efficiency)
+    PROFILE_STEPS,              ///< Steps between low and high irradiance every dwell time
+    PROFILE_RAMPS,              ///< Ramp up, dwell, ramp down, dwell (EN 50530 dynamic test)
+    PROFILE_FLICKER,            ///< Pseudo-random steps between low and high every dwell time
+};
+
+typedef struct {
+    const char *name;
+    uint8_t type;
+    float low;                  // relative irradiance (1.0 = 1000 W/m2)
+    float high;                 // relative irradiance
+    float slope;                // slope of ramps (1/s, 0.01 = 10 W/m2/s)
+    float dwell;                // s
+    int duration;               // s
+    float efficiency_min;       // minimum efficiency expected from all variants
+} mppt_profile_t;
+
+static const mppt_profile_t profiles[] = {
+    { "static 5%",              PROFILE_CONSTANT, 0.05, 0.05, 0,     0,  60, 0.95 },
+    { "static 10%",             PROFILE_CONSTANT, 0.1,  0.1,  0,     0,  60, 0.97 },
+    { "static 20%",             PROFILE_CONSTANT, 0.2,  0.2,  0,     0,  60, 0.98 },
+    { "static 30%",             PROFILE_CONSTANT, 0.3,  0.3,  0,     0,  60, 0.98 },
+    { "static 50%",             PROFILE_CONSTANT, 0.5,  0.5,  0,     0,  60, 0.98 },
+    { "static 100%",            PROFILE_CONSTANT, 1.0,  1.0,  0,     0,  60, 0.98 },
+    { "ramps 10-50% 5 W/m2/s",  PROFILE_RAMPS,    0.1,  0.5,  0.005, 10, 360, 0.97 },
+    { "ramps 10-50% 20 W/m2/s", PROFILE_RAMPS,    0.1,  0.5,  0.02,  10, 240, 0.95 },
+    { "ramps 10-50% 50 W/m2/s", PROFILE_RAMPS,    0.1,  0.5,  0.05,  10, 144, 0.95 },
+    { "ramps 30-100% 10 W/m2/s", PROFILE_RAMPS,   0.3,  1.0,  0.01,  10, 320, 0.97 },
+    { "ramps 30-100% 50 W/m2/s", PROFILE_RAMPS,   0.3,  1.0,  0.05,  10, 192, 0.93 },
+    { "ramps 30-100% 100 W/m2/s", PROFILE_RAMPS,  0.3,  1.0,  0.1,   10, 136, 0.92 },
+    { "steps 30-100%",          PROFILE_STEPS,    0.3,  1.0,  0,     20, 160, 0.97 },
+    { "steps 5-100%",           PROFILE_STEPS,    0.05, 1.0,  0,     10, 160, 0.97 },
+    { "cloud flicker 20-100%",  PROFILE_FLICKER,  0.2,  1.0,  0,     1,  120, 0.95 },
+};
+
+#define PROFILE_LARGE_STEPS 13  // index of the profile with steps from very low irradiance
+
+/* Weights of the static efficiency at 5, 10, 20, 30, 50 and 100% of nominal power
+ * (European efficiency, EN 50530 annex)
+ */
+static const float eu_weights[] = { 0.03, 0.06, 0.13, 0.10, 0.48, 0.20 };
+
+typedef struct {
+    const char *name;
+    uint16_t algorithm;
+    bool adaptive;
+    int sweep_interval;         // s (0 to disable global MPP sweep)
+} mppt_variant_t;
+
+enum mppt_variant_index
+{
+    VARIANT_PO_FIXED,
+    VARIANT_PO_ADAPTIVE,
+    VARIANT_INC_COND,
+    VARIANT_PO_SWEEP,
+};
+
+static const mppt_variant_t variants[] = {
+    { "P&O fixed", MPPT_PERTURB_OBSERVE, false, 0 },
+    { "P&O adaptive", MPPT_PERTURB_OBSERVE, true, 0 },
+    { "IncCond", MPPT_INC_CONDUCTANCE, false, 0 },
+    { "P&O + sweep", MPPT_PERTURB_OBSERVE, true, 30 },
+};
+
+typedef struct {
+    float efficiency;           // harvested energy relative to energy available at the MPP
+    float settling_mean;        // mean time to reach 99% of MPP power after start and steps (s)
+    float settling_max;         // maximum time to reach 99% of MPP power after start and steps (s)
+    float mpp_energy;           // energy available at the MPP (Wh)
+    float energy_lost;          // energy not harvested (Ws)
+} mppt_benchmark_result_t;
+
+static const mppt_profile_t *profile;
+static uint32_t profile_start;      // virtual time of the simulation when the profile starts
+static bool warmup;
+
+// pseudo-random number between 0 and 1 (reproducible for each n)
+static float pseudo_random(uint32_t n)
+{
+    n *= 2654435761u;
+    n ^= n >> 16;
+    return (float)(n & 0xFFFF) / 0xFFFF;
+}
+
+static float profile_irradiance(float t)
+{
+    t = warmup ? 0 : t - profile_start;
+
+    switch (profile->type) {
+        case PROFILE_STEPS:
+            return ((int)(t / profile->dwell) % 2 == 0) ? profile->low : profile->high;
+        case PROFILE_RAMPS:
+        {
+            float ramp = (profile->high - profile->low) / profile->slope;
+            float phase = fmod(t, 2 * (ramp + profile->dwell));
+            if (phase < profile->dwell) {
+                return profile->low;
+            }
+            else if (phase < profile->dwell + ramp) {
+                return profile->low + profile->slope * (phase - profile->dwell);
+            }
+            else if (phase < 2 * profile->dwell + ramp) {
+                return profile->high;
+            }
+            else {
+                return profile->high - profile->slope * (phase - 2 * profile->dwell - ramp);
+            }
+        }
+        case PROFILE_FLICKER:
+        {
+            int n = t / profile->dwell;
+            return (n == 0) ? profile->low :
+                profile->low + (profile->high - profile->low) * pseudo_random(n);
+        }
+        default:
+            return profile->high;
+    }
+}
+
+static mppt_benchmark_result_t mppt_benchmark_run(const mppt_profile_t *prof,
+    const mppt_variant_t *var)
+{
+    static plant_sim_t sim;
+    mppt_benchmark_result_t res = {};
+
+    plant_sim_init(&sim, false);
+    sim.time = 12 * 3600;       // irrelevant for irradiance, but past restart interval of DC/DC
+    sim.dcdc.mppt_algorithm = var->algorithm;
+    sim.dcdc.mppt_adaptive = var->adaptive;
+    sim.dcdc.sweep.interval = var->sweep_interval;
+    profile = prof;
+    sim.irradiance = profile_irradiance;
+
+    warmup = true;
+    plant_sim_run(&sim, WARMUP_DURATION);
+    warmup = false;
+
+    profile_start = sim.time;
+    sim.pv_energy = 0;
+    sim.mpp_energy = 0;
+
+    // restart tracking from an operating point away from the MPP (higher input voltage)
+    sim.dcdc.duty_base = sim.dcdc.duty_base * START_DUTY_OFFSET;
+    mppt_get_algorithm(&sim.dcdc)->reset(&sim.dcdc);
+
+    // settling after the start and after steps of irradiance (ramps are too slow to be counted
+    // as steps)
+    float irradiance_prev = profile_irradiance(sim.time);
+    int settling_cycles = 0;
+    int settling_sum = 0;
+    int settling_max = 0;
+    int steps = 1;
+    for (int i = 0; i < prof->duration * CONTROL_FREQUENCY; i++) {
+        float irradiance = profile_irradiance(sim.time + (float)sim.cycle / CONTROL_FREQUENCY);
+        plant_sim_step(&sim);
+
+        if (fabs(irradiance - irradiance_prev) > 0.05) {
+            if (settling_cycles >= 0) {
+                // not settled before the next step: counted with time until the step
+                settling_sum += settling_cycles;
+                settling_max = (settling_cycles > settling_max) ? settling_cycles : settling_max;
+            }
+            settling_cycles = 0;
+            steps++;
+        }
+        irradiance_prev = irradiance;
+
+        if (settling_cycles >= 0) {
+            settling_cycles++;
+            if (sim.pv_power >= 0.99 * sim.mpp_power) {
+                settling_sum += settling_cycles;
+                settling_max = (settling_cycles > settling_max) ? settling_cycles : settling_max;
+                settling_cycles = -1;
+            }
+        }
+    }
+    if (settling_cycles >= 0) {
+        settling_sum += settling_cycles;
+        settling_max = (settling_cycles > settling_max) ? settling_cycles : settling_max;
+    }
+    half_bridge_stop(&sim.dcdc.half_bridge);
+
+    res.efficiency = (sim.mpp_energy > 0) ? sim.pv_energy / sim.mpp_energy : 0;
+    res.settling_mean = (steps > 0) ? (float)settling_sum / steps / CONTROL_FREQUENCY : 0;
+    res.settling_max = (float)settling_max / CONTROL_FREQUENCY;
+    res.mpp_energy = sim.mpp_energy;
+    res.energy_lost = (sim.mpp_energy - sim.pv_energy) * 3600;
+    return res;
+}
+
+static FILE *csv;
+
+static int stdout_saved = -1;
+
+// status messages of the firmware (DC/DC start/stop) are not part of the benchmark output
+static void firmware_output(bool enabled)
+{
+    fflush(stdout);
+    if (!enabled && stdout_saved < 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0) {
+            stdout_saved = dup(STDOUT_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+    }
+    else if (enabled && stdout_saved >= 0) {
+        dup2(stdout_saved, STDOUT_FILENO);
+        close(stdout_saved);
+        stdout_saved = -1;
+    }
+}
+
+static void print_result(const char *profile_name, const char *variant_name, const char *type,
+    const mppt_benchmark_result_t *res)
+{
+    printf("| %-24s | %-12s | %-7s | %8.2f %% | %7.1f s | %7.1f s | %8.3f | %8.1f |\n",
+        profile_name, variant_name, type, res->efficiency * 100, res->settling_mean,
+        res->settling_max, res->mpp_energy, res->energy_lost);
+    if (csv != NULL) {
+        fprintf(csv, "%s,%s,%s,%.5f,%.1f,%.1f,%.4f,%.2f\n", profile_name, variant_name, type,
+            res->efficiency, res->settling_mean, res->settling_max, res->mpp_energy,
+            res->energy_lost);
+    }
+}
+
+void mppt_efficiency_benchmark()
+{
+    const int num_profiles = sizeof(profiles) / sizeof(profiles[0]);
+    const int num_variants = sizeof(variants) / sizeof(variants[0]);
+    mppt_benchmark_result_t res[num_profiles][num_variants];
+
+    const char *csv_file = getenv("MPPT_BENCHMARK_CSV");
+    csv = (csv_file != NULL) ? fopen(csv_file, "w") : NULL;
+    if (csv != NULL) {
+        fprintf(csv, "profile,variant,type,efficiency,settling_mean_s,settling_max_s,"
+            "mpp_energy_Wh,energy_lost_Ws\n");
+    }
+
+    firmware_output(false);
+    for (int p = 0; p < num_profiles; p++) {
+        for (int v = 0; v < num_variants; v++) {
+            res[p][v] = mppt_benchmark_run(&profiles[p], &variants[v]);
+        }
+    }
+    firmware_output(true);
+
+    printf("| %-24s | %-12s | %-7s | %10s | %9s | %9s | %8s | %8s |\n", "Profile", "Variant",
+        "Type", "Efficiency", "Settling", "Max", "MPP (Wh)", "Lost (Ws)");
+    for (int p = 0; p < num_profiles; p++) {
+        const char *type = (profiles[p].type == PROFILE_CONSTANT) ? "static" : "dynamic";
+        for (int v = 0; v < num_variants; v++) {
+            print_result(profiles[p].name, variants[v].name, type, &res[p][v]);
+        }
+    }
+
+    // summary: weighted static efficiency and mean dynamic efficiency of each variant
+    mppt_benchmark_result_t weighted[num_variants];
+    mppt_benchmark_result_t dynamic[num_variants];
+    for (int v = 0; v < num_variants; v++) {
+        weighted[v] = {};
+        dynamic[v] = {};
+        int num_static = 0;
+        int num_dynamic = 0;
+        for (int p = 0; p < num_profiles; p++) {
+            mppt_benchmark_result_t *sum;
+            if (profiles[p].type == PROFILE_CONSTANT) {
+                sum = &weighted[v];
+                sum->efficiency += eu_weights[num_static++] * res[p][v].efficiency;
+            }
+            else {
+                sum = &dynamic[v];
+                sum->efficiency += res[p][v].efficiency;
+                num_dynamic++;
+            }
+            sum->settling_mean += res[p][v].settling_mean;
+            sum->settling_max = fmax(sum->settling_max, res[p][v].settling_max);
+            sum->mpp_energy += res[p][v].mpp_energy;
+            sum->energy_lost += res[p][v].energy_lost;
+        }
+        weighted[v].settling_mean /= num_static;
+        dynamic[v].efficiency /= num_dynamic;
+        dynamic[v].settling_mean /= num_dynamic;
+        print_result("EU weighted", variants[v].name, "static", &weighted[v]);
+        print_result("dynamic mean", variants[v].name, "dynamic", &dynamic[v]);
+    }
+
+    if (csv != NULL) {
+        fclose(csv);
+    }
+
+    for (int p = 0; p < num_profiles; p++) {
+        for (int v = 0; v < num_variants; v++) {
+            TEST_ASSERT(res[p][v].efficiency >= profiles[p].efficiency_min);
+        }
+        // adaptive step must not be worse than fixed step of perturb and observe
+        TEST_ASSERT(res[p][VARIANT_PO_ADAPTIVE].efficiency >=
+            res[p][VARIANT_PO_FIXED].efficiency - 0.001);
+    }
+
+    // adaptive step tracks faster than fixed step P&O, especially after large steps
+    TEST_ASSERT(dynamic[VARIANT_PO_ADAPTIVE].efficiency > dynamic[VARIANT_PO_FIXED].efficiency);
+    TEST_ASSERT(weighted[VARIANT_PO_ADAPTIVE].settling_mean <
+        weighted[VARIANT_PO_FIXED].settling_mean);
+    TEST_ASSERT(res[PROFILE_LARGE_STEPS][VARIANT_PO_ADAPTIVE].settling_mean <
+        0.5 * res[PROFILE_LARGE_STEPS][VARIANT_PO_FIXED].settling_mean);
+
+    // adaptive step reaches the MPP faster after the start without losses at steady state,
+    // global MPP sweeps cost less than 1.5 %
+    TEST_ASSERT(weighted[VARIANT_PO_ADAPTIVE].efficiency > weighted[VARIANT_PO_FIXED].efficiency);
+    TEST_ASSERT(weighted[VARIANT_PO_SWEEP].efficiency >
+        weighted[VARIANT_PO_ADAPTIVE].efficiency - 0.015);
+}
+
+void mppt_benchmark_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(mppt_efficiency_benchmark);
+
+    UNITY_END();
+}
@@ -0,0 +1,278 @@
+
+#include "tests.h"
+
+#include "dcdc.h"
+#include "mppt.h"
+#include "half_bridge.h"
+#include "power_port.h"
+#include "battery.h"
+#include "pcb.h"
+#include "plant_sim.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#define SIM_BAT_VOLTAGE 12.8
+
+static const sim_pv_t pv_36_cells = { 22.0, 5.5, 36 * 1.3 * 0.0257, 2, 1.0 };
+static const sim_pv_t pv_60_cells = { 37.0, 5.0, 60 * 1.3 * 0.0257, 3, 1.0 };
+static const sim_pv_t pv_60_cells_shaded = { 37.0, 5.0, 60 * 1.3 * 0.0257, 3, 0.3 };
+
+// irradiance profile with steps and a ramp (relative to full irradiance)
+static float irradiance_steps(float t)
+{
+    if (t < 60) {
+        return 1.0;
+    }
+    else if (t < 100) {
+        return 0.4;
+    }
+    else if (t < 160) {
+        return 0.4 + 0.6 * (t - 100) / 60;
+    }
+    else {
+        return 0.7;
+    }
+}
+
+static float irradiance_constant(float)
+{
+    return 1.0;
+}
+
+// fast-changing irradiance (e.g. broken clouds): ramps with 10%/s between 30% and 100%
+static float irradiance_clouds(float t)
+{
+    float phase = fmod(t, 14) / 7;      // 0..2
+    return (phase < 1) ? 1.0 - 0.7 * phase : 0.3 + 0.7 * (phase - 1);
+}
+
+typedef struct {
+    const char *name;
+    const sim_pv_t *pv;
+    float (*irradiance)(float t);
+    float start_voltage;        // PV voltage after DC/DC start (0 for default of firmware)
+    int duration;               // s
+    float efficiency_min;       // minimum efficiency expected from all algorithms
+} mppt_scenario_t;
+
+static const mppt_scenario_t scenarios[] = {
+    { "36 cells, irradiance steps/ramp", &pv_36_cells, irradiance_steps, 0, 200, 0.98 },
+    { "60 cells, start close to Voc", &pv_60_cells, irradiance_constant, 36.0, 30, 0.97 },
+    { "36 cells, fast-changing clouds", &pv_36_cells, irradiance_clouds, 0, 140, 0.90 },
+    { "60 cells, partial shading", &pv_60_cells_shaded, irradiance_constant, 0, 120, 0.40 },
+};
+
+typedef struct {
+    const char *name;
+    uint16_t algorithm;
+    bool adaptive;
+    int sweep_interval;         // s (0 to disable global MPP sweep)
+} mppt_variant_t;
+
+static const mppt_variant_t variants[] = {
+    { "P&O fixed", MPPT_PERTURB_OBSERVE, false, 0 },
+    { "P&O adaptive", MPPT_PERTURB_OBSERVE, true, 0 },
+    { "IncCond", MPPT_INC_CONDUCTANCE, false, 0 },
+    { "P&O + sweep", MPPT_PERTURB_OBSERVE, true, 30 },
+};
+
+typedef struct {
+    float efficiency;           // harvested energy relative to energy available at the MPP
+    int settling_cycles;        // control cycles until 99% of MPP power is reached first
+    float sweep_duration;       // duration of the last global MPP sweep (s)
+    float sweep_energy_lost;    // energy lost during the last global MPP sweep (Ws)
+} mppt_result_t;
+
+/* Simulates the DC/DC in buck mode with ideal converter and battery
+ *
+ * The PV voltage results from the duty cycle (continuous conduction mode). If it would
+ * exceed the open-circuit voltage, no current flows. The plant is updated with the frequency
+ * of the inner control loop.
+ */
+static mppt_result_t mppt_simulation(const mppt_scenario_t *sc, const mppt_variant_t *var)
+{
+    dcdc_t dcdc_sim = {};
+    power_port_t hs = {};
+    power_port_t ls = {};
+    battery_conf_t bat;
+    mppt_result_t res = { 0, -1, 0, 0 };
+
+    battery_conf_init(&bat, BAT_TYPE_GEL, 6, 100);
+    power_port_init_solar(&hs);
+    power_port_init_bat(&ls, &bat);
+    dcdc_init(&dcdc_sim);
+    dcdc_sim.mppt_algorithm = var->algorithm;
+    dcdc_sim.mppt_adaptive = var->adaptive;
+    dcdc_sim.sweep.interval = var->sweep_interval;
+    half_bridge_init(&dcdc_sim.half_bridge, 1, 70, 300, 12 / dcdc_sim.hs_voltage_max, 0.97);
+
+    float energy = 0;
+    float energy_max = 0;
+    bool started = false;
+    for (int i = 0; i < sc->duration * CONTROL_FREQUENCY; i++) {
+        float irradiance = sc->irradiance((float)i / CONTROL_FREQUENCY);
+        float power_max = sim_pv_power_max(sc->pv, irradiance, SIM_BAT_VOLTAGE);
+        float power = 0;
+
+        if (half_bridge_enabled(&dcdc_sim.half_bridge) && !started) {
+            started = true;
+            if (sc->start_voltage > 0) {
+                dcdc_sim.duty_base = SIM_BAT_VOLTAGE / sc->start_voltage * 65536;
+                half_bridge_set_duty_cycle(&dcdc_sim.half_bridge, SIM_BAT_VOLTAGE / sc->start_voltage);
+            }
+        }
+
+        for (int j = 0; j < FAST_CONTROL_FREQUENCY / CONTROL_FREQUENCY; j++) {
+            float v_pv = sc->pv->voc;
+            if (half_bridge_enabled(&dcdc_sim.half_bridge)) {
+                v_pv = SIM_BAT_VOLTAGE / half_bridge_get_duty_cycle(&dcdc_sim.half_bridge);
+            }
+            float i_pv = sim_pv_current(sc->pv, v_pv, irradiance);
+            if (i_pv <= 0) {
+                // voltage limited to open-circuit voltage
+                v_pv = sc->pv->voc;
+            }
+            power = v_pv * i_pv;
+            energy += power / FAST_CONTROL_FREQUENCY;
+
+            hs.voltage = v_pv;
+            hs.current = -i_pv;
+            ls.voltage = SIM_BAT_VOLTAGE;
+            ls.current = power / SIM_BAT_VOLTAGE;
+            dcdc_sim.ls_current = ls.current;
+
+            dcdc_fast_meas_t meas;
+            meas.hs_voltage = hs.voltage * 1000;
+            meas.ls_voltage = ls.voltage * 1000;
+            meas.hs_current = hs.current * 1000;
+            meas.ls_current = ls.current * 1000;
+            meas.phase_imbalance = 0;
+            dcdc_fast_control(&dcdc_sim, &meas);
+        }
+
+        energy_max += power_max / CONTROL_FREQUENCY;
+        if (power >= 0.99 * power_max && res.settling_cycles < 0) {
+            res.settling_cycles = i;
+        }
+
+        dcdc_control(&dcdc_sim, &hs, &ls);
+    }
+    half_bridge_stop(&dcdc_sim.half_bridge);
+
+    res.efficiency = energy / energy_max;
+    res.sweep_duration = dcdc_sim.sweep.duration;
+    res.sweep_energy_lost = dcdc_sim.sweep.energy_lost;
+    return res;
+}
+
+void mppt_algorithms_benchmark()
+{
+    const int num_variants = sizeof(variants) / sizeof(variants[0]);
+
+    printf("| %-32s | %-12s | %10s | %15s |\n", "Scenario", "Algorithm", "Efficiency", "Settling cycles");
+    for (unsigned int i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        mppt_result_t res[num_variants];
+        for (int v = 0; v < num_variants; v++) {
+            res[v] = mppt_simulation(&scenarios[i], &variants[v]);
+            printf("| %-32s | %-12s | %8.2f %% | %15d |\n", scenarios[i].name, variants[v].name,
+                res[v].efficiency * 100, res[v].settling_cycles);
+            TEST_ASSERT(res[v].efficiency > scenarios[i].efficiency_min);
+        }
+        printf("| %-32s | last sweep: %.2f s, %.2f Ws lost\n", scenarios[i].name,
+            res[3].sweep_duration, res[3].sweep_energy_lost);
+
+        // global MPP sweep finds the MPP in case of partial shading
+        if (scenarios[i].pv->shading < 1.0) {
+            TEST_ASSERT(res[3].efficiency > res[1].efficiency + 0.1);
+            TEST_ASSERT(res[3].sweep_duration < 1.0);
+            continue;
+        }
+
+        // adaptive step must not be worse than fixed step of perturb and observe
+        TEST_ASSERT(res[1].efficiency >= res[0].efficiency - 0.001);
+        TEST_ASSERT(res[1].settling_cycles >= 0);
+        TEST_ASSERT(res[1].settling_cycles <= res[0].settling_cycles);
+    }
+}
+
+static dcdc_t dcdc_inc;
+static power_port_t pv_port;
+static power_port_t bat_port;
+
+// runs one step of incremental conductance with given PV voltage and current
+static int inc_cond_step(float voltage, float current)
+{
+    pv_port.voltage = voltage;
+    pv_port.current = -current;
+    return mppt_algorithms[MPPT_INC_CONDUCTANCE].step(&dcdc_inc, &bat_port, &pv_port);
+}
+
+void inc_cond_moves_towards_mpp()
+{
+    dcdc_init(&dcdc_inc);
+    mppt_algorithms[MPPT_INC_CONDUCTANCE].reset(&dcdc_inc);
+    bat_port.voltage = 12.8;
+
+    // first step decreases the input voltage from the start point
+    TEST_ASSERT_EQUAL(1, inc_cond_step(20.0, 3.0));
+
+    // power increased with lower voltage (right of MPP): continue
+    TEST_ASSERT_EQUAL(1, inc_cond_step(19.8, 3.1));
+
+    // power decreased with lower voltage (left of MPP): increase voltage
+    TEST_ASSERT_EQUAL(-1, inc_cond_step(19.6, 3.12));
+}
+
+void inc_cond_holds_at_mpp()
+{
+    dcdc_init(&dcdc_inc);
+    mppt_algorithms[MPPT_INC_CONDUCTANCE].reset(&dcdc_inc);
+    bat_port.voltage = 12.8;
+
+    inc_cond_step(18.0, 5.0);
+
+    // dI/dV = -I/V
+    TEST_ASSERT_EQUAL(0, inc_cond_step(18.2, 5.0 / (1 + 0.2 / 18.2)));
+
+    // irradiance increase at constant voltage: increase voltage
+    TEST_ASSERT_EQUAL(-1, inc_cond_step(18.2, 5.5));
+}
+
+// runs one step of adaptive perturb and observe with given PV voltage and current (lossless)
+static int po_step(float voltage, float current)
+{
+    pv_port.voltage = voltage;
+    pv_port.current = -current;
+    bat_port.current = voltage * current / bat_port.voltage;
+    return mppt_algorithms[MPPT_PERTURB_OBSERVE].step(&dcdc_inc, &bat_port, &pv_port);
+}
+
+void perturb_observe_adaptive_step_ignores_irradiance_change()
+{
+    dcdc_init(&dcdc_inc);
+    dcdc_inc.mppt_adaptive = true;
+    mppt_algorithms[MPPT_PERTURB_OBSERVE].reset(&dcdc_inc);
+    bat_port.voltage = 12.8;
+
+    // no adaptive step at start
+    TEST_ASSERT_EQUAL(1, po_step(20.0, 3.0));
+
+    // power increased by 2.3% along the I-V curve: larger step
+    TEST_ASSERT(po_step(19.8, 3.1) > 5);
+
+    // voltage and current increased: caused by irradiance, so back to smallest step
+    TEST_ASSERT_EQUAL(1, po_step(19.9, 3.3));
+}
+
+void mppt_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(mppt_algorithms_benchmark);
+    RUN_TEST(inc_cond_moves_towards_mpp);
+    RUN_TEST(inc_cond_holds_at_mpp);
+    RUN_TEST(perturb_observe_adaptive_step_ignores_irradiance_change);
+
+    UNITY_END();
+}
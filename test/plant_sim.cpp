@@ -0,0 +1,310 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "plant_sim.h"
+
+#include "half_bridge.h"
+#include "charger.h"
+#include "pcb.h"
+#include "hardware.h"
+
+#include <math.h>
+
+static float _pv_saturation_current(const sim_pv_t *pv)
+{
+    return pv->isc / (exp(pv->voc / pv->vt) - 1);
+}
+
+// total voltage of all substrings at given current
+static float _pv_voltage(const sim_pv_t *pv, float current, float irradiance)
+{
+    float voltage = 0;
+    for (int i = 0; i < pv->substrings; i++) {
+        float iph = pv->isc * irradiance * ((i == pv->substrings - 1) ? pv->shading : 1.0);
+        if (current < iph) {
+            voltage += pv->vt / pv->substrings * log((iph - current) / _pv_saturation_current(pv) + 1);
+        }
+        else {
+            voltage -= 0.5;     // bypass diode conducting
+        }
+    }
+    return voltage;
+}
+
+float sim_pv_current(const sim_pv_t *pv, float voltage, float irradiance)
+{
+    if (pv->shading >= 1.0) {
+        float current = pv->isc * irradiance - _pv_saturation_current(pv) * (exp(voltage / pv->vt) - 1);
+        return (current > 0) ? current : 0;
+    }
+
+    // voltage decreases monotonically with current: bisection
+    float low = 0;
+    float high = pv->isc * irradiance;
+    if (_pv_voltage(pv, low, irradiance) <= voltage) {
+        return 0;
+    }
+    for (int i = 0; i < 30; i++) {
+        float mid = (low + high) / 2;
+        if (_pv_voltage(pv, mid, irradiance) > voltage) {
+            low = mid;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+float sim_pv_power_max(const sim_pv_t *pv, float irradiance, float v_min)
+{
+    static const sim_pv_t *last_pv = NULL;
+    static float last_irradiance = -1;
+    static float last_v_min = -1;
+    static float p_max = 0;
+
+    if (pv != last_pv || irradiance != last_irradiance || v_min != last_v_min) {
+        // coarse search first, then refine around the maximum found
+        float v_max = v_min;
+        p_max = 0;
+        for (float v = v_min; v < pv->voc; v += 0.2) {
+            float p = v * sim_pv_current(pv, v, irradiance);
+            if (p > p_max) {
+                p_max = p;
+                v_max = v;
+            }
+        }
+        for (float v = v_max - 0.2; v < v_max + 0.2; v += 0.01) {
+            float p = (v >= v_min) ? v * sim_pv_current(pv, v, irradiance) : 0;
+            if (p > p_max) {
+                p_max = p;
+            }
+        }
+        last_pv = pv;
+        last_irradiance = irradiance;
+        last_v_min = v_min;
+    }
+    return p_max;
+}
+
+void sim_battery_init(sim_battery_t *bat, int num_cells, float capacity, float soc)
+{
+    bat->num_cells = num_cells;
+    bat->capacity = capacity;
+    bat->r0 = 0.2 * num_cells / capacity;       // 12 mOhm for 12V/100Ah
+    bat->r1 = bat->r0;
+    bat->c1 = 60 / bat->r1;                     // time constant of 60 s
+    bat->soc = soc;
+    bat->v_rc = 0;
+}
+
+float sim_battery_voltage(const sim_battery_t *bat, float current)
+{
+    // 1.95 V (empty) to 2.15 V (full) per cell, with overpotential close to full charge reaching
+    // the typical topping voltage of 2.4 V per cell at 100% SOC and a steep drop when empty
+    float ocv = bat->num_cells * (1.95 + 0.2 * bat->soc + 0.25 * exp((bat->soc - 1) / 0.03)
+        - 0.25 * exp(-bat->soc / 0.03));
+    return ocv + bat->v_rc + bat->r0 * current;
+}
+
+// integrates the battery state over time step dt (s) with given charging current
+static void _battery_update(sim_battery_t *bat, float current, float dt)
+{
+    bat->soc += current * dt / 3600 / bat->capacity;
+    if (bat->soc > 1.0) {
+        bat->soc = 1.0;
+    }
+    else if (bat->soc < 0) {
+        bat->soc = 0;
+    }
+    bat->v_rc += (current - bat->v_rc / bat->r1) / bat->c1 * dt;
+}
+
+/* Operating point of the averaged DC/DC model for the present duty cycle
+ *
+ * Continuous conduction mode with conduction losses r_dcdc. The PV voltage is determined by
+ * bisection, as the PV current is a monotonic function of it. The inductor current is limited
+ * to the direction from PV to battery (no reverse current into the panel).
+ */
+static void _plant_update(plant_sim_t *sim, float irradiance, float i_load)
+{
+    const float dt = 1.0 / FAST_CONTROL_FREQUENCY;
+    const sim_pv_t *pv = sim->pv;
+    float duty = half_bridge_get_duty_cycle(&sim->dcdc.half_bridge);
+    float v_oc = (irradiance > 0) ? _pv_voltage(pv, 0, irradiance) : 0;
+    float v_pv = v_oc;
+    float i_pv = 0;
+    float i_bat;
+
+    if (half_bridge_enabled(&sim->dcdc.half_bridge)) {
+        float low = 0;
+        float high = v_oc;
+        for (int i = 0; i < 25; i++) {
+            float v = (low + high) / 2;
+            float current = sim_pv_current(pv, v, irradiance);
+            float residual;
+            if (sim->boost) {
+                // D * V_bat - V_pv = -R * I_pv, battery at high-side gets D * I_pv
+                residual = v - duty * sim_battery_voltage(&sim->bat, duty * current)
+                    - sim->r_dcdc * current;
+            }
+            else {
+                // D * V_pv - V_bat = R * I_L with I_L = I_pv / D
+                residual = duty * v - sim_battery_voltage(&sim->bat, current / duty - i_load)
+                    - sim->r_dcdc * current / duty;
+            }
+            // residual increases with the PV voltage
+            if (residual > 0) {
+                high = v;
+            }
+            else {
+                low = v;
+            }
+        }
+        v_pv = high;
+        i_pv = sim_pv_current(pv, v_pv, irradiance);
+    }
+
+    sim->pv_power = v_pv * i_pv;
+    sim->pv_energy += sim->pv_power * dt / 3600;
+
+    if (sim->boost) {
+        i_bat = duty * i_pv;
+        sim->ls.voltage = v_pv;
+        sim->ls.current = -i_pv;
+        sim->hs.voltage = sim_battery_voltage(&sim->bat, i_bat);
+        sim->hs.current = i_bat;
+        sim->dcdc.ls_current = -i_pv;
+    }
+    else {
+        float i_dcdc = (duty > 0) ? i_pv / duty : 0;
+        i_bat = i_dcdc - i_load;
+        sim->hs.voltage = v_pv;
+        sim->hs.current = -i_pv;
+        sim->ls.voltage = sim_battery_voltage(&sim->bat, i_bat);
+        sim->ls.current = i_bat;
+        sim->dcdc.ls_current = i_dcdc;
+        sim->load.voltage = sim->ls.voltage;
+        sim->load.current = i_load;
+        sim->load_energy += sim->load.voltage * i_load * dt / 3600;
+    }
+
+    _battery_update(&sim->bat, i_bat, dt);
+}
+
+static float _no_load(float)
+{
+    return 0;
+}
+
+void plant_sim_init(plant_sim_t *sim, bool boost)
+{
+    static const sim_pv_t pv_36_cells = { 22.0, 5.5, 36 * 1.3 * 0.0257, 2, 1.0 };
+
+    *sim = plant_sim_t();
+    sim->pv = &pv_36_cells;
+    sim->irradiance = sim_irradiance_clear_day;
+    sim->load_current = _no_load;
+    sim->r_dcdc = 0.05;
+    sim->boost = boost;
+
+    // same initialization as in main()
+    int num_cells = boost ? 12 : 6;
+    battery_conf_init(&sim->bat_conf, BAT_TYPE_GEL, num_cells, 50);
+    battery_state_init(&sim->bat_state);
+    sim_battery_init(&sim->bat, num_cells, 50, 0.5);
+    load_init(&sim->load);
+    dcdc_init(&sim->dcdc);
+    half_bridge_init(&sim->dcdc.half_bridge, 1, 70, 300, 12 / sim->dcdc.hs_voltage_max, 0.97);
+
+    if (boost) {
+        sim->dcdc.mode = MODE_MPPT_BOOST;
+        power_port_init_solar(&sim->ls);
+        power_port_init_bat(&sim->hs, &sim->bat_conf);
+        sim->bat_port = &sim->hs;
+    }
+    else {
+        sim->dcdc.mode = MODE_MPPT_BUCK;
+        power_port_init_solar(&sim->hs);
+        power_port_init_bat(&sim->ls, &sim->bat_conf);
+        sim->bat_port = &sim->ls;
+    }
+}
+
+void plant_sim_step(plant_sim_t *sim)
+{
+    // firmware clock follows the virtual time
+    uptime = sim->time;
+
+    // system_control() called by control timer
+    float t = sim->time + (float)sim->cycle / CONTROL_FREQUENCY;
+    float irradiance = sim->irradiance(t);
+    float i_load = (sim->load.enabled && !sim->boost) ? sim->load_current(t) : 0;
+
+    // dcdc_fast_control() called by ADC DMA interrupt
+    for (int f = 0; f < FAST_CONTROL_FREQUENCY / CONTROL_FREQUENCY; f++) {
+        _plant_update(sim, irradiance, i_load);
+
+        dcdc_fast_meas_t meas;
+        meas.hs_voltage = sim->hs.voltage * 1000;
+        meas.ls_voltage = sim->ls.voltage * 1000;
+        meas.hs_current = sim->hs.current * 1000;
+        meas.ls_current = sim->ls.current * 1000;
+        meas.phase_imbalance = 0;
+        dcdc_fast_control(&sim->dcdc, &meas);
+    }
+
+    dcdc_control(&sim->dcdc, &sim->hs, &sim->ls);
+    load_control(&sim->load);
+
+    // energy available at the MPP (PV voltage limited by the battery in buck mode)
+    sim->mpp_power = 0;
+    if (irradiance > 0) {
+        float v_min = sim->boost ? 0 : sim->ls.voltage;
+        sim->mpp_power = sim_pv_power_max(sim->pv, irradiance, v_min);
+        sim->mpp_energy += sim->mpp_power / CONTROL_FREQUENCY / 3600;
+    }
+
+    if (++sim->cycle >= CONTROL_FREQUENCY) {
+        sim->cycle = 0;
+        sim->time++;
+        battery_update_energy(&sim->bat_state, sim->bat_port->voltage, sim->bat_port->current,
+            sim->dcdc.ls_current, sim->load.current);
+        battery_update_soc(&sim->bat_conf, &sim->bat_state, sim->bat_port->voltage,
+            sim->bat_port->current);
+
+        // slow tasks of the main loop
+        charger_state_machine(sim->bat_port, &sim->bat_conf, &sim->bat_state,
+            sim->bat_port->voltage, sim->bat_port->current);
+        load_state_machine(&sim->load, sim->ls.input_allowed);
+    }
+}
+
+void plant_sim_run(plant_sim_t *sim, int duration)
+{
+    for (int i = 0; i < duration * CONTROL_FREQUENCY; i++) {
+        plant_sim_step(sim);
+    }
+}
+
+float sim_irradiance_clear_day(float t)
+{
+    float hour = fmod(t / 3600, 24);
+    if (hour < 6 || hour > 18) {
+        return 0;
+    }
+    return sin(M_PI * (hour - 6) / 12);
+}
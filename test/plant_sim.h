@@ -0,0 +1,160 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PLANT_SIM_H
+#define PLANT_SIM_H
+
+/** @file
+ *
+ * @brief Closed-loop simulation of PV panel, DC/DC converter and battery for unit tests
+ *
+ * The firmware functions of the control timer (dcdc_control, load_control) and of the main
+ * loop (charger_state_machine, load_state_machine) are called with the same frequencies as on
+ * the target, while dcdc_fast_control() is called with FAST_CONTROL_FREQUENCY. Measurements
+ * are taken directly from the plant model, i.e. the ADC and its filters are not simulated.
+ *
+ * The firmware clock (uptime) is set to the virtual time of the simulation, so that a simulated
+ * day takes only seconds.
+ */
+
+#include "dcdc.h"
+#include "power_port.h"
+#include "battery.h"
+#include "load.h"
+
+#include <stdint.h>
+
+/** PV module described by single-diode model without resistances
+ *
+ * The cells are split into substrings with bypass diodes. The last substring may be shaded.
+ */
+typedef struct {
+    float voc;                  ///< Open-circuit voltage at full irradiance (V)
+    float isc;                  ///< Short-circuit current at full irradiance (A)
+    float vt;                   ///< Thermal voltage multiplied with number of cells and ideality factor (V)
+    int substrings;             ///< Number of substrings with bypass diode
+    float shading;              ///< Relative irradiance of the last substring (1.0 = unshaded)
+} sim_pv_t;
+
+/** Current of the PV module at given voltage
+ *
+ * @param pv PV module
+ * @param voltage Module voltage (V)
+ * @param irradiance Irradiance relative to STC (1.0 = 1000 W/m2)
+ */
+float sim_pv_current(const sim_pv_t *pv, float voltage, float irradiance);
+
+/** Maximum power of the PV module within the given voltage range
+ *
+ * The result of the last call is cached, as the calculation is expensive.
+ *
+ * @param pv PV module
+ * @param irradiance Irradiance relative to STC
+ * @param v_min Lowest voltage reachable by the DC/DC converter (V)
+ */
+float sim_pv_power_max(const sim_pv_t *pv, float irradiance, float v_min);
+
+/** Battery equivalent circuit model
+ *
+ * Open-circuit voltage linear with SOC, with a steep rise close to full charge (overpotential
+ * of lead-acid batteries) and a steep drop when empty, series resistance r0 and one RC element
+ * (r1, c1) for diffusion.
+ */
+typedef struct {
+    int num_cells;              ///< Number of lead-acid cells in series
+    float capacity;             ///< Capacity (Ah)
+    float r0;                   ///< Series resistance (Ohm)
+    float r1;                   ///< Resistance of RC element (Ohm)
+    float c1;                   ///< Capacitance of RC element (F)
+    float soc;                  ///< State of charge (0.0 to 1.0)
+    float v_rc;                 ///< Voltage across RC element (V)
+} sim_battery_t;
+
+/** Initializes battery model with typical values for lead-acid batteries
+ *
+ * @param bat Battery model
+ * @param num_cells Number of cells in series
+ * @param capacity Capacity (Ah)
+ * @param soc Initial state of charge (0.0 to 1.0)
+ */
+void sim_battery_init(sim_battery_t *bat, int num_cells, float capacity, float soc);
+
+/** Terminal voltage of the battery model
+ *
+ * @param bat Battery model
+ * @param current Charging current (A), negative for discharging
+ */
+float sim_battery_voltage(const sim_battery_t *bat, float current);
+
+/** Simulation of the complete system including the firmware objects under test
+ */
+typedef struct {
+    // plant
+    const sim_pv_t *pv;                 ///< PV module
+    float (*irradiance)(float t);       ///< Relative irradiance at time t (s)
+    float (*load_current)(float t);     ///< Current drawn by the load output at time t (s)
+    sim_battery_t bat;                  ///< Battery model
+    float r_dcdc;                       ///< Conduction losses of the DC/DC (inductor, MOSFETs)
+    bool boost;                         ///< PV at the low-side and battery at the high-side
+
+    // firmware
+    dcdc_t dcdc;
+    power_port_t hs;
+    power_port_t ls;
+    power_port_t *bat_port;
+    battery_conf_t bat_conf;
+    battery_state_t bat_state;
+    load_output_t load;
+
+    // results
+    uint32_t time;                      ///< Virtual time (s)
+    int cycle;                          ///< Control cycles since the last full second
+    float pv_power;                     ///< PV power of the last fast control cycle (W)
+    float mpp_power;                    ///< PV power available at the MPP in the last control cycle (W)
+    float pv_energy;                    ///< Energy harvested from PV (Wh)
+    float mpp_energy;                   ///< Energy available at the MPP (Wh)
+    float load_energy;                  ///< Energy supplied to the load output (Wh)
+} plant_sim_t;
+
+/** Initializes the simulation with default plant parameters and firmware configuration
+ *
+ * Plant parameters (pv, irradiance, load_current, bat, r_dcdc) can be changed afterwards.
+ *
+ * @param sim Simulation
+ * @param boost True to simulate MODE_MPPT_BOOST, false for MODE_MPPT_BUCK
+ */
+void plant_sim_init(plant_sim_t *sim, bool boost);
+
+/** Runs the closed-loop simulation for one cycle of the control timer (1 / CONTROL_FREQUENCY)
+ *
+ * The slow tasks of the main loop are called every full second.
+ *
+ * @param sim Simulation
+ */
+void plant_sim_step(plant_sim_t *sim);
+
+/** Runs the closed-loop simulation
+ *
+ * @param sim Simulation
+ * @param duration Simulated time (s)
+ */
+void plant_sim_run(plant_sim_t *sim, int duration);
+
+/** Clear-sky irradiance of a day starting at midnight (sunrise 6:00, sunset 18:00)
+ */
+float sim_irradiance_clear_day(float t);
+
+#endif /* PLANT_SIM_H */
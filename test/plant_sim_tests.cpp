@@ -0,0 +1,99 @@
+
+#include "tests.h"
+
+#include "plant_sim.h"
+#include "charger.h"
+#include "half_bridge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static plant_sim_t sim;
+
+static float load_5A(float)
+{
+    return 5.0;
+}
+
+void sunny_hour_charges_battery_close_to_mpp()
+{
+    plant_sim_init(&sim, false);
+    sim.time = 11 * 3600;
+
+    plant_sim_run(&sim, 3600);
+
+    TEST_ASSERT(sim.bat.soc > 0.55);
+    TEST_ASSERT(sim.pv_energy > 0.95 * sim.mpp_energy);
+    TEST_ASSERT_EQUAL(CHG_STATE_BULK, sim.bat_state.chg_state);
+    half_bridge_stop(&sim.dcdc.half_bridge);
+}
+
+void charger_reaches_trickle_with_full_battery()
+{
+    plant_sim_init(&sim, false);
+    sim_battery_init(&sim.bat, 6, 50, 0.97);
+    sim.time = 11 * 3600;
+
+    plant_sim_run(&sim, 2 * 3600);
+
+    TEST_ASSERT_EQUAL(true, sim.bat_state.full);
+    TEST_ASSERT_EQUAL(CHG_STATE_TRICKLE, sim.bat_state.chg_state);
+    TEST_ASSERT(sim.ls.voltage < sim.bat_conf.voltage_topping + 0.1);
+    half_bridge_stop(&sim.dcdc.half_bridge);
+}
+
+void load_disconnected_at_night_with_empty_battery()
+{
+    plant_sim_init(&sim, false);
+    sim_battery_init(&sim.bat, 6, 50, 0.15);
+    sim.load_current = load_5A;
+
+    plant_sim_run(&sim, 60);
+    TEST_ASSERT_EQUAL(LOAD_STATE_ON, sim.load.switch_state);
+
+    plant_sim_run(&sim, 2 * 3600);
+    TEST_ASSERT_EQUAL(LOAD_STATE_OFF_LOW_SOC, sim.load.switch_state);
+    TEST_ASSERT_EQUAL(false, half_bridge_enabled(&sim.dcdc.half_bridge));
+    TEST_ASSERT(sim.load_energy > 0);
+}
+
+void boost_mode_charges_high_side_battery()
+{
+    plant_sim_init(&sim, true);
+    sim.time = 11 * 3600;
+
+    plant_sim_run(&sim, 600);
+
+    TEST_ASSERT(sim.hs.current > 1.0);
+    TEST_ASSERT(sim.pv_energy > 0.9 * sim.mpp_energy);
+    half_bridge_stop(&sim.dcdc.half_bridge);
+}
+
+void plant_sim_tests()
+{
+    UNITY_BEGIN();
+
+    RUN_TEST(sunny_hour_charges_battery_close_to_mpp);
+    RUN_TEST(charger_reaches_trickle_with_full_battery);
+    RUN_TEST(load_disconnected_at_night_with_empty_battery);
+    RUN_TEST(boost_mode_charges_high_side_battery);
+
+    UNITY_END();
+
+    // simulation of an entire day with hourly results: PLANT_SIM_DAY=1
+    if (getenv("PLANT_SIM_DAY") != NULL) {
+        plant_sim_init(&sim, false);
+        sim.load_current = load_5A;
+        clock_t start = clock();
+        printf("| %4s | %8s | %8s | %8s | %6s | %7s | %4s |\n", "Hour", "PV (Wh)", "MPP (Wh)",
+            "Load (Wh)", "SOC", "Bat (V)", "Chg");
+        for (int hour = 1; hour <= 24; hour++) {
+            plant_sim_run(&sim, 3600);
+            printf("| %4d | %8.1f | %8.1f | %9.1f | %5.1f%% | %7.2f | %4d |\n", hour,
+                sim.pv_energy, sim.mpp_energy, sim.load_energy, sim.bat.soc * 100,
+                sim.ls.voltage, sim.bat_state.chg_state);
+        }
+        float duration = (float)(clock() - start) / CLOCKS_PER_SEC;
+        printf("Simulated 24 h in %.1f s (%.0fx real time)\n", duration, 24 * 3600 / duration);
+    }
+}
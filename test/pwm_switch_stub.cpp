@@ -0,0 +1,48 @@
+/* LibreSolar charge controller firmware
+ * Copyright (c) 2016-2019 Martin Jäger (www.libre.solar)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "pwm_switch.h"
+
+static float _duty;
+
+static bool _enabled;
+
+void pwm_switch_set_duty_cycle(float duty)
+{
+    _duty = duty;
+}
+
+float pwm_switch_get_duty_cycle()
+{
+    return _duty;
+}
+
+void pwm_switch_start(float pwm_duty)
+{
+    pwm_switch_set_duty_cycle(pwm_duty);
+    _enabled = true;
+}
+
+void pwm_switch_stop()
+{
+    _enabled = false;
+}
+
+bool pwm_switch_enabled()
+{
+    return _enabled;
+}
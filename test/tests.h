@@ -1,6 +1,57 @@
 #include <unity.h>
 #include <time.h>
 
+#include "half_bridge.h"
+
 void charger_tests();
 
+void adc_tests();
+
+void log_tests();
+
+void eeprom_tests();
+
+void adc_scope_tests();
+
+void meas_snapshot_tests();
+
+void adc_replay_tests();
+
+void dcdc_tests();
+
+/* Inductor current of the half bridge stub in buck operation (steady state)
+ *
+ * The DC/DC is modelled with a resistance r_ohm for all losses and an inductance l_uH. The
+ * position within the switching period (0..1) is relative to the timer counter value 0.
+ */
+float half_bridge_stub_current(const half_bridge_t *hb, float v_hs, float v_ls, float r_ohm,
+    float l_uH, float pos);
+
+/* Duty cycles applied by the half bridge host backend to the given instance
+ *
+ * Each update of the compare value is recorded with the limits and resolution of the driver
+ * (the last 1024 updates of all instances are kept). Returns the number of entries written to
+ * duty, oldest first.
+ */
+int half_bridge_host_history(const half_bridge_t *hb, float *duty, int max_entries);
+
+void half_bridge_host_clear_history();
+
+/* Configuration hooks called by the driver for the host backend
+ *
+ * Returns the names of the hooks (e.g. "init_timer init_channel lock") in the order of their
+ * calls since the last clear.
+ */
+const char *half_bridge_host_config_log();
+
+void half_bridge_host_clear_config_log();
+
+void half_bridge_tests();
+
+void mppt_tests();
+
+void plant_sim_tests();
+
+void mppt_benchmark_tests();
+
 void battery_tests();